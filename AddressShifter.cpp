@@ -0,0 +1,25 @@
+#include "AddressShifter.h"
+
+#include "SpiDevice.h"
+
+AddressShifter::AddressShifter(SpiDevice* pDevice) : mpDevice(pDevice)
+{
+}
+
+bool AddressShifter::SetAddress(uint32_t address)
+{
+	uint8_t bytes[3] = { (uint8_t)(address >> 16), (uint8_t)(address >> 8), (uint8_t)address };
+	
+	mNumShifts++;
+	return mpDevice->Write(bytes, sizeof(bytes));
+}
+
+void AddressShifter::Clear()
+{
+	SetAddress(0);
+}
+
+uint64_t AddressShifter::GetNumKernelCalls() const
+{
+	return mpDevice->GetNumKernelCalls();
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include <cstdint>
+
+class SpiDevice;
+
+// The address bus through three 74HC595s chained off SPI instead of the two 74HC373s, for
+// --address-spi. The whole 24 bit address goes out as one 3 byte transfer, bank first so it ends up
+// in the last 595, and chip select going back up at the end clocks all three storage registers at
+// once, so the cart sees the new address change in one step.
+//
+// Wiring: SPI0 MOSI (gpio10) to the first 595's SER, SCLK (gpio11) to every SRCLK, and chip select
+// to every RCLK. SPI0's own CE0 is gpio8, which is a data line here, so chip select moves to gpio5
+// (the old address latch enable) with dtoverlay=spi0-1cs,cs0_pin=5. /OE is tied low and /SRCLR
+// high. The rest of the old address and latch lines (gpio 2-4, 6, 9, 13, 16, 17, 19, 22, 26, 27)
+// are left alone by the bus code in this mode.
+//
+// It's one ioctl per address against four gpiod ones for a latched low byte, so it mostly helps
+// the gpiod backend. A whole bank's addresses could go out as one DMA'd message, but nothing here
+// could sample the data bus in step with it, so addresses still go out one at a time.
+class AddressShifter
+{
+public:
+	AddressShifter(SpiDevice* pDevice);
+	
+	bool SetAddress(uint32_t address);
+	
+	// The 595s can't float their outputs with /OE tied low, so this parks them at 0.
+	void Clear();
+	
+	uint32_t GetNumShifts() const { return mNumShifts; }
+	uint64_t GetNumKernelCalls() const;
+	
+private:
+	SpiDevice* mpDevice = nullptr;
+	uint32_t mNumShifts = 0;
+};
@@ -0,0 +1,315 @@
+#include "Batch.h"
+
+#include <cstring>
+#include <stdio.h>
+
+static const char* gBatchOpNames[] = { "probe", "dump", "sram-backup", "sram-restore" };
+static const char* gBatchResultNames[] = { "skipped", "ok", "failed" };
+
+const char* GetBatchOpName(BatchOp op)
+{
+	return gBatchOpNames[(uint32_t)op];
+}
+
+BatchManifest::~BatchManifest()
+{
+	delete[] mpCarts;
+	mpCarts = nullptr;
+}
+
+bool BatchManifest::Load(const char* pFileName)
+{
+	FILE* pFile = fopen(pFileName, "r");
+	if(!pFile)
+	{
+		printf("Batch: Failed to open manifest '%s'\n", pFileName);
+		return false;
+	}
+	
+	delete[] mpCarts;
+	mpCarts = new BatchCart[MAX_BATCH_CARTS];
+	mNumCarts = 0;
+	
+	bool failed = false;
+	char line[MAX_BATCH_LINE];
+	for(uint32_t lineNum = 1; !failed && fgets(line, sizeof(line), pFile); lineNum++)
+	{
+		char* pComment = strchr(line, '#');
+		if(pComment)
+		{
+			*pComment = 0;
+		}
+		
+		char* pSave = nullptr;
+		const char* pName = strtok_r(line, " \t\r\n", &pSave);
+		if(!pName)
+		{
+			continue;
+		}
+		
+		// names become file names here, the same as --game's
+		if(strchr(pName, '/') || pName[0] == '.' || strlen(pName) >= sizeof(mpCarts[0].mName))
+		{
+			printf("Batch: %s:%d: '%s' can't be a file name\n", pFileName, lineNum, pName);
+			failed = true;
+			break;
+		}
+		
+		if(mNumCarts >= MAX_BATCH_CARTS)
+		{
+			printf("Batch: %s:%d: More than %d carts, split the manifest\n", pFileName, lineNum, MAX_BATCH_CARTS);
+			failed = true;
+			break;
+		}
+		
+		BatchCart& cart = mpCarts[mNumCarts];
+		memset(&cart, 0, sizeof(cart));
+		strcpy(cart.mName, pName);
+		
+		for(const char* pOp = strtok_r(nullptr, " \t\r\n", &pSave); pOp; pOp = strtok_r(nullptr, " \t\r\n", &pSave))
+		{
+			uint32_t op = 0;
+			while(op < sizeof(gBatchOpNames) / sizeof(gBatchOpNames[0]) && strcmp(gBatchOpNames[op], pOp))
+			{
+				op++;
+			}
+			
+			if(op == sizeof(gBatchOpNames) / sizeof(gBatchOpNames[0]))
+			{
+				printf("Batch: %s:%d: Unknown job '%s', expected probe, dump, sram-backup or sram-restore\n", pFileName, lineNum, pOp);
+				failed = true;
+				break;
+			}
+			
+			if(cart.mNumJobs >= MAX_BATCH_JOBS)
+			{
+				printf("Batch: %s:%d: More than %d jobs for one cart\n", pFileName, lineNum, MAX_BATCH_JOBS);
+				failed = true;
+				break;
+			}
+			
+			cart.mJobs[cart.mNumJobs].mOp = (BatchOp)op;
+			cart.mJobs[cart.mNumJobs].mResult = BatchResult::Skipped;
+			cart.mNumJobs++;
+		}
+		
+		if(!failed && cart.mNumJobs == 0)
+		{
+			printf("Batch: %s:%d: Nothing to do with '%s'\n", pFileName, lineNum, pName);
+			failed = true;
+		}
+		
+		mNumCarts++;
+	}
+	
+	fclose(pFile);
+	pFile = NULL;
+	
+	if(!failed && mNumCarts == 0)
+	{
+		printf("Batch: No carts in '%s'\n", pFileName);
+		failed = true;
+	}
+	
+	return !failed;
+}
+
+void BatchManifest::PrintSummary() const
+{
+	uint32_t numOk = 0;
+	uint32_t numFailed = 0;
+	uint32_t numSkipped = 0;
+	
+	for(uint32_t c = 0; c < mNumCarts; c++)
+	{
+		const BatchCart& cart = mpCarts[c];
+		for(uint32_t j = 0; j < cart.mNumJobs; j++)
+		{
+			const BatchJob& job = cart.mJobs[j];
+			printf("Batch: %-20s %-12s %-7s %6.1fs\n", cart.mName, GetBatchOpName(job.mOp), gBatchResultNames[(uint32_t)job.mResult],
+				job.mSeconds + job.mFinishSeconds);
+			
+			numOk += (job.mResult == BatchResult::Ok) ? 1 : 0;
+			numFailed += (job.mResult == BatchResult::Failed) ? 1 : 0;
+			numSkipped += (job.mResult == BatchResult::Skipped) ? 1 : 0;
+		}
+	}
+	
+	printf("Batch: %d ok, %d failed, %d skipped\n", numOk, numFailed, numSkipped);
+}
+
+// How many bytes the UTF-8 sequence at p takes, or 0 if it isn't one (overlong, a surrogate or cut short).
+static uint32_t GetUtf8Length(const unsigned char* p)
+{
+	uint32_t length = 0;
+	unsigned char low = 0x80;
+	unsigned char high = 0xBF;
+	
+	if(p[0] >= 0xC2 && p[0] <= 0xDF)
+	{
+		length = 2;
+	}
+	else if(p[0] >= 0xE0 && p[0] <= 0xEF)
+	{
+		length = 3;
+		low = (p[0] == 0xE0) ? 0xA0 : low;
+		high = (p[0] == 0xED) ? 0x9F : high;
+	}
+	else if(p[0] >= 0xF0 && p[0] <= 0xF4)
+	{
+		length = 4;
+		low = (p[0] == 0xF0) ? 0x90 : low;
+		high = (p[0] == 0xF4) ? 0x8F : high;
+	}
+	else
+	{
+		return 0;
+	}
+	
+	if(p[1] < low || p[1] > high)
+	{
+		return 0;
+	}
+	
+	for(uint32_t i = 2; i < length; i++)
+	{
+		if(p[i] < 0x80 || p[i] > 0xBF)
+		{
+			return 0;
+		}
+	}
+	
+	return length;
+}
+
+// Names come from the manifest and the DAT LookUpRom reads, which are UTF-8, so that goes through as
+// it is. Only control characters are escaped, and anything that isn't UTF-8 becomes U+FFFD.
+static void WriteJsonString(FILE* pFile, const char* pString)
+{
+	fputc('"', pFile);
+	for(const unsigned char* p = (const unsigned char*)pString; *p; p++)
+	{
+		if(*p == '"' || *p == '\\')
+		{
+			fprintf(pFile, "\\%c", *p);
+		}
+		else if(*p < 0x20 || *p == 0x7F)
+		{
+			fprintf(pFile, "\\u%04x", *p);
+		}
+		else if(*p < 0x80)
+		{
+			fputc(*p, pFile);
+		}
+		else if(uint32_t length = GetUtf8Length(p))
+		{
+			fwrite(p, length, 1, pFile);
+			p += length - 1;
+		}
+		else
+		{
+			fprintf(pFile, "\\ufffd");
+		}
+	}
+	
+	fputc('"', pFile);
+}
+
+// A header's title is raw bytes, JIS X 0201 katakana on Japanese carts, which aren't UTF-8 or
+// Latin-1 either, so anything past ASCII comes out as '?'.
+static void WriteJsonTitle(FILE* pFile, const char* pTitle)
+{
+	char title[sizeof(BatchCart::mTitle)];
+	uint32_t length = 0;
+	
+	for(; pTitle[length] && length < sizeof(title) - 1; length++)
+	{
+		title[length] = (pTitle[length] & 0x80) ? '?' : pTitle[length];
+	}
+	
+	title[length] = 0;
+	WriteJsonString(pFile, title);
+}
+
+bool BatchManifest::WriteJson(const char* pFileName, double totalSeconds) const
+{
+	FILE* pFile = fopen(pFileName, "w");
+	if(!pFile)
+	{
+		printf("Failed to open file '%s' for write!\n", pFileName);
+		return false;
+	}
+	
+	fprintf(pFile, "{\n");
+	fprintf(pFile, "  \"seconds\": %.3f,\n", totalSeconds);
+	fprintf(pFile, "  \"carts\": [\n");
+	
+	for(uint32_t c = 0; c < mNumCarts; c++)
+	{
+		const BatchCart& cart = mpCarts[c];
+		
+		fprintf(pFile, "    {\n");
+		fprintf(pFile, "      \"name\": ");
+		WriteJsonString(pFile, cart.mName);
+		fprintf(pFile, ",\n      \"title\": ");
+		WriteJsonTitle(pFile, cart.mTitle);
+		fprintf(pFile, ",\n      \"probed\": %s,\n", cart.mProbed ? "true" : "false");
+		fprintf(pFile, "      \"insert_seconds\": %.3f,\n", cart.mInsertSeconds);
+		fprintf(pFile, "      \"jobs\": [\n");
+		
+		for(uint32_t j = 0; j < cart.mNumJobs; j++)
+		{
+			const BatchJob& job = cart.mJobs[j];
+			
+			fprintf(pFile, "        { \"job\": \"%s\", \"result\": \"%s\", \"seconds\": %.3f, \"bytes\": %u", GetBatchOpName(job.mOp),
+				gBatchResultNames[(uint32_t)job.mResult], job.mSeconds, job.mNumBytes);
+			
+			if(job.mFileName[0])
+			{
+				fprintf(pFile, ", \"file\": ");
+				WriteJsonString(pFile, job.mFileName);
+			}
+			
+			if(job.mOp == BatchOp::Dump)
+			{
+				fprintf(pFile, ", \"finish_seconds\": %.3f", job.mFinishSeconds);
+			}
+			
+			if(job.mHasDigests)
+			{
+				fprintf(pFile, ", \"crc32\": \"%08x\", \"md5\": \"", job.mDigests.mCrc32);
+				for(uint32_t i = 0; i < MD5_DIGEST_SIZE; i++)
+				{
+					fprintf(pFile, "%02x", job.mDigests.mMd5[i]);
+				}
+				
+				fprintf(pFile, "\", \"sha1\": \"");
+				for(uint32_t i = 0; i < SHA1_DIGEST_SIZE; i++)
+				{
+					fprintf(pFile, "%02x", job.mDigests.mSha1[i]);
+				}
+				
+				fprintf(pFile, "\"");
+			}
+			
+			if(job.mKnownName[0])
+			{
+				fprintf(pFile, ", \"known_as\": ");
+				WriteJsonString(pFile, job.mKnownName);
+			}
+			
+			fprintf(pFile, " }%s\n", (j + 1 < cart.mNumJobs) ? "," : "");
+		}
+		
+		fprintf(pFile, "      ]\n");
+		fprintf(pFile, "    }%s\n", (c + 1 < mNumCarts) ? "," : "");
+	}
+	
+	fprintf(pFile, "  ]\n");
+	fprintf(pFile, "}\n");
+	
+	bool failed = (fclose(pFile) != 0);
+	pFile = NULL;
+	
+	return !failed;
+}
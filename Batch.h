@@ -0,0 +1,83 @@
+#pragma once
+
+#include <cstdint>
+
+#include "DumpHasher.h"
+
+// --batch: a session of carts one after another, from a manifest with a line per cart, the name its
+// files go by and then what to do with it, in order:
+//
+//   # name    jobs
+//   smw       dump sram-backup
+//   ff2       sram-restore
+//   pushover  probe
+//
+// dump writes <name>.smc, sram-backup reads the SRAM to <name>.srm and sram-restore writes it back
+// from there. The cart is powered up and probed before its jobs either way; probe just makes a
+// missing header count as a failure. How every job went is written out as JSON at the end.
+#define MAX_BATCH_CARTS (256)
+#define MAX_BATCH_JOBS (8)
+#define MAX_BATCH_LINE (512)
+
+enum class BatchOp
+{
+	Probe,
+	Dump,
+	SRAMBackup,
+	SRAMRestore
+};
+
+enum class BatchResult
+{
+	Skipped,
+	Ok,
+	Failed
+};
+
+struct BatchJob
+{
+	BatchOp mOp;
+	BatchResult mResult;
+	double mSeconds;
+	uint32_t mNumBytes;
+	char mFileName[300];
+	
+	// dumps only. The part after the bus is done runs while the next cart goes in, see FinishRomDump.
+	double mFinishSeconds;
+	bool mHasDigests;
+	RomDigests mDigests;
+	char mKnownName[256];
+};
+
+struct BatchCart
+{
+	char mName[256];
+	BatchJob mJobs[MAX_BATCH_JOBS];
+	uint32_t mNumJobs;
+	
+	// what the probe found, and how long the cart took to go in
+	bool mProbed;
+	char mTitle[22];
+	double mInsertSeconds;
+};
+
+class BatchManifest
+{
+public:
+	~BatchManifest();
+	
+	// Logs the line and returns false for anything it doesn't understand
+	bool Load(const char* pFileName);
+	
+	uint32_t GetNumCarts() const { return mNumCarts; }
+	BatchCart& GetCart(uint32_t index) { return mpCarts[index]; }
+	
+	void PrintSummary() const;
+	bool WriteJson(const char* pFileName, double totalSeconds) const;
+
+private:
+	BatchCart* mpCarts = nullptr;
+	uint32_t mNumCarts = 0;
+};
+
+const char* GetBatchOpName(BatchOp op);
@@ -0,0 +1,731 @@
+#include "Bench.h"
+
+#include <cstring>
+#include <stdio.h>
+#include <time.h>
+
+#include "BusTiming.h"
+#include "CartBus.h"
+#include "Mapper.h"
+#include "PinMap.h"
+#include "RomManager.h"
+#include "SimCart.h"
+
+// The data bus pin table as a plain runtime array, the way the bus classes used to hold it.
+uint8_t gBenchDataLineIndices[] = {14,15,18,23,24,25,8,7};
+
+static uint32_t LoopToLevels(uint32_t value, const uint8_t* pLines, uint32_t numLines)
+{
+	uint32_t levels = 0;
+	for(uint32_t i = 0; i < numLines; i++)
+	{
+		levels |= ((value >> i) & 0x1) << pLines[i];
+	}
+	
+	return levels;
+}
+
+static uint32_t LoopFromLevels(uint32_t levels, const uint8_t* pLines, uint32_t numLines)
+{
+	uint32_t value = 0;
+	for(uint32_t i = 0; i < numLines; i++)
+	{
+		value |= ((levels >> pLines[i]) & 0x1) << i;
+	}
+	
+	return value;
+}
+
+void RunEncoderBench()
+{
+	const uint32_t numIterations = 100000000;
+	
+	// everything gets folded into sink so the compiler can't throw the work away
+	volatile uint32_t sink = 0;
+	uint32_t acc = 0;
+	
+	uint64_t start = GetTimeNs();
+	for(uint32_t i = 0; i < numIterations; i++)
+	{
+		acc ^= LoopToLevels(i & 0xFF, gBenchDataLineIndices, sizeof(gBenchDataLineIndices));
+	}
+	uint64_t loopEncodeNs = GetTimeNs() - start;
+	sink = acc;
+	
+	acc = 0;
+	start = GetTimeNs();
+	for(uint32_t i = 0; i < numIterations; i++)
+	{
+		acc ^= PinEncoder<DataPins>::ToLevels(i & 0xFF);
+	}
+	uint64_t tableEncodeNs = GetTimeNs() - start;
+	
+	if(acc != sink)
+	{
+		printf("RunEncoderBench: table and loop encodings disagree!\n");
+	}
+	
+	acc = 0;
+	start = GetTimeNs();
+	for(uint32_t i = 0; i < numIterations; i++)
+	{
+		acc ^= LoopFromLevels(i * 2654435761u, gBenchDataLineIndices, sizeof(gBenchDataLineIndices));
+	}
+	uint64_t loopDecodeNs = GetTimeNs() - start;
+	sink = acc;
+	
+	acc = 0;
+	start = GetTimeNs();
+	for(uint32_t i = 0; i < numIterations; i++)
+	{
+		acc ^= PinEncoder<DataPins>::FromLevels(i * 2654435761u);
+	}
+	uint64_t tableDecodeNs = GetTimeNs() - start;
+	
+	if(acc != sink)
+	{
+		printf("RunEncoderBench: table and loop decodings disagree!\n");
+	}
+	
+	printf("encode: loop %.2fns, table %.2fns per byte\n", (double)loopEncodeNs / numIterations, (double)tableEncodeNs / numIterations);
+	printf("decode: loop %.2fns, table %.2fns per byte\n", (double)loopDecodeNs / numIterations, (double)tableDecodeNs / numIterations);
+}
+
+enum class BusOp
+{
+	SetAddress,
+	DataHiZ,
+	DataRead,
+	DataWrite,
+	CartEnable,
+	Count
+};
+
+static const char* gBusOpNames[] = { "set_address", "data_hiz", "data_read", "data_write", "cart_enable" };
+
+// Latencies with full resolution up to 128ns and 64 buckets per power of two above that,
+// so percentiles are good to ~1.5% without keeping every sample.
+#define LATENCY_EXACT_BUCKETS (128)
+#define LATENCY_SUB_BUCKETS (64)
+#define LATENCY_NUM_BUCKETS (LATENCY_EXACT_BUCKETS + (40 * LATENCY_SUB_BUCKETS))
+
+class LatencyHistogram
+{
+public:
+	void Clear()
+	{
+		memset(mBuckets, 0, sizeof(mBuckets));
+		mCount = 0;
+		mTotalNs = 0;
+		mMaxNs = 0;
+	}
+	
+	void Add(uint64_t ns)
+	{
+		mBuckets[GetBucket(ns)]++;
+		mCount++;
+		mTotalNs += ns;
+		mMaxNs = ns > mMaxNs ? ns : mMaxNs;
+	}
+	
+	uint64_t GetCount() const { return mCount; }
+	uint64_t GetMaxNs() const { return mMaxNs; }
+	double GetMeanNs() const { return mCount ? (double)mTotalNs / mCount : 0.0; }
+	
+	uint64_t GetPercentileNs(double percentile) const
+	{
+		uint64_t target = (uint64_t)(mCount * percentile / 100.0);
+		uint64_t seen = 0;
+		
+		for(uint32_t i = 0; i < LATENCY_NUM_BUCKETS; i++)
+		{
+			seen += mBuckets[i];
+			if(seen > target)
+			{
+				return GetBucketNs(i);
+			}
+		}
+		
+		return mMaxNs;
+	}
+	
+private:
+	static uint32_t GetBucket(uint64_t ns)
+	{
+		if(ns < LATENCY_EXACT_BUCKETS)
+		{
+			return (uint32_t)ns;
+		}
+		
+		uint32_t msb = 63 - __builtin_clzll(ns);
+		uint32_t shift = msb - 6;
+		uint32_t bucket = LATENCY_EXACT_BUCKETS + ((msb - 7) * LATENCY_SUB_BUCKETS) + ((ns >> shift) & (LATENCY_SUB_BUCKETS - 1));
+		
+		return bucket < LATENCY_NUM_BUCKETS ? bucket : LATENCY_NUM_BUCKETS - 1;
+	}
+	
+	static uint64_t GetBucketNs(uint32_t bucket)
+	{
+		if(bucket < LATENCY_EXACT_BUCKETS)
+		{
+			return bucket;
+		}
+		
+		uint32_t msb = ((bucket - LATENCY_EXACT_BUCKETS) / LATENCY_SUB_BUCKETS) + 7;
+		uint32_t sub = (bucket - LATENCY_EXACT_BUCKETS) % LATENCY_SUB_BUCKETS;
+		
+		return (uint64_t)(LATENCY_SUB_BUCKETS + sub) << (msb - 6);
+	}
+	
+private:
+	uint32_t mBuckets[LATENCY_NUM_BUCKETS];
+	uint64_t mCount;
+	uint64_t mTotalNs;
+	uint64_t mMaxNs;
+};
+
+struct WorkloadResult
+{
+	const char* mpName;
+	uint32_t mNumBytes;
+	uint64_t mElapsedNs;
+	uint64_t mKernelCalls;
+	uint32_t mNumErrors;
+	bool mSkipped;
+	LatencyHistogram mOps[(uint32_t)BusOp::Count];
+};
+
+enum class Workload
+{
+	LoROMDump,
+	RandomReads,
+	SRAMRoundTrip,
+	SetAddress,
+	LoROMRunDump,
+	LoROMPipelinedDump,
+	Count
+};
+
+static const char* gWorkloadNames[] = { "lorom_dump", "random_reads", "sram_round_trip", "set_address", "lorom_run_dump", "lorom_pipelined_dump" };
+
+static WorkloadResult gWorkloadResults[(uint32_t)Workload::Count];
+
+// what reading the clock costs, taken off every timed operation
+static uint64_t gClockCostNs = 0;
+
+// where the workloads put what they read
+static uint8_t* gpBenchBuffer = nullptr;
+
+// nullptr for the plain run, otherwise where each timed operation goes
+static LatencyHistogram* gpOpHistograms = nullptr;
+
+// where the SRAM round trip finds the SRAM, from the cart's header
+static const Mapper* gpBenchSRAMMapper = nullptr;
+
+// what the SRAM was before the round trip, kept until it's been put back
+#define BENCH_SRAM_BACKUP_FILE "bench-sram-backup.srm"
+
+template<typename Func>
+inline void TimeOp(BusOp op, Func func)
+{
+	if(!gpOpHistograms)
+	{
+		func();
+		return;
+	}
+	
+	uint64_t start = GetTimeNs();
+	func();
+	uint64_t elapsedNs = GetTimeNs() - start;
+	
+	gpOpHistograms[(uint32_t)op].Add(elapsedNs > gClockCostNs ? elapsedNs - gClockCostNs : 0);
+}
+
+// ReadCartByte and WriteCartByte step for step, with each bus operation timed
+static uint8_t BenchReadByte(uint32_t address, bool romSel)
+{
+	TimeOp(BusOp::CartEnable, [] { gCartEnable.Write(1); });
+	DelayNs(gBusTimings.mHoldNs);
+	
+	TimeOp(BusOp::SetAddress, [address] { gAddressLines.SetAddress(address); });
+	DelayNs(gBusTimings.mSetupNs);
+	
+	TimeOp(BusOp::DataHiZ, [] { gDataLines.HiZ(); });
+	DelayNs(gBusTimings.mSetupNs);
+	
+	TimeOp(BusOp::CartEnable, [romSel] { gCartEnable.Write(romSel ? 0 : 1); });
+	DelayNs(gBusTimings.mAccessNs);
+	
+	uint8_t value = 0;
+	TimeOp(BusOp::DataRead, [&value] { value = gDataLines.Read(); });
+	DelayNs(gBusTimings.mHoldNs);
+	
+	TimeOp(BusOp::DataHiZ, [] { gDataLines.HiZ(); });
+	DelayNs(gBusTimings.mHoldNs);
+	
+	return value;
+}
+
+static void BenchWriteByte(uint32_t address, uint8_t value, bool romSel)
+{
+	gWriteEnable.Write(1);
+	DelayNs(gBusTimings.mHoldNs);
+	
+	TimeOp(BusOp::DataHiZ, [] { gDataLines.HiZ(); });
+	DelayNs(gBusTimings.mHoldNs);
+	
+	TimeOp(BusOp::CartEnable, [] { gCartEnable.Write(1); });
+	DelayNs(gBusTimings.mHoldNs);
+	
+	TimeOp(BusOp::SetAddress, [address] { gAddressLines.SetAddress(address); });
+	DelayNs(gBusTimings.mSetupNs);
+	
+	TimeOp(BusOp::CartEnable, [romSel] { gCartEnable.Write(romSel ? 0 : 1); });
+	DelayNs(gBusTimings.mSetupNs);
+	
+	gWriteEnable.Write(0);
+	DelayNs(gBusTimings.mSetupNs);
+	
+	TimeOp(BusOp::DataWrite, [value] { gDataLines.Write(value); });
+	DelayNs(gBusTimings.mWritePulseNs);
+	
+	if(romSel)
+	{
+		TimeOp(BusOp::CartEnable, [] { gCartEnable.Write(1); });
+		DelayNs(gBusTimings.mHoldNs);
+	}
+	
+	gWriteEnable.Write(1);
+	TimeOp(BusOp::DataHiZ, [] { gDataLines.HiZ(); });
+	DelayNs(gBusTimings.mHoldNs);
+}
+
+// Both halves of the bench run the same code; timed only changes whether each bus operation is timed.
+static uint32_t RunWorkload(Workload workload, uint32_t numBytes)
+{
+	const Mapper* pMapper = GetMapper(RomMapping::LoROM);
+	BusRun runs[MAX_BUS_RUNS];
+	uint32_t numErrors = 0;
+	
+	switch(workload)
+	{
+		case Workload::LoROMDump:
+		{
+			for(uint32_t i = 0; i < numBytes;)
+			{
+				uint32_t numRuns = pMapper->GetRomBatch(i, numBytes - i, runs, MAX_BUS_RUNS);
+				for(uint32_t r = 0; r < numRuns; r++)
+				{
+					for(uint32_t a = 0; a < runs[r].mLength; a++, i++)
+					{
+						gpBenchBuffer[i] = BenchReadByte(runs[r].mAddress + a, runs[r].mRomSel);
+					}
+				}
+			}
+			
+			break;
+		}
+		
+		case Workload::RandomReads:
+		{
+			// same seed every run so the address sequence, and what SetAddress gets to skip, is repeatable
+			uint32_t seed = 12345;
+			for(uint32_t i = 0; i < numBytes / 8; i++)
+			{
+				seed = seed * 1664525 + 1013904223;
+				BusRun run = pMapper->GetRomRun((seed >> 8) % numBytes);
+				
+				gpBenchBuffer[i] = BenchReadByte(run.mAddress, run.mRomSel);
+			}
+			
+			break;
+		}
+		
+		case Workload::SRAMRoundTrip:
+		{
+			// read it, write the inverse, check it, put it back, check that
+			uint32_t sramSize = numBytes / 4;
+			uint8_t* pSaved = gpBenchBuffer + sramSize;
+			
+			for(uint32_t pass = 0; pass < 4; pass++)
+			{
+				for(uint32_t i = 0; i < sramSize;)
+				{
+					uint32_t numRuns = gpBenchSRAMMapper->GetSRAMBatch(i, sramSize - i, runs, MAX_BUS_RUNS);
+					for(uint32_t r = 0; r < numRuns; r++)
+					{
+						for(uint32_t a = 0; a < runs[r].mLength; a++, i++)
+						{
+							uint32_t address = runs[r].mAddress + a;
+							
+							if(pass == 0)
+							{
+								pSaved[i] = BenchReadByte(address, runs[r].mRomSel);
+							}
+							else if(pass == 1)
+							{
+								BenchWriteByte(address, ~pSaved[i], runs[r].mRomSel);
+							}
+							else if(pass == 2)
+							{
+								uint8_t value = BenchReadByte(address, runs[r].mRomSel);
+								numErrors += (value != (uint8_t)~pSaved[i]) ? 1 : 0;
+								
+								BenchWriteByte(address, pSaved[i], runs[r].mRomSel);
+							}
+							else
+							{
+								numErrors += (BenchReadByte(address, runs[r].mRomSel) != pSaved[i]) ? 1 : 0;
+							}
+						}
+					}
+				}
+			}
+			
+			break;
+		}
+		
+		case Workload::SetAddress:
+		{
+			for(uint32_t i = 0; i < numBytes;)
+			{
+				uint32_t numRuns = pMapper->GetRomBatch(i, numBytes - i, runs, MAX_BUS_RUNS);
+				for(uint32_t r = 0; r < numRuns; r++)
+				{
+					for(uint32_t a = 0; a < runs[r].mLength; a++, i++)
+					{
+						uint32_t address = runs[r].mAddress + a;
+						TimeOp(BusOp::SetAddress, [address] { gAddressLines.SetAddress(address); });
+					}
+				}
+			}
+			
+			break;
+		}
+		
+		case Workload::LoROMRunDump:
+		{
+			// lorom_dump again through compiled BusPrograms, which run a whole run at once so
+			// there are no single operations to time
+			for(uint32_t i = 0; i < numBytes;)
+			{
+				uint32_t numRuns = pMapper->GetRomBatch(i, numBytes - i, runs, MAX_BUS_RUNS);
+				for(uint32_t r = 0; r < numRuns; r++)
+				{
+					ReadCartRunSerial(runs[r], gpBenchBuffer + i);
+					i += runs[r].mLength;
+				}
+			}
+			
+			break;
+		}
+		
+		case Workload::LoROMPipelinedDump:
+		{
+			for(uint32_t i = 0; i < numBytes;)
+			{
+				uint32_t numRuns = pMapper->GetRomBatch(i, numBytes - i, runs, MAX_BUS_RUNS);
+				for(uint32_t r = 0; r < numRuns; r++)
+				{
+					ReadCartRunPipelined(runs[r], gpBenchBuffer + i);
+					i += runs[r].mLength;
+				}
+			}
+			
+			break;
+		}
+		
+		default:
+		{
+			break;
+		}
+	}
+	
+	return numErrors;
+}
+
+// Copies the SRAM to BENCH_SRAM_BACKUP_FILE before the round trip writes over it, so a crash part
+// way doesn't take the save with it.
+static bool BackUpBenchSRAM(uint32_t sramSize)
+{
+	BusRun runs[MAX_BUS_RUNS];
+	for(uint32_t i = 0; i < sramSize;)
+	{
+		uint32_t numRuns = gpBenchSRAMMapper->GetSRAMBatch(i, sramSize - i, runs, MAX_BUS_RUNS);
+		for(uint32_t r = 0; r < numRuns; r++)
+		{
+			ReadCartRun(runs[r], gpBenchBuffer + i);
+			i += runs[r].mLength;
+		}
+	}
+	
+	FILE* pFile = fopen(BENCH_SRAM_BACKUP_FILE, "wb");
+	if(!pFile)
+	{
+		printf("Failed to open file '%s' for write!\n", BENCH_SRAM_BACKUP_FILE);
+		return false;
+	}
+	
+	bool written = fwrite(gpBenchBuffer, sramSize, 1, pFile) == 1;
+	written = (fclose(pFile) == 0) && written;
+	pFile = NULL;
+	
+	if(!written)
+	{
+		printf("RunBusBench: Couldn't back the SRAM up to '%s'\n", BENCH_SRAM_BACKUP_FILE);
+	}
+	
+	return written;
+}
+
+static void WriteBenchJson(FILE* pFile, const char* pBackendName)
+{
+	fprintf(pFile, "{\n");
+	fprintf(pFile, "  \"backend\": \"%s\",\n", pBackendName);
+	fprintf(pFile, "  \"timings_ns\": { \"latch\": %d, \"setup\": %d, \"access\": %d, \"hold\": %d, \"write_pulse\": %d },\n",
+		gBusTimings.mLatchNs, gBusTimings.mSetupNs, gBusTimings.mAccessNs, gBusTimings.mHoldNs, gBusTimings.mWritePulseNs);
+	fprintf(pFile, "  \"workloads\": [\n");
+	
+	for(uint32_t w = 0; w < (uint32_t)Workload::Count; w++)
+	{
+		const WorkloadResult& result = gWorkloadResults[w];
+		double seconds = result.mElapsedNs / 1e9;
+		
+		fprintf(pFile, "    {\n");
+		fprintf(pFile, "      \"name\": \"%s\",\n", result.mpName);
+		fprintf(pFile, "      \"bytes\": %u,\n", result.mNumBytes);
+		fprintf(pFile, "      \"seconds\": %.6f,\n", seconds);
+		fprintf(pFile, "      \"bytes_per_sec\": %.1f,\n", seconds > 0 ? result.mNumBytes / seconds : 0.0);
+		fprintf(pFile, "      \"kernel_calls\": %llu,\n", (unsigned long long)result.mKernelCalls);
+		fprintf(pFile, "      \"kernel_calls_per_byte\": %.3f,\n", result.mNumBytes ? (double)result.mKernelCalls / result.mNumBytes : 0.0);
+		fprintf(pFile, "      \"errors\": %u,\n", result.mNumErrors);
+		fprintf(pFile, "      \"skipped\": %s,\n", result.mSkipped ? "true" : "false");
+		fprintf(pFile, "      \"operations\": {");
+		
+		bool first = true;
+		for(uint32_t op = 0; op < (uint32_t)BusOp::Count; op++)
+		{
+			const LatencyHistogram& histogram = result.mOps[op];
+			if(!histogram.GetCount())
+			{
+				continue;
+			}
+			
+			fprintf(pFile, "%s\n        \"%s\": { \"count\": %llu, \"mean_ns\": %.1f, \"p50_ns\": %llu, \"p90_ns\": %llu, \"p99_ns\": %llu, \"p999_ns\": %llu, \"max_ns\": %llu }",
+				first ? "" : ",", gBusOpNames[op], (unsigned long long)histogram.GetCount(), histogram.GetMeanNs(),
+				(unsigned long long)histogram.GetPercentileNs(50.0), (unsigned long long)histogram.GetPercentileNs(90.0),
+				(unsigned long long)histogram.GetPercentileNs(99.0), (unsigned long long)histogram.GetPercentileNs(99.9),
+				(unsigned long long)histogram.GetMaxNs());
+			first = false;
+		}
+		
+		fprintf(pFile, "\n      }\n");
+		fprintf(pFile, "    }%s\n", (w + 1 < (uint32_t)Workload::Count) ? "," : "");
+	}
+	
+	fprintf(pFile, "  ]\n");
+	fprintf(pFile, "}\n");
+}
+
+// the address shifter's spidev ioctls count too
+static uint64_t GetNumKernelCalls(GPIOBackend* pBackend)
+{
+	AddressShifter* pShifter = gAddressLines.GetShifter();
+	return pBackend->GetNumKernelCalls() + (pShifter ? pShifter->GetNumKernelCalls() : 0);
+}
+
+bool RunBusBench(GPIOBackend* pBackend, const char* pBackendName, uint32_t numBytes, const char* pJsonFileName, bool writeSRAM)
+{
+	if(numBytes < 4)
+	{
+		printf("RunBusBench: Need at least a few bytes to work with\n");
+		return false;
+	}
+	
+	gpBenchBuffer = new uint8_t[numBytes * 2];
+	
+	uint64_t start = GetTimeNs();
+	for(uint32_t i = 0; i < 1000; i++)
+	{
+		GetTimeNs();
+	}
+	gClockCostNs = (GetTimeNs() - start) / 1000;
+	
+	// the state RunMain leaves a cart in, so the SRAM is powered
+	gWriteEnable.Write(1);
+	gCartEnable.Write(1);
+	gReset.Write(1);
+	gDataLines.HiZ();
+	usleep(100);
+	
+	// the SRAM round trip goes where the header says the SRAM is, and only as far as it goes, since
+	// past that are its mirrors
+	RomInfo romInfo;
+	bool found = ProbeRomInfo(ReadRomByte, &romInfo);
+	gpBenchSRAMMapper = GetMapper(romInfo.mMapping);
+	
+	const char* pSRAMSkipped = nullptr;
+	if(!found || romInfo.mSRAMSize == 0)
+	{
+		pSRAMSkipped = "the cart has no SRAM";
+	}
+	else if(!writeSRAM)
+	{
+		pSRAMSkipped = "it writes over the cart's SRAM, --bench-sram to let it";
+	}
+	
+	for(uint32_t w = 0; w < (uint32_t)Workload::Count; w++)
+	{
+		WorkloadResult& result = gWorkloadResults[w];
+		result.mpName = gWorkloadNames[w];
+		result.mNumBytes = (w == (uint32_t)Workload::RandomReads) ? numBytes / 8 : numBytes;
+		result.mElapsedNs = 0;
+		result.mKernelCalls = 0;
+		result.mNumErrors = 0;
+		result.mSkipped = false;
+		
+		for(uint32_t op = 0; op < (uint32_t)BusOp::Count; op++)
+		{
+			result.mOps[op].Clear();
+		}
+		
+		// Random reads are spread over numBytes but only do an eighth as many. The SRAM round trip
+		// touches every byte four times.
+		uint32_t workloadBytes = numBytes;
+		if(w == (uint32_t)Workload::SRAMRoundTrip)
+		{
+			uint32_t sramSize = (romInfo.mSRAMSize < numBytes / 4) ? romInfo.mSRAMSize : numBytes / 4;
+			if(pSRAMSkipped || !BackUpBenchSRAM(sramSize))
+			{
+				printf("%-16s skipped, %s\n", result.mpName, pSRAMSkipped ? pSRAMSkipped : "no backup of the SRAM");
+				result.mNumBytes = 0;
+				result.mSkipped = true;
+				continue;
+			}
+			
+			workloadBytes = sramSize * 4;
+			result.mNumBytes = workloadBytes;
+		}
+		
+		uint64_t kernelCallsBefore = GetNumKernelCalls(pBackend);
+		uint32_t backendErrorsBefore = pBackend->GetNumErrors();
+		
+		gpOpHistograms = nullptr;
+		start = GetTimeNs();
+		result.mNumErrors = RunWorkload((Workload)w, workloadBytes);
+		result.mElapsedNs = GetTimeNs() - start;
+		
+		result.mKernelCalls = GetNumKernelCalls(pBackend) - kernelCallsBefore;
+		result.mNumErrors += pBackend->GetNumErrors() - backendErrorsBefore;
+		
+		gpOpHistograms = result.mOps;
+		RunWorkload((Workload)w, workloadBytes);
+		gpOpHistograms = nullptr;
+		
+		printf("%-16s %8d bytes %9.1f KB/s %6.2f kernel calls/byte %d errors\n", result.mpName, result.mNumBytes,
+			result.mElapsedNs ? (result.mNumBytes / 1024.0) / (result.mElapsedNs / 1e9) : 0.0,
+			result.mNumBytes ? (double)result.mKernelCalls / result.mNumBytes : 0.0, result.mNumErrors);
+		
+		if(w == (uint32_t)Workload::SRAMRoundTrip)
+		{
+			if(result.mNumErrors == 0)
+			{
+				remove(BENCH_SRAM_BACKUP_FILE);
+			}
+			else
+			{
+				printf("RunBusBench: The SRAM may not have been put back, the save is in '%s'\n", BENCH_SRAM_BACKUP_FILE);
+			}
+		}
+	}
+	
+	gCartEnable.Write(1);
+	gReset.Write(0);
+	
+	delete[] gpBenchBuffer;
+	gpBenchBuffer = nullptr;
+	
+	FILE* pFile = fopen(pJsonFileName, "w");
+	if(!pFile)
+	{
+		printf("Failed to open file '%s' for write!\n", pJsonFileName);
+		return false;
+	}
+	
+	WriteBenchJson(pFile, pBackendName);
+	fclose(pFile);
+	pFile = NULL;
+	
+	printf("RunBusBench: Wrote results to '%s'\n", pJsonFileName);
+	
+	uint32_t numErrors = 0;
+	for(uint32_t w = 0; w < (uint32_t)Workload::Count; w++)
+	{
+		numErrors += gWorkloadResults[w].mNumErrors;
+	}
+	
+	return numErrors == 0;
+}
+
+// one way of reading the sweep, for RunPipelineCheck
+typedef void (*ReadRunFunc)(const BusRun& run, uint8_t* pData);
+
+static void ReadLoROMSweep(ReadRunFunc readRun, uint8_t* pData, uint32_t numBytes)
+{
+	const Mapper* pMapper = GetMapper(RomMapping::LoROM);
+	BusRun runs[MAX_BUS_RUNS];
+	
+	for(uint32_t i = 0; i < numBytes;)
+	{
+		uint32_t numRuns = pMapper->GetRomBatch(i, numBytes - i, runs, MAX_BUS_RUNS);
+		for(uint32_t r = 0; r < numRuns; r++)
+		{
+			readRun(runs[r], pData + i);
+			i += runs[r].mLength;
+		}
+	}
+}
+
+bool RunPipelineCheck(uint32_t numBytes, SimCart* pSimCart)
+{
+	uint8_t* pSerial = new uint8_t[numBytes];
+	uint8_t* pPipelined = new uint8_t[numBytes];
+	
+	gWriteEnable.Write(1);
+	gCartEnable.Write(1);
+	gReset.Write(1);
+	gDataLines.HiZ();
+	usleep(100);
+	
+	uint32_t violationsBefore = pSimCart ? pSimCart->GetNumViolations() : 0;
+	uint64_t start = GetTimeNs();
+	ReadLoROMSweep(ReadCartRunSerial, pSerial, numBytes);
+	uint64_t serialNs = GetTimeNs() - start;
+	uint32_t serialViolations = pSimCart ? pSimCart->GetNumViolations() - violationsBefore : 0;
+	
+	violationsBefore = pSimCart ? pSimCart->GetNumViolations() : 0;
+	start = GetTimeNs();
+	ReadLoROMSweep(ReadCartRunPipelined, pPipelined, numBytes);
+	uint64_t pipelinedNs = GetTimeNs() - start;
+	uint32_t pipelinedViolations = pSimCart ? pSimCart->GetNumViolations() - violationsBefore : 0;
+	
+	uint32_t numDiffering = 0;
+	for(uint32_t i = 0; i < numBytes; i++)
+	{
+		numDiffering += (pSerial[i] != pPipelined[i]) ? 1 : 0;
+	}
+	
+	gCartEnable.Write(1);
+	gReset.Write(0);
+	
+	printf("RunPipelineCheck: serial    %8d bytes %9.1f KB/s %d timing violations\n", numBytes,
+		serialNs ? (numBytes / 1024.0) / (serialNs / 1e9) : 0.0, serialViolations);
+	printf("RunPipelineCheck: pipelined %8d bytes %9.1f KB/s %d timing violations\n", numBytes,
+		pipelinedNs ? (numBytes / 1024.0) / (pipelinedNs / 1e9) : 0.0, pipelinedViolations);
+	printf("RunPipelineCheck: %d bytes differ%s\n", numDiffering, pSimCart ? "" : " (no sim cart, so no timing check)");
+	
+	delete[] pSerial;
+	delete[] pPipelined;
+	
+	return numDiffering == 0 && pipelinedViolations == 0;
+}
@@ -0,0 +1,26 @@
+#pragma once
+
+#include <cstdint>
+
+class GPIOBackend;
+class SimCart;
+
+// Times PinEncoder's compile time tables against the per-bit loops the bus used to run on every access.
+void RunEncoderBench();
+
+// Runs the standard bus workloads (linear LoROM dump, random reads, an SRAM round trip and SetAddress
+// on its own) on whatever backend the bus lines were created on, numBytes each. Throughput and kernel
+// calls per byte come from a plain run of each workload, per operation latency percentiles from a second
+// run with every bus operation timed. Prints a summary and writes the results as JSON to pJsonFileName.
+// Returns false if any workload had errors or the JSON couldn't be written.
+//
+// The SRAM round trip finds the SRAM from the cart's header and only runs with writeSRAM, since it
+// writes the inverse of the save over it. The save is copied to a file first and put back after,
+// and the file is only removed once it has read back whole. On a real cart run this with the cart
+// already inserted, like --game leaves it.
+bool RunBusBench(GPIOBackend* pBackend, const char* pBackendName, uint32_t numBytes, const char* pJsonFileName, bool writeSRAM);
+
+// Reads numBytes of LoROM once serially and once pipelined (see ReadCartRunPipelined), and checks
+// they came back the same and, with pSimCart, that the pipelined reads kept to its timing model.
+// Returns false if either didn't hold.
+bool RunPipelineCheck(uint32_t numBytes, SimCart* pSimCart);
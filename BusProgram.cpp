@@ -0,0 +1,260 @@
+#include "BusProgram.h"
+
+#include <time.h>
+
+#include "BusTiming.h"
+#include "GPIODBackend.h"
+#include "MMIOBackend.h"
+#include "SimBackend.h"
+
+void BusProgram::AddWrite(uint32_t lineMask, uint32_t levels)
+{
+	AddOp(BusProgramOpType::Write, lineMask);
+	mOps[mNumOps - 1].mLevels = levels;
+}
+
+void BusProgram::AddOp(BusProgramOpType type, uint32_t lineMask)
+{
+	if(mNumOps >= MAX_BUS_PROGRAM_OPS)
+	{
+		LOG("Too many ops. Increase MAX_BUS_PROGRAM_OPS.");
+		return;
+	}
+	
+	BusProgramOp& op = mOps[mNumOps++];
+	op.mType = type;
+	op.mLineMask = lineMask;
+	op.mLevels = 0;
+	op.mDelayNs = 0;
+}
+
+// Delays back to back (where a step the bus classes would have skipped sat between them) become one.
+void BusProgram::AddDelay(uint32_t ns)
+{
+	if(mNumOps > 0 && mOps[mNumOps - 1].mType == BusProgramOpType::Delay)
+	{
+		mOps[mNumOps - 1].mDelayNs += ns;
+		return;
+	}
+	
+	AddOp(BusProgramOpType::Delay);
+	mOps[mNumOps - 1].mDelayNs = ns;
+}
+
+// What GPIOAddressArray::SetAddress does for consecutive addresses in a bank: the low byte always
+// changes, so it's latched every time with the high byte put back afterwards, and the bank is left alone.
+void BusProgram::AddSetAddress()
+{
+	if(mpShifter)
+	{
+		AddOp(BusProgramOpType::ShiftAddress);
+		return;
+	}
+	
+	AddWrite(Latch8Thru15Pin::Mask(), Latch8Thru15Pin::Mask());
+	AddDelay(gBusTimings.mLatchNs);
+	AddOp(BusProgramOpType::WriteAddressLow, AddressPins::Mask());
+	AddWrite(Latch8Thru15Pin::Mask(), 0);
+	AddDelay(gBusTimings.mLatchNs);
+	AddOp(BusProgramOpType::WriteAddressHigh, AddressPins::Mask());
+}
+
+// ReadCartByte, with the data bus already HiZ from the byte before so neither HiZ touches it
+void BusProgram::CompileRead(bool romSel, AddressShifter* pShifter)
+{
+	mNumOps = 0;
+	mpShifter = pShifter;
+	
+	AddWrite(CartEnablePin::Mask(), PinEncoder<CartEnablePin>::ToLevels(1));
+	AddDelay(gBusTimings.mHoldNs);
+	
+	AddSetAddress();
+	AddDelay(gBusTimings.mSetupNs);
+	AddDelay(gBusTimings.mSetupNs);
+	
+	AddWrite(CartEnablePin::Mask(), PinEncoder<CartEnablePin>::ToLevels(romSel ? 0 : 1));
+	AddDelay(gBusTimings.mAccessNs);
+	
+	AddOp(BusProgramOpType::DataRead, DataPins::Mask());
+	AddDelay(gBusTimings.mHoldNs);
+	AddDelay(gBusTimings.mHoldNs);
+}
+
+// The rom and SRAM are asynchronous: with /ROMSEL (and /RD) left asserted their outputs simply
+// follow the address, valid an access time after it last changed. So the only thing that has to
+// come between two reads is the address settling and the access time from there. The 373 can't
+// be loaded any earlier, it's transparent while loading and would change the address under the
+// read still in flight.
+void BusProgram::CompilePipelinedRead(AddressShifter* pShifter)
+{
+	mNumOps = 0;
+	mpShifter = pShifter;
+	
+	AddSetAddress();
+	AddDelay(gBusTimings.mSetupNs);
+	AddDelay(gBusTimings.mAccessNs);
+	
+	AddOp(BusProgramOpType::DataRead, DataPins::Mask());
+}
+
+// WriteCartByte, likewise starting and ending with the data bus HiZ
+void BusProgram::CompileWrite(bool romSel, AddressShifter* pShifter)
+{
+	mNumOps = 0;
+	mpShifter = pShifter;
+	
+	AddWrite(WritePin::Mask(), PinEncoder<WritePin>::ToLevels(1));
+	AddDelay(gBusTimings.mHoldNs);
+	AddDelay(gBusTimings.mHoldNs);
+	
+	AddWrite(CartEnablePin::Mask(), PinEncoder<CartEnablePin>::ToLevels(1));
+	AddDelay(gBusTimings.mHoldNs);
+	
+	AddSetAddress();
+	AddDelay(gBusTimings.mSetupNs);
+	
+	AddWrite(CartEnablePin::Mask(), PinEncoder<CartEnablePin>::ToLevels(romSel ? 0 : 1));
+	AddDelay(gBusTimings.mSetupNs);
+	
+	AddWrite(WritePin::Mask(), PinEncoder<WritePin>::ToLevels(0));
+	AddDelay(gBusTimings.mSetupNs);
+	
+	AddOp(BusProgramOpType::DataOutput, DataPins::Mask());
+	AddDelay(gBusTimings.mWritePulseNs);
+	
+	if(romSel)
+	{
+		AddWrite(CartEnablePin::Mask(), PinEncoder<CartEnablePin>::ToLevels(1));
+		AddDelay(gBusTimings.mHoldNs);
+	}
+	
+	AddWrite(WritePin::Mask(), PinEncoder<WritePin>::ToLevels(1));
+	AddOp(BusProgramOpType::DataHiZ, DataPins::Mask());
+	AddDelay(gBusTimings.mHoldNs);
+}
+
+BusLoopStats* gpBusLoopStats = nullptr;
+
+void BusLoopStats::Reset()
+{
+	mNumBytes = 0;
+	mTotalNs = 0;
+	mMinNs = ~0ull;
+	mMaxNs = 0;
+	mMaxAddress = 0;
+	mNumSlow = 0;
+}
+
+void BusLoopStats::Print(const char* pName) const
+{
+	if(mNumBytes == 0)
+	{
+		return;
+	}
+	
+	printf("%s: %llu bus cycles, fastest %lluns, mean %lluns, worst %lluns at $%06X, %llu over twice the fastest\n", pName,
+		(unsigned long long)mNumBytes, (unsigned long long)mMinNs, (unsigned long long)(mTotalNs / mNumBytes),
+		(unsigned long long)mMaxNs, mMaxAddress, (unsigned long long)mNumSlow);
+}
+
+template<typename Backend, bool Timed>
+static void RunOps(Backend* pBackend, AddressShifter* pShifter, const BusProgramOp* pOps, uint32_t numOps, uint32_t address, uint32_t length, uint8_t* pData)
+{
+	uint64_t lastNs = Timed ? GetTimeNs() : 0;
+	
+	for(uint32_t i = 0; i < length; i++)
+	{
+		uint32_t byteAddress = address + i;
+		
+		for(const BusProgramOp* pOp = pOps; pOp < pOps + numOps; pOp++)
+		{
+			switch(pOp->mType)
+			{
+				case BusProgramOpType::Write:
+					pBackend->Write(pOp->mLineMask, pOp->mLevels);
+					break;
+				
+				case BusProgramOpType::WriteAddressLow:
+					pBackend->Write(pOp->mLineMask, PinEncoder<AddressPins>::ToLevels(byteAddress & 0xFF));
+					break;
+				
+				case BusProgramOpType::WriteAddressHigh:
+					pBackend->Write(pOp->mLineMask, PinEncoder<AddressPins>::ToLevels((byteAddress >> 8) & 0xFF));
+					break;
+				
+				case BusProgramOpType::ShiftAddress:
+					pShifter->SetAddress(byteAddress);
+					break;
+				
+				case BusProgramOpType::DataHiZ:
+					pBackend->Configure(pOp->mLineMask, LineDirection::HiZ, 0);
+					break;
+				
+				case BusProgramOpType::DataOutput:
+					pBackend->Configure(pOp->mLineMask, LineDirection::Output, PinEncoder<DataPins>::ToLevels(pData[i]));
+					break;
+				
+				case BusProgramOpType::DataRead:
+					pData[i] = PinEncoder<DataPins>::FromLevels(pBackend->Read(pOp->mLineMask));
+					break;
+				
+				case BusProgramOpType::Delay:
+					DelayNs(pOp->mDelayNs);
+					break;
+			}
+		}
+		
+		if(Timed)
+		{
+			uint64_t nowNs = GetTimeNs();
+			uint64_t elapsedNs = nowNs - lastNs;
+			lastNs = nowNs;
+			
+			BusLoopStats& stats = *gpBusLoopStats;
+			stats.mNumBytes++;
+			stats.mTotalNs += elapsedNs;
+			stats.mNumSlow += (stats.mNumBytes > 1 && elapsedNs > stats.mMinNs * 2) ? 1 : 0;
+			stats.mMinNs = elapsedNs < stats.mMinNs ? elapsedNs : stats.mMinNs;
+			
+			if(elapsedNs > stats.mMaxNs)
+			{
+				stats.mMaxNs = elapsedNs;
+				stats.mMaxAddress = byteAddress;
+			}
+		}
+	}
+}
+
+template<typename Backend>
+static void RunOps(Backend* pBackend, AddressShifter* pShifter, const BusProgramOp* pOps, uint32_t numOps, uint32_t address, uint32_t length, uint8_t* pData)
+{
+	if(gpBusLoopStats)
+	{
+		RunOps<Backend, true>(pBackend, pShifter, pOps, numOps, address, length, pData);
+	}
+	else
+	{
+		RunOps<Backend, false>(pBackend, pShifter, pOps, numOps, address, length, pData);
+	}
+}
+
+void BusProgram::Run(GPIOBackend* pBackend, uint32_t address, uint32_t length, uint8_t* pData) const
+{
+	// picked once per run, so every call inside is direct
+	if(MMIOBackend* pMMIOBackend = dynamic_cast<MMIOBackend*>(pBackend))
+	{
+		RunOps(pMMIOBackend, mpShifter, mOps, mNumOps, address, length, pData);
+	}
+	else if(GPIODBackend* pGPIODBackend = dynamic_cast<GPIODBackend*>(pBackend))
+	{
+		RunOps(pGPIODBackend, mpShifter, mOps, mNumOps, address, length, pData);
+	}
+	else if(SimBackend* pSimBackend = dynamic_cast<SimBackend*>(pBackend))
+	{
+		RunOps(pSimBackend, mpShifter, mOps, mNumOps, address, length, pData);
+	}
+	else
+	{
+		RunOps(pBackend, mpShifter, mOps, mNumOps, address, length, pData);
+	}
+}
@@ -0,0 +1,99 @@
+#pragma once
+
+#include <cstdint>
+
+#include "GPIOManager.h"
+
+// A read or write run compiled into the flat list of bus operations every byte of it takes,
+// with back to back delays already merged into one, and run by a tight loop instead of going
+// through the bus classes a call at a time. The steps are exactly the ones ReadCartByte and
+// WriteCartByte take. The only things that change from byte to byte are the address and the
+// data, so the ops say where to take those from rather than being compiled out per byte.
+//
+// The executor is instantiated for each backend, which are all final, so the backend is picked
+// once per run and every call inside it is direct rather than virtual.
+#define MAX_BUS_PROGRAM_OPS (32)
+
+enum class BusProgramOpType : uint8_t
+{
+	// drive mLevels onto mLineMask
+	Write,
+	
+	// the address lines, from the low or high byte of the byte's address
+	WriteAddressLow,
+	WriteAddressHigh,
+	
+	// or the whole address through the 595s, see AddressShifter
+	ShiftAddress,
+	
+	// the data bus, to HiZ or driving the byte being written
+	DataHiZ,
+	DataOutput,
+	
+	// sample the data bus into the byte being read
+	DataRead,
+	
+	Delay
+};
+
+struct BusProgramOp
+{
+	BusProgramOpType mType;
+	uint32_t mLineMask;
+	uint32_t mLevels;
+	uint32_t mDelayNs;
+};
+
+// How long each byte's trip round the program took, when gpBusLoopStats is set. It's measured
+// between clock reads at the end of each byte, so it includes one clock read (tens of ns).
+struct BusLoopStats
+{
+	void Reset();
+	void Print(const char* pName) const;
+	
+	uint64_t mNumBytes;
+	uint64_t mTotalNs;
+	uint64_t mMinNs;
+	uint64_t mMaxNs;
+	uint32_t mMaxAddress;
+	
+	// bytes that took more than twice the fastest one, which is a stall and not the bus
+	uint64_t mNumSlow;
+};
+
+// nullptr unless something (--realtime) wants the loop timed
+extern BusLoopStats* gpBusLoopStats;
+
+class BusProgram
+{
+public:
+	// A read cycle per byte, with /ROMSEL asserted or not. pShifter is where the address goes if
+	// it's on 74HC595s rather than the latches.
+	void CompileRead(bool romSel, AddressShifter* pShifter);
+	
+	// A read per byte with /ROMSEL held where romSel puts it for the whole run, for
+	// ReadCartRunPipelined. Each byte is just the next address, the access time and the read, so
+	// loading byte N+1's address starts the moment byte N has been sampled, in place of the holds,
+	// the /ROMSEL toggle and the second setup a CompileRead byte spends between them.
+	void CompilePipelinedRead(AddressShifter* pShifter);
+	
+	// An SRAM write cycle per byte
+	void CompileWrite(bool romSel, AddressShifter* pShifter);
+	
+	// Runs it for length bytes starting at address, which have to stay within one bank. pData is
+	// read into for a read program and written from for a write one.
+	void Run(GPIOBackend* pBackend, uint32_t address, uint32_t length, uint8_t* pData) const;
+	
+	uint32_t GetNumOps() const { return mNumOps; }
+	
+private:
+	void AddWrite(uint32_t lineMask, uint32_t levels);
+	void AddOp(BusProgramOpType type, uint32_t lineMask = 0);
+	void AddDelay(uint32_t ns);
+	void AddSetAddress();
+	
+private:
+	BusProgramOp mOps[MAX_BUS_PROGRAM_OPS];
+	uint32_t mNumOps = 0;
+	AddressShifter* mpShifter = nullptr;
+};
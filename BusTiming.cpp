@@ -0,0 +1,132 @@
+#include "BusTiming.h"
+
+#include <stdio.h>
+
+// Data sheet numbers for the 74HC373 and SNES roms/SRAMs, with some margin for
+// the level shifting and wire lengths on our rig.
+static const BusTimings gSlowROMTimings = { 50, 50, 200, 50, 100 };
+static const BusTimings gFastROMTimings = { 50, 50, 120, 50, 100 };
+
+BusTimings gBusTimings = gSlowROMTimings;
+
+// Start out pessimistic (a fast core) until CalibrateDelays has run, so an early delay is never too short.
+uint32_t gSpinsPerUs = 4000;
+
+void SetCartSpeed(CartSpeed speed, uint32_t scalePercent)
+{
+	const BusTimings& timings = (speed == CartSpeed::FastROM) ? gFastROMTimings : gSlowROMTimings;
+	
+	gBusTimings.mLatchNs = timings.mLatchNs * scalePercent / 100;
+	gBusTimings.mSetupNs = timings.mSetupNs * scalePercent / 100;
+	gBusTimings.mAccessNs = timings.mAccessNs * scalePercent / 100;
+	gBusTimings.mHoldNs = timings.mHoldNs * scalePercent / 100;
+	gBusTimings.mWritePulseNs = timings.mWritePulseNs * scalePercent / 100;
+}
+
+void SpinDelay(uint32_t spins)
+{
+	for(volatile uint32_t i = 0; i < spins; i++)
+	{
+	}
+}
+
+void CalibrateDelays()
+{
+	const uint32_t numSpins = 20000;
+	
+	// first a warm up so the governor has bumped the clock, then keep the fastest run, since
+	// anything slower was just us getting preempted. The runs are kept down to tens of
+	// microseconds so the fastest one can miss the timer tick and any other interrupts entirely,
+	// otherwise every run pays for them and the loop looks slower than it is. DelayNs checks the
+	// clock either way, so getting this wrong costs a few extra clock reads and not short delays.
+	uint64_t warmupEndNs = GetTimeNs() + DELAY_WARMUP_MS * 1000000ull;
+	while(GetTimeNs() < warmupEndNs)
+	{
+		SpinDelay(numSpins);
+	}
+	
+	uint64_t bestNs = UINT64_MAX;
+	for(uint32_t i = 0; i < 200; i++)
+	{
+		uint64_t start = GetTimeNs();
+		SpinDelay(numSpins);
+		uint64_t elapsedNs = GetTimeNs() - start;
+		
+		if(elapsedNs < bestNs)
+		{
+			bestNs = elapsedNs;
+		}
+	}
+	
+	gSpinsPerUs = (uint32_t)(((uint64_t)numSpins * 1000) / (bestNs ? bestNs : 1));
+	if(gSpinsPerUs == 0)
+	{
+		gSpinsPerUs = 1;
+	}
+}
+
+// clockCostNs is what reading the clock itself costs, taken off the average and the max. Not off
+// the min, which is what has to be at least requestedNs, and the clock reads either side of a
+// delay can only make it look longer than it was. Returns false if the min was short.
+static bool ReportDelay(const char* pName, uint32_t requestedNs, uint64_t clockCostNs)
+{
+	const uint32_t numSamples = 2000;
+	
+	uint64_t totalNs = 0;
+	uint64_t minNs = UINT64_MAX;
+	uint64_t maxNs = 0;
+	
+	for(uint32_t i = 0; i < numSamples; i++)
+	{
+		uint64_t start = GetTimeNs();
+		DelayNs(requestedNs);
+		uint64_t elapsedNs = GetTimeNs() - start;
+		minNs = elapsedNs < minNs ? elapsedNs : minNs;
+		
+		elapsedNs = elapsedNs > clockCostNs ? elapsedNs - clockCostNs : 0;
+		totalNs += elapsedNs;
+		maxNs = elapsedNs > maxNs ? elapsedNs : maxNs;
+	}
+	
+	double averageNs = (double)totalNs / numSamples;
+	double errorPercent = requestedNs ? (averageNs - requestedNs) * 100.0 / requestedNs : 0.0;
+	bool cameUpShort = minNs < requestedNs;
+	
+	printf("%-12s requested %7dns, achieved avg %9.1fns min %7llu max %7llu (%+.1f%%)%s\n", pName, requestedNs, averageNs,
+		(unsigned long long)minNs, (unsigned long long)maxNs, errorPercent, cameUpShort ? " SHORT" : "");
+	
+	return !cameUpShort;
+}
+
+bool RunTimingSelfTest()
+{
+	// what it costs just to read the clock, which would otherwise be baked into every number below
+	uint64_t start = GetTimeNs();
+	for(uint32_t i = 0; i < 1000; i++)
+	{
+		GetTimeNs();
+	}
+	uint64_t clockCostNs = (GetTimeNs() - start) / 1000;
+	
+	printf("Delay loop: %d spins/us, clock read costs ~%lluns\n", gSpinsPerUs, (unsigned long long)clockCostNs);
+	
+	bool passed = true;
+	passed = ReportDelay("latch", gBusTimings.mLatchNs, clockCostNs) && passed;
+	passed = ReportDelay("setup", gBusTimings.mSetupNs, clockCostNs) && passed;
+	passed = ReportDelay("access", gBusTimings.mAccessNs, clockCostNs) && passed;
+	passed = ReportDelay("hold", gBusTimings.mHoldNs, clockCostNs) && passed;
+	passed = ReportDelay("write pulse", gBusTimings.mWritePulseNs, clockCostNs) && passed;
+	
+	const uint32_t sweepNs[] = { 100, 500, 1000, 10000, 100000 };
+	for(uint32_t i = 0; i < sizeof(sweepNs) / sizeof(sweepNs[0]); i++)
+	{
+		passed = ReportDelay("sweep", sweepNs[i], clockCostNs) && passed;
+	}
+	
+	if(!passed)
+	{
+		printf("Timing self-test: FAILED, some delays came in shorter than requested\n");
+	}
+	
+	return passed;
+}
@@ -0,0 +1,96 @@
+#pragma once
+
+#include <cstdint>
+#include <time.h>
+
+// Bus delays in nanoseconds. usleep gets rounded up by the scheduler to something like
+// 60-100us, which is hundreds of times what the cart actually needs, so these are done
+// with a busy wait instead. It spins for as long as CalibrateDelays worked out at startup and
+// then on until CLOCK_MONOTONIC says the time is up, so a delay is never shorter than asked
+// for, even once the governor has raised the clock past what it was calibrated at.
+struct BusTimings
+{
+	// 74HC373 latch enable pulse, and data setup before it drops
+	uint32_t mLatchNs;
+	
+	// address and control lines settling before the cart is enabled or strobed
+	uint32_t mSetupNs;
+	
+	// cart enabled to data valid. The SNES rom access time.
+	uint32_t mAccessNs;
+	
+	// lines held after a strobe ends, before the next step changes them
+	uint32_t mHoldNs;
+	
+	// how long /WR stays low with the data on the bus for an SRAM write
+	uint32_t mWritePulseNs;
+};
+
+enum class CartSpeed
+{
+	// 200ns roms, everything before FastROM
+	SlowROM,
+	
+	// 120ns roms
+	FastROM
+};
+
+extern BusTimings gBusTimings;
+
+// Spins of the delay loop per microsecond, worked out by CalibrateDelays
+extern uint32_t gSpinsPerUs;
+
+// Anything at least this long goes to the scheduler instead of spinning
+#define DELAY_SLEEP_THRESHOLD_NS (100000)
+
+// How long CalibrateDelays spins first, so the ondemand governor (which samples every few tens of
+// ms) has raised the clock before it measures
+#define DELAY_WARMUP_MS (200)
+
+// Sets gBusTimings for the given cart speed, stretched by scalePercent for rigs with long
+// wires or flaky contacts (100 is as specified).
+void SetCartSpeed(CartSpeed speed, uint32_t scalePercent);
+
+void CalibrateDelays();
+
+// CLOCK_MONOTONIC in nanoseconds, the one clock everything here is timed against
+inline uint64_t GetTimeNs()
+{
+	timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// Prints how far the achieved delays land from the requested ones. Returns false if any came
+// in shorter than requested.
+bool RunTimingSelfTest();
+
+// Out of line on purpose: gSpinsPerUs is measured on this one loop, and a copy inlined somewhere
+// else can come out of the compiler a different shape and run at a different speed per spin.
+void SpinDelay(uint32_t spins);
+
+inline void DelayNs(uint32_t ns)
+{
+	if(ns == 0)
+	{
+		return;
+	}
+	
+	uint64_t deadlineNs = GetTimeNs() + ns;
+	
+	if(ns >= DELAY_SLEEP_THRESHOLD_NS)
+	{
+		timespec ts = { (time_t)(deadlineNs / 1000000000), (long)(deadlineNs % 1000000000) };
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, nullptr);
+	}
+	else
+	{
+		// the calibrated count is a first guess, so the clock is only read once or twice a delay
+		SpinDelay((uint32_t)(((uint64_t)ns * gSpinsPerUs) / 1000));
+	}
+	
+	// a signal can cut the sleep short, and the core can be faster now than when it was calibrated
+	while(GetTimeNs() < deadlineNs)
+	{
+	}
+}
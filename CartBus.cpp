@@ -0,0 +1,154 @@
+#include "CartBus.h"
+
+#include "BusProgram.h"
+
+GPIOAddressArray<AddressPins, Latch8Thru15Pin, BankAddressPins, Latch16Thru19Pin> gAddressLines;
+
+GPIOLineArray<DataPins> gDataLines;
+GPIOLineArray<WritePin> gWriteEnable;
+GPIOLineArray<ResetPin> gReset;
+GPIOLineArray<CartEnablePin> gCartEnable;
+
+uint8_t ReadCartByte(uint32_t address, bool romSel)
+{
+	gCartEnable.Write(1);
+	DelayNs(gBusTimings.mHoldNs);
+	
+	gAddressLines.SetAddress(address);
+	DelayNs(gBusTimings.mSetupNs);
+	
+	gDataLines.HiZ();
+	DelayNs(gBusTimings.mSetupNs);
+	
+	gCartEnable.Write(romSel ? 0 : 1);
+	DelayNs(gBusTimings.mAccessNs);
+	
+	uint8_t value = gDataLines.Read();
+	DelayNs(gBusTimings.mHoldNs);
+	
+	gDataLines.HiZ();
+	DelayNs(gBusTimings.mHoldNs);
+	
+	return value;
+}
+
+uint8_t ReadRomByte(uint32_t address)
+{
+	return ReadCartByte(address, true);
+}
+
+void WriteCartByte(uint32_t address, uint8_t value, bool romSel)
+{
+	gWriteEnable.Write(1);
+	DelayNs(gBusTimings.mHoldNs);
+	
+	gDataLines.HiZ();
+	DelayNs(gBusTimings.mHoldNs);
+	
+	gCartEnable.Write(1);
+	DelayNs(gBusTimings.mHoldNs);
+	
+	gAddressLines.SetAddress(address);
+	DelayNs(gBusTimings.mSetupNs);
+	
+	gCartEnable.Write(romSel ? 0 : 1);
+	DelayNs(gBusTimings.mSetupNs);
+	
+	gWriteEnable.Write(0);
+	DelayNs(gBusTimings.mSetupNs);
+	
+	gDataLines.Write(value);
+	DelayNs(gBusTimings.mWritePulseNs);
+	
+	// Raising the write line also lowers /RD through the inverter, which turns the SRAM's
+	// outputs on against ours. Where /ROMSEL selects the SRAM, end the write with that instead,
+	// and either way let go of the data bus straight after.
+	if(romSel)
+	{
+		gCartEnable.Write(1);
+		DelayNs(gBusTimings.mHoldNs);
+	}
+	
+	gWriteEnable.Write(1);
+	gDataLines.HiZ();
+	DelayNs(gBusTimings.mHoldNs);
+}
+
+// Runs pProgram over run a bank at a time. The program leaves the bank alone, so each bank is
+// set up here the normal way first, and the address cache told where the program left it after.
+static void RunProgram(const BusProgram& program, const BusRun& run, uint8_t* pData)
+{
+	GPIOBackend* pBackend = gDataLines.GetBackend();
+	
+	for(uint32_t i = 0; i < run.mLength;)
+	{
+		uint32_t address = run.mAddress + i;
+		uint32_t length = 0x10000 - (address & 0xFFFF);
+		if(length > run.mLength - i)
+		{
+			length = run.mLength - i;
+		}
+		
+		gAddressLines.SetAddress(address);
+		
+		program.Run(pBackend, address, length, pData + i);
+		
+		gAddressLines.NoteAddress(address + length - 1, length);
+		i += length;
+	}
+}
+
+bool gPipelinedReads = false;
+
+void ReadCartRun(const BusRun& run, uint8_t* pData)
+{
+	if(gPipelinedReads)
+	{
+		ReadCartRunPipelined(run, pData);
+	}
+	else
+	{
+		ReadCartRunSerial(run, pData);
+	}
+}
+
+void ReadCartRunSerial(const BusRun& run, uint8_t* pData)
+{
+	// the lines the program drives without going through their buses have to be in the state it expects
+	gCartEnable.Write(1);
+	gDataLines.HiZ();
+	
+	// compiled each time, since the timings can change between runs (see ReadVerifier)
+	BusProgram program;
+	program.CompileRead(run.mRomSel, gAddressLines.GetShifter());
+	RunProgram(program, run, pData);
+}
+
+void ReadCartRunPipelined(const BusRun& run, uint8_t* pData)
+{
+	gCartEnable.Write(1);
+	DelayNs(gBusTimings.mHoldNs);
+	
+	gDataLines.HiZ();
+	
+	// /ROMSEL goes down on whatever address was there before, which is no different to the
+	// addresses the latches pass through on the way to the next one
+	gCartEnable.Write(run.mRomSel ? 0 : 1);
+	
+	BusProgram program;
+	program.CompilePipelinedRead(gAddressLines.GetShifter());
+	RunProgram(program, run, pData);
+	
+	DelayNs(gBusTimings.mHoldNs);
+}
+
+void WriteCartRun(const BusRun& run, const uint8_t* pData)
+{
+	gWriteEnable.Write(1);
+	gCartEnable.Write(1);
+	gDataLines.HiZ();
+	
+	BusProgram program;
+	program.CompileWrite(run.mRomSel, gAddressLines.GetShifter());
+	RunProgram(program, run, const_cast<uint8_t*>(pData));
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+
+#include "GPIOManager.h"
+#include "Mapper.h"
+#include "PinMap.h"
+
+// Controls address lines A0 - A15 with support of a latch and A16-A23 (Bank Addresses BA0-BA7) with another latch.
+extern GPIOAddressArray<AddressPins, Latch8Thru15Pin, BankAddressPins, Latch16Thru19Pin> gAddressLines;
+
+extern GPIOLineArray<DataPins> gDataLines;
+extern GPIOLineArray<WritePin> gWriteEnable;
+extern GPIOLineArray<ResetPin> gReset;
+extern GPIOLineArray<CartEnablePin> gCartEnable;
+
+// One read cycle with the write line already high (/RD low). Leaves /ROMSEL where romSel put it and the data bus HiZ.
+uint8_t ReadCartByte(uint32_t address, bool romSel);
+
+// ReadCartByte with /ROMSEL asserted, in the shape ProbeRomInfo wants.
+uint8_t ReadRomByte(uint32_t address);
+
+// One SRAM write cycle. Leaves the write line high, /ROMSEL high if romSel asserted it, and the data bus HiZ.
+void WriteCartByte(uint32_t address, uint8_t value, bool romSel);
+
+// Reads run with ReadCartRunPipelined if gPipelinedReads is set (--pipeline), otherwise ReadCartRunSerial.
+void ReadCartRun(const BusRun& run, uint8_t* pData);
+
+extern bool gPipelinedReads;
+
+// ReadCartByte over every byte of run, through a BusProgram. Same cycle and same state left behind.
+void ReadCartRunSerial(const BusRun& run, uint8_t* pData);
+
+// run with /ROMSEL asserted throughout and each byte's address going out as soon as the byte
+// before has been read, see BusProgram::CompilePipelinedRead. Leaves the same state ReadCartByte does.
+void ReadCartRunPipelined(const BusRun& run, uint8_t* pData);
+
+// WriteCartByte over every byte of run, through a BusProgram.
+void WriteCartRun(const BusRun& run, const uint8_t* pData);
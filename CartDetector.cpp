@@ -0,0 +1,205 @@
+#include "CartDetector.h"
+
+#include <time.h>
+
+#include "BusTiming.h"
+#include "CartBus.h"
+#include "RomManager.h"
+#include "SimCart.h"
+
+// where ProbeHeader looks: LoROM, and HiROM (ExHiROM's header is at $40:FFC0 too)
+static const uint8_t gHeaderBanks[] = { 0x00, 0x40 };
+
+// one swap in RunDetectCheck is the cart out for half of this and in for the other half, and it
+// gets knocked for this long every other half
+#define DETECT_CHECK_PERIOD_MS (2000)
+#define DETECT_CHECK_GLITCH_MS (40)
+
+void CartDetector::Create(GPIOBackend* pBackend, CartDetectMode mode)
+{
+	mMode = mode;
+	
+	if(mMode == CartDetectMode::Sense)
+	{
+		mSense.Create(pBackend);
+		mSense.WatchEdges();
+	}
+}
+
+void CartDetector::Release()
+{
+	mSense.Release();
+	mMode = CartDetectMode::None;
+}
+
+bool CartDetector::Sample()
+{
+	if(mMode == CartDetectMode::Sense)
+	{
+		return mSense.Read() == 0;
+	}
+	
+	if(mMode == CartDetectMode::Header)
+	{
+		return ProbeHeader();
+	}
+	
+	return true;
+}
+
+bool CartDetector::ProbeHeader()
+{
+	bool found = false;
+	
+	gWriteEnable.Write(1);
+	
+	for(uint32_t b = 0; b < sizeof(gHeaderBanks) && !found; b++)
+	{
+		uint32_t address = (gHeaderBanks[b] << 16) | (HEADER_READ_BASE + HEADER_COMPLEMENT);
+		
+		uint16_t complement = ReadRomByte(address) | (ReadRomByte(address + 1) << 8);
+		uint16_t checksum = ReadRomByte(address + 2) | (ReadRomByte(address + 3) << 8);
+		
+		found = ((complement ^ checksum) == 0xFFFF);
+	}
+	
+	// back to nothing driven into the slot between probes
+	gCartEnable.Write(1);
+	gAddressLines.HiZ();
+	gDataLines.HiZ();
+	
+	return found;
+}
+
+bool CartDetector::WaitFor(bool present, uint32_t timeoutMs)
+{
+	uint64_t settleNs = CART_DETECT_SETTLE_MS * 1000000ull;
+	uint64_t startNs = GetTimeNs();
+	uint64_t timeoutNs = timeoutMs * 1000000ull;
+	
+	// what the lines last said, and since when
+	bool sampled = Sample();
+	uint64_t sampledNs = startNs;
+	
+	while(true)
+	{
+		uint64_t nowNs = GetTimeNs();
+		if(sampled == present && nowNs - sampledNs >= settleNs)
+		{
+			return true;
+		}
+		
+		if(timeoutMs && nowNs - startNs >= timeoutNs)
+		{
+			return false;
+		}
+		
+		// Until it would have settled, or with it the wrong way round, for as long as there is.
+		// Header probes can only look every so often either way.
+		uint64_t waitNs = (sampled == present) ? settleNs - (nowNs - sampledNs) : CART_DETECT_WAIT_MS * 1000000ull;
+		if(timeoutMs && waitNs > timeoutNs - (nowNs - startNs))
+		{
+			waitNs = timeoutNs - (nowNs - startNs);
+		}
+		
+		bool changed = false;
+		bool level = sampled;
+		if(mMode == CartDetectMode::Sense)
+		{
+			// any edge restarts the clock, even one that's been undone by the time the line is read
+			changed = mSense.WaitForEdge(sampled ? 0 : 1, (uint32_t)(waitNs / 1000));
+			level = changed ? Sample() : sampled;
+		}
+		else
+		{
+			usleep((waitNs < CART_DETECT_PROBE_MS * 1000000ull) ? (uint32_t)(waitNs / 1000) : CART_DETECT_PROBE_MS * 1000);
+			level = Sample();
+			changed = (level != sampled);
+		}
+		
+		if(changed)
+		{
+			// what the lines said before didn't last long enough to count
+			uint64_t changedNs = GetTimeNs();
+			if(changedNs - sampledNs < settleNs)
+			{
+				mNumBounces++;
+			}
+			
+			sampled = level;
+			sampledNs = changedNs;
+		}
+	}
+}
+
+bool RunDetectCheck(CartDetector* pDetector, SimCart* pSimCart, uint32_t numSwaps, uint32_t bounceMs)
+{
+	if(!pSimCart)
+	{
+		printf("RunDetectCheck: Needs the sim cart (--backend=sim or mmio-fake)\n");
+		return false;
+	}
+	
+	if(!pDetector->IsEnabled())
+	{
+		printf("RunDetectCheck: Nothing to check, pick --cart-detect=sense or header\n");
+		return false;
+	}
+	
+	gWriteEnable.Write(1);
+	gReset.Write(0);
+	gCartEnable.Write(1);
+	gAddressLines.HiZ();
+	gDataLines.HiZ();
+	
+	// [0] removals, [1] inserts
+	uint32_t numDetected[2] = { 0, 0 };
+	uint64_t totalLatencyNs[2] = { 0, 0 };
+	uint64_t maxLatencyNs[2] = { 0, 0 };
+	uint32_t numFalse = 0;
+	uint32_t numMissed = 0;
+	uint32_t bouncesBefore = pDetector->GetNumBounces();
+	
+	pSimCart->SetSwapSchedule(DETECT_CHECK_PERIOD_MS, bounceMs, DETECT_CHECK_GLITCH_MS);
+	
+	// the schedule starts with the slot empty, so the first thing to see is an insert
+	for(uint32_t i = 0; i < numSwaps * 2; i++)
+	{
+		bool present = (i % 2) == 0;
+		if(!pDetector->WaitFor(present, DETECT_CHECK_PERIOD_MS))
+		{
+			printf("RunDetectCheck: Missed %s %d\n", present ? "insert" : "removal", i / 2 + 1);
+			numMissed++;
+			continue;
+		}
+		
+		uint64_t nowNs = GetTimeNs();
+		if(pSimCart->IsInserted(nowNs) != present)
+		{
+			printf("RunDetectCheck: Saw the cart %s when it wasn't\n", present ? "go in" : "come out");
+			numFalse++;
+			continue;
+		}
+		
+		uint64_t latencyNs = nowNs - pSimCart->GetLastSwapNs(nowNs);
+		numDetected[present]++;
+		totalLatencyNs[present] += latencyNs;
+		maxLatencyNs[present] = (latencyNs > maxLatencyNs[present]) ? latencyNs : maxLatencyNs[present];
+	}
+	
+	// in for good again
+	pSimCart->SetSwapSchedule(0, 0, 0);
+	
+	for(uint32_t i = 0; i < 2; i++)
+	{
+		uint32_t present = 1 - i;
+		printf("RunDetectCheck: %-8s %d of %d detected, latency mean %6.1f ms max %6.1f ms\n", present ? "inserts" : "removals",
+			numDetected[present], numSwaps, numDetected[present] ? totalLatencyNs[present] / 1e6 / numDetected[present] : 0.0,
+			maxLatencyNs[present] / 1e6);
+	}
+	
+	printf("RunDetectCheck: %d false triggers, %d missed, %d bounces ridden out (%d ms bounce, %d ms settle)\n", numFalse,
+		numMissed, pDetector->GetNumBounces() - bouncesBefore, bounceMs, CART_DETECT_SETTLE_MS);
+	
+	return numFalse == 0 && numMissed == 0;
+}
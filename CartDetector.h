@@ -0,0 +1,73 @@
+#pragma once
+
+#include <cstdint>
+
+#include "GPIOManager.h"
+#include "PinMap.h"
+
+class SimCart;
+
+// Knowing when a cart goes in or comes out without anyone pressing a key, one of two ways:
+//
+//   sense   CartSensePin (see PinMap.h) goes low when the cart's ground plane touches the slot.
+//           The backend sleeps on its edges: libgpiod line events for gpiod, the sim cart's own
+//           schedule for sim, and a poll every EDGE_POLL_US for mmio, which has no interrupts.
+//           With gpio-sim.sh, pull-down on sim_gpio11 is a cart going in and pull-up one coming out.
+//   header  For a stock wired slot. Every CART_DETECT_PROBE_MS the checksum and its complement are
+//           read from where a LoROM and a HiROM header would be, with /RESET low so the SRAM stays
+//           on its battery. An empty slot reads FF FF FF FF, which never adds up. It drives the
+//           address lines into the slot for a few microseconds a probe, so sense is the gentler way.
+//
+// Either way the contacts bounce as a cart goes in or comes out, so a change only counts once it
+// has held for CART_DETECT_SETTLE_MS. Anything that didn't last that long is counted as a bounce.
+#define CART_DETECT_SETTLE_MS (250)
+#define CART_DETECT_PROBE_MS (20)
+
+// how long a sense wait sleeps at once when it has nothing to time out on
+#define CART_DETECT_WAIT_MS (1000)
+
+enum class CartDetectMode
+{
+	None,
+	Sense,
+	Header
+};
+
+class CartDetector
+{
+public:
+	// For header, the bus lines have to be created already. For sense, this claims CartSensePin.
+	void Create(GPIOBackend* pBackend, CartDetectMode mode);
+	void Release();
+	
+	bool IsEnabled() const
+	{
+		return mMode != CartDetectMode::None;
+	}
+	
+	// Waits for the cart to be in (or out) for CART_DETECT_SETTLE_MS, with the lines as
+	// ConfigureLinesForInsert leaves them. Returns false if timeoutMs ran out first, 0 waits forever.
+	bool WaitFor(bool present, uint32_t timeoutMs);
+	
+	// One look at the lines, bounces and all.
+	bool Sample();
+	
+	uint32_t GetNumBounces() const
+	{
+		return mNumBounces;
+	}
+
+private:
+	bool ProbeHeader();
+
+private:
+	CartDetectMode mMode = CartDetectMode::None;
+	GPIOLineArray<CartSensePin> mSense;
+	uint32_t mNumBounces = 0;
+};
+
+// The simulated cart goes in and comes out numSwaps times, its contacts bouncing for bounceMs each
+// time and getting knocked in between (see SimCart::SetSwapSchedule). Reports how long detection
+// took from the start of each change, and counts detections that didn't match the cart (false
+// triggers) and changes that weren't detected. Returns false if there were any of either.
+bool RunDetectCheck(CartDetector* pDetector, SimCart* pSimCart, uint32_t numSwaps, uint32_t bounceMs);
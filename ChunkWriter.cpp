@@ -0,0 +1,238 @@
+#include "ChunkWriter.h"
+
+#include "Crc32.h"
+#include "DumpHasher.h"
+#include "DumpJournal.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <unistd.h>
+
+ChunkWriter::~ChunkWriter()
+{
+	if(mFile != -1)
+	{
+		Close(0);
+	}
+}
+
+bool ChunkWriter::Open(const char* pFileName, bool keepContents)
+{
+	int flags = O_RDWR | O_CREAT | (keepContents ? 0 : O_TRUNC);
+	
+	// O_DIRECT keeps a big dump from pushing everything else out of the page cache on a small Pi,
+	// but not every filesystem (tmpfs, some FUSE mounts) takes it
+	mFile = open(pFileName, flags | O_DIRECT, 0644);
+	mDirect = (mFile != -1);
+	
+	if(mFile == -1 && errno == EINVAL)
+	{
+		mFile = open(pFileName, flags, 0644);
+	}
+	
+	if(mFile == -1)
+	{
+		printf("ChunkWriter: Failed to open file '%s' for write!\n", pFileName);
+		return false;
+	}
+	
+	if(posix_memalign((void**)&mpPoolData, CHUNK_ALIGNMENT, CHUNK_SIZE * CHUNK_POOL_SIZE) != 0)
+	{
+		printf("ChunkWriter: Failed to allocate chunks\n");
+		close(mFile);
+		mFile = -1;
+		return false;
+	}
+	
+	mQueue.Clear();
+	mFree.Clear();
+	
+	for(uint32_t i = 0; i < CHUNK_POOL_SIZE; i++)
+	{
+		mChunks[i].mpData = mpPoolData + (i * CHUNK_SIZE);
+		mChunks[i].mOffset = 0;
+		mChunks[i].mSize = 0;
+		mFree.Push(&mChunks[i]);
+	}
+	
+	mClosing = false;
+	mFailed = false;
+	mBytesSinceSync = 0;
+	
+	mThread = std::thread(&ChunkWriter::WriterThread, this);
+	return true;
+}
+
+void ChunkWriter::SetJournal(DumpJournal* pJournal)
+{
+	mpJournal = pJournal;
+}
+
+void ChunkWriter::SetHasher(DumpHasher* pHasher)
+{
+	mpHasher = pHasher;
+}
+
+Chunk* ChunkWriter::GetFreeChunk()
+{
+	Chunk* pChunk = nullptr;
+	while(!mFree.Pop(pChunk))
+	{
+		usleep(CHUNK_FREE_POLL_US);
+	}
+	
+	pChunk->mSize = 0;
+	pChunk->mOnDisk = false;
+	return pChunk;
+}
+
+void ChunkWriter::Submit(Chunk* pChunk)
+{
+	// there are only CHUNK_POOL_SIZE chunks, so there's always room
+	mQueue.Push(pChunk);
+}
+
+bool ChunkWriter::ReadChunk(Chunk* pChunk)
+{
+	// O_DIRECT reads have to be whole blocks too, the file just comes up short past its end
+	uint32_t size = mDirect ? (pChunk->mSize + CHUNK_ALIGNMENT - 1) & ~(CHUNK_ALIGNMENT - 1) : pChunk->mSize;
+	
+	uint32_t numRead = 0;
+	while(numRead < pChunk->mSize)
+	{
+		ssize_t result = pread(mFile, pChunk->mpData + numRead, size - numRead, (off_t)pChunk->mOffset + numRead);
+		if(result <= 0)
+		{
+			if(result == -1 && errno == EINTR)
+			{
+				continue;
+			}
+			
+			return false;
+		}
+		
+		numRead += result;
+	}
+	
+	return true;
+}
+
+bool ChunkWriter::Close(uint32_t finalSize)
+{
+	if(mFile == -1)
+	{
+		return false;
+	}
+	
+	mClosing.store(true, std::memory_order_release);
+	mThread.join();
+	
+	// chunks are written whole (and padded out for O_DIRECT), the file ends where the rom does
+	if(ftruncate(mFile, finalSize) != 0 || fsync(mFile) != 0)
+	{
+		mFailed = true;
+	}
+	
+	if(!mFailed && mpJournal)
+	{
+		mpJournal->Checkpoint();
+	}
+	
+	close(mFile);
+	mFile = -1;
+	
+	free(mpPoolData);
+	mpPoolData = nullptr;
+	
+	return !mFailed;
+}
+
+void ChunkWriter::WriterThread()
+{
+	while(true)
+	{
+		Chunk* pChunk = nullptr;
+		if(!mQueue.Pop(pChunk))
+		{
+			// Close is only ever called after the last Submit, so once it has been an empty queue stays empty
+			if(mClosing.load(std::memory_order_acquire) && mQueue.IsEmpty())
+			{
+				return;
+			}
+			
+			usleep(CHUNK_WRITER_POLL_US);
+			continue;
+		}
+		
+		if(mpHasher)
+		{
+			mpHasher->AddChunk(pChunk->mpData, pChunk->mSize);
+		}
+		
+		if(!pChunk->mOnDisk)
+		{
+			if(!WriteChunk(pChunk))
+			{
+				mFailed = true;
+			}
+			else if(mpJournal)
+			{
+				mpJournal->AddChunk(pChunk->mOffset / CHUNK_SIZE, Crc32(pChunk->mpData, pChunk->mSize));
+			}
+			
+			mBytesSinceSync += pChunk->mSize;
+		}
+		
+		// a checkpoint: everything so far is on the disk, not just in the page cache, and the journal can say so
+		if(mBytesSinceSync >= CHUNK_CHECKPOINT_BYTES)
+		{
+			if(fdatasync(mFile) != 0)
+			{
+				mFailed = true;
+			}
+			else if(mpJournal && !mpJournal->Checkpoint())
+			{
+				mFailed = true;
+			}
+			
+			mBytesSinceSync = 0;
+		}
+		
+		mFree.Push(pChunk);
+	}
+}
+
+bool ChunkWriter::WriteChunk(const Chunk* pChunk)
+{
+	uint32_t size = pChunk->mSize;
+	if(mDirect && (size % CHUNK_ALIGNMENT) != 0)
+	{
+		// only ever the last chunk, Close cuts the padding back off
+		uint32_t paddedSize = (size + CHUNK_ALIGNMENT - 1) & ~(CHUNK_ALIGNMENT - 1);
+		memset(pChunk->mpData + size, 0, paddedSize - size);
+		size = paddedSize;
+	}
+	
+	uint32_t written = 0;
+	while(written < size)
+	{
+		ssize_t result = pwrite(mFile, pChunk->mpData + written, size - written, (off_t)pChunk->mOffset + written);
+		if(result <= 0)
+		{
+			if(result == -1 && errno == EINTR)
+			{
+				continue;
+			}
+			
+			printf("ChunkWriter: Write at %x failed\n", pChunk->mOffset + written);
+			return false;
+		}
+		
+		written += result;
+	}
+	
+	return true;
+}
@@ -0,0 +1,90 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <thread>
+
+#include "SpscQueue.h"
+
+// Streams a dump to disk as it comes off the bus. The bus side fills fixed size chunks from a small
+// pool and submits them, a writer thread writes each one at its offset and syncs the file every
+// CHUNK_CHECKPOINT_BYTES, so memory stays at CHUNK_POOL_SIZE chunks whatever the cart size and a
+// dump that dies part way still has everything up to the last checkpoint on disk.
+#define CHUNK_SIZE (0x8000)
+#define CHUNK_POOL_SIZE (4)
+#define CHUNK_CHECKPOINT_BYTES (1024 * 1024)
+
+// Chunks go back and forth over SpscQueues so the bus side never takes a lock. Neither side can be
+// woken without one either, so they poll: the writer for work, the bus side for a free chunk when
+// it's got a whole pool ahead of the disk.
+#define CHUNK_WRITER_POLL_US (1000)
+#define CHUNK_FREE_POLL_US (100)
+
+// Biggest dump it'll write
+#define MAX_DUMP_SIZE (16 * 1024 * 1024)
+
+// O_DIRECT wants the buffers, sizes and offsets aligned to the device's block size
+#define CHUNK_ALIGNMENT (4096)
+
+class DumpHasher;
+class DumpJournal;
+
+struct Chunk
+{
+	uint8_t* mpData;
+	
+	// where it goes in the file, and how much of it is filled
+	uint32_t mOffset;
+	uint32_t mSize;
+	
+	// already in the file from an earlier dump, so it only needs hashing
+	bool mOnDisk;
+};
+
+class ChunkWriter
+{
+public:
+	~ChunkWriter();
+	
+	// Creates the file and starts the writer thread. Unless keepContents is set whatever was in it is gone.
+	bool Open(const char* pFileName, bool keepContents = false);
+	
+	// Chunks are recorded in the journal as they're synced, and run through the hasher in file order
+	// once they're written. Set them before Open.
+	void SetJournal(DumpJournal* pJournal);
+	void SetHasher(DumpHasher* pHasher);
+	
+	// Blocks until the writer has a chunk to spare.
+	Chunk* GetFreeChunk();
+	void Submit(Chunk* pChunk);
+	
+	// Fills the chunk back in from what's already in the file, for picking up an earlier dump.
+	bool ReadChunk(Chunk* pChunk);
+	
+	// Writes out everything submitted, cuts the file to finalSize, syncs and stops the thread.
+	// Returns false if any write failed.
+	bool Close(uint32_t finalSize);
+	
+private:
+	void WriterThread();
+	bool WriteChunk(const Chunk* pChunk);
+	
+private:
+	int mFile = -1;
+	bool mDirect = false;
+	DumpJournal* mpJournal = nullptr;
+	DumpHasher* mpHasher = nullptr;
+	
+	uint8_t* mpPoolData = nullptr;
+	Chunk mChunks[CHUNK_POOL_SIZE];
+	
+	// submitted chunks in order, and the ones free to fill
+	SpscQueue<Chunk*, CHUNK_POOL_SIZE> mQueue;
+	SpscQueue<Chunk*, CHUNK_POOL_SIZE> mFree;
+	
+	std::atomic<bool> mClosing{false};
+	bool mFailed = false;
+	uint32_t mBytesSinceSync = 0;
+	
+	std::thread mThread;
+};
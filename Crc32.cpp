@@ -0,0 +1,67 @@
+#include "Crc32.h"
+
+#define CRC32_POLYNOMIAL (0xEDB88320u)
+
+// Slice-by-8: mEntries[0] is the usual byte at a time table, mEntries[n] is what a byte does to the
+// crc when it's followed by n more, so eight bytes go through as eight lookups and no shifting
+// between them.
+struct Crc32Table
+{
+	Crc32Table()
+	{
+		for(uint32_t i = 0; i < 256; i++)
+		{
+			uint32_t crc = i;
+			for(uint32_t bit = 0; bit < 8; bit++)
+			{
+				crc = (crc >> 1) ^ ((crc & 0x1) ? CRC32_POLYNOMIAL : 0);
+			}
+			
+			mEntries[0][i] = crc;
+		}
+		
+		for(uint32_t slice = 1; slice < 8; slice++)
+		{
+			for(uint32_t i = 0; i < 256; i++)
+			{
+				uint32_t previous = mEntries[slice - 1][i];
+				mEntries[slice][i] = (previous >> 8) ^ mEntries[0][previous & 0xFF];
+			}
+		}
+	}
+	
+	uint32_t mEntries[8][256];
+};
+
+static inline uint32_t ReadLittle32(const uint8_t* pData)
+{
+	return pData[0] | (pData[1] << 8) | (pData[2] << 16) | ((uint32_t)pData[3] << 24);
+}
+
+uint32_t Crc32(const uint8_t* pData, uint32_t size, uint32_t crc)
+{
+	// built on first use, which is safe from any thread
+	static const Crc32Table table;
+	const uint32_t (*pEntries)[256] = table.mEntries;
+	
+	crc = ~crc;
+	
+	while(size >= 8)
+	{
+		uint32_t low = ReadLittle32(pData) ^ crc;
+		uint32_t high = ReadLittle32(pData + 4);
+		
+		crc = pEntries[7][low & 0xFF] ^ pEntries[6][(low >> 8) & 0xFF] ^ pEntries[5][(low >> 16) & 0xFF] ^ pEntries[4][low >> 24] ^
+			pEntries[3][high & 0xFF] ^ pEntries[2][(high >> 8) & 0xFF] ^ pEntries[1][(high >> 16) & 0xFF] ^ pEntries[0][high >> 24];
+		
+		pData += 8;
+		size -= 8;
+	}
+	
+	for(uint32_t i = 0; i < size; i++)
+	{
+		crc = pEntries[0][(crc ^ pData[i]) & 0xFF] ^ (crc >> 8);
+	}
+	
+	return ~crc;
+}
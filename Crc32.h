@@ -0,0 +1,7 @@
+#pragma once
+
+#include <cstdint>
+
+// The usual zip/No-Intro CRC32. Pass the previous result back in to carry on over more data,
+// starting from 0.
+uint32_t Crc32(const uint8_t* pData, uint32_t size, uint32_t crc = 0);
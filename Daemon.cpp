@@ -0,0 +1,681 @@
+#include "Daemon.h"
+
+#include <atomic>
+#include <condition_variable>
+#include <ctype.h>
+#include <cstring>
+#include <fcntl.h>
+#include <mutex>
+#include <poll.h>
+#include <signal.h>
+#include <stdio.h>
+#include <sys/sendfile.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/un.h>
+#include <thread>
+#include <unistd.h>
+
+#include "Progress.h"
+
+struct DaemonCommandName
+{
+	const char* mpName;
+	DaemonCommand mCommand;
+	bool mTakesName;
+};
+
+static const DaemonCommandName gCommandNames[] =
+{
+	{ "probe", DaemonCommand::Probe, false },
+	{ "eject", DaemonCommand::Eject, false },
+	{ "dump", DaemonCommand::DumpROM, true },
+	{ "read-sram", DaemonCommand::ReadSRAM, true },
+	{ "write-sram", DaemonCommand::WriteSRAM, true },
+	{ "status", DaemonCommand::Status, false },
+	{ "cancel", DaemonCommand::Cancel, false }
+};
+
+static std::atomic<bool> gShutdown{false};
+static std::atomic<bool> gCancel{false};
+static std::atomic<uint32_t> gNumConnections{0};
+static const DaemonHandlers* gpHandlers = nullptr;
+
+// Bus jobs take a ticket and wait for it to come up, so they run in the order they came in.
+// Everything status reports is under gJobMutex too.
+static std::mutex gJobMutex;
+static std::condition_variable gJobTurn;
+static uint32_t gNextTicket = 0;
+static uint32_t gServing = 0;
+static uint32_t gNumQueued = 0;
+static bool gRunning = false;
+static char gRunningRequest[DAEMON_MAX_REQUEST] = { 0 };
+static uint32_t gNumDone = 0;
+static uint32_t gNumFailed = 0;
+static char gCartText[DAEMON_MAX_REPLY] = { 0 };
+
+static const DaemonCommandName* FindCommand(const char* pWord)
+{
+	for(uint32_t i = 0; i < sizeof(gCommandNames) / sizeof(gCommandNames[0]); i++)
+	{
+		if(!strcmp(gCommandNames[i].mpName, pWord))
+		{
+			return &gCommandNames[i];
+		}
+	}
+	
+	return nullptr;
+}
+
+// Names become file names in the daemon's directory, so they can't climb out of it, and they're
+// one word of the request line.
+static bool IsValidName(const char* pName)
+{
+	uint32_t length = strlen(pName);
+	if(length == 0 || length > 200 || pName[0] == '.')
+	{
+		return false;
+	}
+	
+	for(uint32_t i = 0; i < length; i++)
+	{
+		if(!isgraph((unsigned char)pName[i]) || pName[i] == '/')
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+static bool SendAll(int socket, const void* pData, size_t size)
+{
+	const uint8_t* pBytes = (const uint8_t*)pData;
+	while(size > 0)
+	{
+		ssize_t numSent = send(socket, pBytes, size, MSG_NOSIGNAL);
+		if(numSent <= 0)
+		{
+			return false;
+		}
+		
+		pBytes += numSent;
+		size -= numSent;
+	}
+	
+	return true;
+}
+
+static bool ReceiveAll(int socket, void* pData, size_t size)
+{
+	uint8_t* pBytes = (uint8_t*)pData;
+	while(size > 0)
+	{
+		ssize_t numReceived = recv(socket, pBytes, size, 0);
+		if(numReceived <= 0)
+		{
+			return false;
+		}
+		
+		pBytes += numReceived;
+		size -= numReceived;
+	}
+	
+	return true;
+}
+
+// A byte at a time, so nothing after the newline (an upload) gets swallowed.
+static bool ReceiveLine(int socket, char* pLine, uint32_t size)
+{
+	for(uint32_t length = 0; length + 1 < size; length++)
+	{
+		if(recv(socket, &pLine[length], 1, 0) != 1)
+		{
+			return false;
+		}
+		
+		if(pLine[length] == '\n')
+		{
+			pLine[length] = 0;
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+static void SendError(int socket, const char* pReason)
+{
+	char line[DAEMON_MAX_REPLY + 8];
+	int length = snprintf(line, sizeof(line), "ERR %s\n", pReason);
+	SendAll(socket, line, length);
+}
+
+static void SendText(int socket, const char* pText)
+{
+	char header[32];
+	uint32_t size = strlen(pText);
+	int length = snprintf(header, sizeof(header), "OK %u\n", size);
+	
+	if(SendAll(socket, header, length))
+	{
+		SendAll(socket, pText, size);
+	}
+}
+
+// Straight from the page cache to the socket, without coming through here.
+static void SendFile(int socket, const char* pFileName)
+{
+	int file = open(pFileName, O_RDONLY | O_CLOEXEC);
+	struct stat fileStat;
+	if(file == -1 || fstat(file, &fileStat) != 0)
+	{
+		SendError(socket, "couldn't open what the job wrote");
+		if(file != -1)
+		{
+			close(file);
+		}
+		
+		return;
+	}
+	
+	char header[32];
+	int length = snprintf(header, sizeof(header), "OK %u\n", (uint32_t)fileStat.st_size);
+	
+	off_t offset = 0;
+	bool sent = SendAll(socket, header, length);
+	while(sent && offset < fileStat.st_size)
+	{
+		sent = sendfile(socket, file, &offset, fileStat.st_size - offset) > 0;
+	}
+	
+	if(!sent)
+	{
+		printf("Daemon: Client went away before '%s' was sent\n", pFileName);
+	}
+	
+	close(file);
+}
+
+static void SendStatus(int socket)
+{
+	char text[DAEMON_MAX_REPLY * 2];
+	int length = 0;
+	
+	std::unique_lock<std::mutex> lock(gJobMutex);
+	
+	if(gRunning)
+	{
+		length += snprintf(text + length, sizeof(text) - length, "running '%s', %s %u/%u bytes\n", gRunningRequest,
+			gProgress.GetOperation(), gProgress.GetBytesDone(), gProgress.GetTotalBytes());
+	}
+	else
+	{
+		length += snprintf(text + length, sizeof(text) - length, "idle\n");
+	}
+	
+	length += snprintf(text + length, sizeof(text) - length, "queued %u\n", gNumQueued);
+	length += snprintf(text + length, sizeof(text) - length, "done %u, failed %u\n", gNumDone, gNumFailed);
+	snprintf(text + length, sizeof(text) - length, "cart %s\n", gCartText);
+	
+	lock.unlock();
+	
+	SendText(socket, text);
+}
+
+static void SendCancel(int socket)
+{
+	char text[DAEMON_MAX_REQUEST + 32];
+	
+	std::unique_lock<std::mutex> lock(gJobMutex);
+	if(!gRunning)
+	{
+		lock.unlock();
+		SendError(socket, "nothing running");
+		return;
+	}
+	
+	gCancel = true;
+	snprintf(text, sizeof(text), "cancelling '%s'\n", gRunningRequest);
+	lock.unlock();
+	
+	SendText(socket, text);
+}
+
+static void RunJob(int socket, DaemonCommand command, const char* pRequest, const char* pName, const uint8_t* pUpload, uint32_t uploadSize)
+{
+	std::unique_lock<std::mutex> lock(gJobMutex);
+	
+	uint32_t ticket = gNextTicket++;
+	gNumQueued++;
+	gJobTurn.wait(lock, [ticket] { return gServing == ticket; });
+	
+	gNumQueued--;
+	gRunning = true;
+	snprintf(gRunningRequest, sizeof(gRunningRequest), "%s", pRequest);
+	if(!gShutdown)
+	{
+		gCancel = false;
+	}
+	
+	lock.unlock();
+	
+	char reply[DAEMON_MAX_REPLY] = { 0 };
+	char fileName[300] = { 0 };
+	bool succeeded = false;
+	
+	if(gShutdown)
+	{
+		snprintf(reply, sizeof(reply), "shutting down");
+	}
+	else
+	{
+		printf("Daemon: Running '%s'\n", pRequest);
+		succeeded = gpHandlers->mRunJob(command, pName, pUpload, uploadSize, reply, sizeof(reply), fileName, sizeof(fileName));
+	}
+	
+	char cartText[DAEMON_MAX_REPLY];
+	gpHandlers->mDescribeCart(cartText, sizeof(cartText));
+	
+	// the job counts as done by the time the client has its reply, but the next one doesn't start
+	// until the reply is out, since it might be writing the same file
+	lock.lock();
+	
+	memcpy(gCartText, cartText, sizeof(gCartText));
+	gRunning = false;
+	gNumDone += succeeded ? 1 : 0;
+	gNumFailed += succeeded ? 0 : 1;
+	
+	lock.unlock();
+	
+	if(!succeeded)
+	{
+		SendError(socket, reply[0] ? reply : "failed, see the daemon's log");
+	}
+	else if(fileName[0])
+	{
+		SendFile(socket, fileName);
+	}
+	else
+	{
+		SendText(socket, reply);
+	}
+	
+	lock.lock();
+	gServing++;
+	lock.unlock();
+	
+	gJobTurn.notify_all();
+}
+
+static void HandleRequest(int socket, const char* pRequest)
+{
+	char word[32] = { 0 };
+	char name[256] = { 0 };
+	uint32_t size = 0;
+	int numFields = sscanf(pRequest, "%31s %255s %u", word, name, &size);
+	
+	const DaemonCommandName* pCommand = (numFields >= 1) ? FindCommand(word) : nullptr;
+	if(!pCommand)
+	{
+		SendError(socket, "unknown command");
+		return;
+	}
+	
+	if(pCommand->mTakesName && (numFields < 2 || !IsValidName(name)))
+	{
+		SendError(socket, "expected a name, one word without any '/'");
+		return;
+	}
+	
+	switch(pCommand->mCommand)
+	{
+		case DaemonCommand::Status:
+		{
+			SendStatus(socket);
+			break;
+		}
+		
+		case DaemonCommand::Cancel:
+		{
+			SendCancel(socket);
+			break;
+		}
+		
+		case DaemonCommand::WriteSRAM:
+		{
+			if(numFields < 3 || size == 0 || size > DAEMON_MAX_UPLOAD)
+			{
+				SendError(socket, "expected the SRAM's size after the name");
+				break;
+			}
+			
+			// taken before queueing, so a job that's waiting its turn isn't holding up the client
+			uint8_t* pUpload = new uint8_t[size];
+			if(ReceiveAll(socket, pUpload, size))
+			{
+				RunJob(socket, pCommand->mCommand, pRequest, name, pUpload, size);
+			}
+			else
+			{
+				SendError(socket, "SRAM upload cut short");
+			}
+			
+			delete[] pUpload;
+			break;
+		}
+		
+		default:
+		{
+			RunJob(socket, pCommand->mCommand, pRequest, name, nullptr, 0);
+			break;
+		}
+	}
+}
+
+static void ServeConnection(int socket)
+{
+	char request[DAEMON_MAX_REQUEST];
+	if(ReceiveLine(socket, request, sizeof(request)))
+	{
+		HandleRequest(socket, request);
+	}
+	else
+	{
+		SendError(socket, "expected a request line");
+	}
+	
+	close(socket);
+	gNumConnections--;
+}
+
+static void OnShutdownSignal(int)
+{
+	gShutdown = true;
+}
+
+static bool MakeSocketAddress(const char* pSocketPath, sockaddr_un& address)
+{
+	memset(&address, 0, sizeof(address));
+	address.sun_family = AF_UNIX;
+	
+	if(strlen(pSocketPath) >= sizeof(address.sun_path))
+	{
+		printf("Daemon: Socket path '%s' is too long\n", pSocketPath);
+		return false;
+	}
+	
+	strcpy(address.sun_path, pSocketPath);
+	return true;
+}
+
+bool RunDaemon(const char* pSocketPath, const DaemonHandlers& handlers)
+{
+	sockaddr_un address;
+	if(!MakeSocketAddress(pSocketPath, address))
+	{
+		return false;
+	}
+	
+	int listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(listener == -1)
+	{
+		printf("Daemon: Failed to create a socket\n");
+		return false;
+	}
+	
+	// a socket file left behind by a daemon that died is in the way of bind, one that still answers isn't ours to take
+	if(connect(listener, (sockaddr*)&address, sizeof(address)) == 0)
+	{
+		printf("Daemon: Another daemon is already listening on '%s'\n", pSocketPath);
+		close(listener);
+		return false;
+	}
+	
+	close(listener);
+	listener = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	unlink(pSocketPath);
+	
+	if(listener == -1 || bind(listener, (sockaddr*)&address, sizeof(address)) != 0 || listen(listener, DAEMON_MAX_CONNECTIONS) != 0)
+	{
+		printf("Daemon: Failed to listen on '%s'\n", pSocketPath);
+		if(listener != -1)
+		{
+			close(listener);
+		}
+		
+		return false;
+	}
+	
+	struct sigaction action;
+	memset(&action, 0, sizeof(action));
+	action.sa_handler = OnShutdownSignal;
+	sigaction(SIGINT, &action, nullptr);
+	sigaction(SIGTERM, &action, nullptr);
+	signal(SIGPIPE, SIG_IGN);
+	
+	gpHandlers = &handlers;
+	handlers.mDescribeCart(gCartText, sizeof(gCartText));
+	
+	printf("Daemon: Listening on '%s'\n", pSocketPath);
+	fflush(stdout);
+	
+	while(!gShutdown)
+	{
+		pollfd listenerPoll = { listener, POLLIN, 0 };
+		if(poll(&listenerPoll, 1, DAEMON_POLL_MS) <= 0)
+		{
+			continue;
+		}
+		
+		int connection = accept4(listener, nullptr, nullptr, SOCK_CLOEXEC);
+		if(connection == -1)
+		{
+			continue;
+		}
+		
+		if(gNumConnections >= DAEMON_MAX_CONNECTIONS)
+		{
+			SendError(connection, "too many connections");
+			close(connection);
+			continue;
+		}
+		
+		// only the request line has to turn up in time, a reply can take as long as the job does
+		timeval timeout = { DAEMON_REQUEST_TIMEOUT_S, 0 };
+		setsockopt(connection, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+		
+		gNumConnections++;
+		std::thread(ServeConnection, connection).detach();
+	}
+	
+	printf("Daemon: Shutting down\n");
+	
+	close(listener);
+	unlink(pSocketPath);
+	
+	// the running job stops at its next chunk and everything queued behind it fails straight away
+	gCancel = true;
+	while(gNumConnections > 0)
+	{
+		usleep(DAEMON_POLL_MS * 1000);
+	}
+	
+	gpHandlers = nullptr;
+	return true;
+}
+
+bool IsCancelRequested()
+{
+	return gCancel.load(std::memory_order_relaxed);
+}
+
+// Writes the payload to pFileName by way of a .part file, so a daemon sending the very same file
+// (same directory, same name) still has it to send.
+static bool ReceiveFile(int socket, uint32_t size, const char* pFileName)
+{
+	char partFileName[310];
+	snprintf(partFileName, sizeof(partFileName), "%s.part", pFileName);
+	
+	FILE* pFile = fopen(partFileName, "wb");
+	if(!pFile)
+	{
+		printf("Client: Failed to open file '%s' for write!\n", partFileName);
+		return false;
+	}
+	
+	static uint8_t buffer[65536];
+	uint32_t numReceived = 0;
+	while(numReceived < size)
+	{
+		uint32_t numWanted = (size - numReceived < sizeof(buffer)) ? size - numReceived : sizeof(buffer);
+		ssize_t numRead = recv(socket, buffer, numWanted, 0);
+		if(numRead <= 0 || fwrite(buffer, numRead, 1, pFile) != 1)
+		{
+			break;
+		}
+		
+		numReceived += numRead;
+	}
+	
+	bool failed = (fclose(pFile) != 0) || numReceived != size;
+	pFile = NULL;
+	
+	if(failed || rename(partFileName, pFileName) != 0)
+	{
+		printf("Client: Only got %u of %u bytes for '%s'\n", numReceived, size, pFileName);
+		unlink(partFileName);
+		return false;
+	}
+	
+	printf("Client: Wrote %u bytes to '%s'\n", size, pFileName);
+	return true;
+}
+
+static bool ReceiveText(int socket, uint32_t size)
+{
+	char buffer[4096];
+	while(size > 0)
+	{
+		uint32_t numWanted = (size < sizeof(buffer)) ? size : sizeof(buffer);
+		ssize_t numRead = recv(socket, buffer, numWanted, 0);
+		if(numRead <= 0)
+		{
+			return false;
+		}
+		
+		fwrite(buffer, numRead, 1, stdout);
+		size -= numRead;
+	}
+	
+	return true;
+}
+
+bool RunDaemonClient(const char* pSocketPath, int argc, const char** argv)
+{
+	if(argc < 1)
+	{
+		printf("Client: Expected one of probe, eject, dump <name>, read-sram <name>, write-sram <name>, status or cancel\n");
+		return false;
+	}
+	
+	// anything that isn't a known command still goes to the daemon, which is what turns it down
+	const DaemonCommandName* pCommand = FindCommand(argv[0]);
+	bool takesName = pCommand && pCommand->mTakesName;
+	const char* pName = (argc > 1) ? argv[1] : "";
+	
+	if(takesName && !IsValidName(pName))
+	{
+		printf("Client: '%s' needs a name, one word without any '/'\n", argv[0]);
+		return false;
+	}
+	
+	char fileName[300] = { 0 };
+	if(takesName)
+	{
+		const char* pExtension = (pCommand->mCommand == DaemonCommand::DumpROM) ? "smc" : "srm";
+		snprintf(fileName, sizeof(fileName), "%s", (argc > 2) ? argv[2] : "");
+		if(!fileName[0])
+		{
+			snprintf(fileName, sizeof(fileName), "./%s.%s", pName, pExtension);
+		}
+	}
+	
+	static uint8_t upload[DAEMON_MAX_UPLOAD + 1];
+	uint32_t uploadSize = 0;
+	if(pCommand && pCommand->mCommand == DaemonCommand::WriteSRAM)
+	{
+		FILE* pFile = fopen(fileName, "rb");
+		if(!pFile)
+		{
+			printf("Client: Failed to open file '%s'\n", fileName);
+			return false;
+		}
+		
+		uploadSize = fread(upload, 1, sizeof(upload), pFile);
+		fclose(pFile);
+		pFile = NULL;
+		
+		if(uploadSize == 0 || uploadSize > DAEMON_MAX_UPLOAD)
+		{
+			printf("Client: '%s' is too big (or too small) to be SRAM\n", fileName);
+			return false;
+		}
+	}
+	
+	char request[DAEMON_MAX_REQUEST];
+	if(uploadSize > 0)
+	{
+		snprintf(request, sizeof(request), "%s %s %u\n", argv[0], pName, uploadSize);
+	}
+	else
+	{
+		snprintf(request, sizeof(request), "%s %s\n", argv[0], pName);
+	}
+	
+	sockaddr_un address;
+	if(!MakeSocketAddress(pSocketPath, address))
+	{
+		return false;
+	}
+	
+	int socket = ::socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+	if(socket == -1 || connect(socket, (sockaddr*)&address, sizeof(address)) != 0)
+	{
+		printf("Client: No daemon on '%s', start one with copyromd or --daemon\n", pSocketPath);
+		if(socket != -1)
+		{
+			close(socket);
+		}
+		
+		return false;
+	}
+	
+	bool succeeded = false;
+	char reply[DAEMON_MAX_REPLY + 8];
+	uint32_t payloadSize = 0;
+	
+	if(!SendAll(socket, request, strlen(request)) || !SendAll(socket, upload, uploadSize) || !ReceiveLine(socket, reply, sizeof(reply)))
+	{
+		printf("Client: The daemon hung up\n");
+	}
+	else if(!strncmp(reply, "ERR ", 4))
+	{
+		printf("Client: %s\n", reply + 4);
+	}
+	else if(sscanf(reply, "OK %u", &payloadSize) != 1)
+	{
+		printf("Client: Didn't understand the reply '%s'\n", reply);
+	}
+	else if(takesName && pCommand->mCommand != DaemonCommand::WriteSRAM)
+	{
+		succeeded = ReceiveFile(socket, payloadSize, fileName);
+	}
+	else
+	{
+		succeeded = ReceiveText(socket, payloadSize);
+	}
+	
+	close(socket);
+	return succeeded;
+}
@@ -0,0 +1,67 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+// copyromd: the backend, the lines and the cart stay set up between jobs, and scripts queue work
+// over a Unix domain socket instead of answering prompts. A request is one line:
+//
+//   probe                    power the cart up and read its header
+//   eject                    hold the cart in reset with nothing driven, so it can come out
+//   dump <name>              dump the rom to <name>.smc, which comes back as the payload
+//   read-sram <name>         read the SRAM to <name>.srm, which comes back as the payload
+//   write-sram <name> <n>    followed by n bytes, which become <name>.srm and go to the cart
+//   status                   what's running, how many are queued and what cart is in
+//   cancel                   stop the dump that's running, leaving its journal for --resume
+//
+// and the reply is "OK <n>\n" followed by n bytes of payload, or "ERR <reason>\n". Bus jobs run
+// one at a time in the order they came in, status and cancel are answered straight away.
+// Files go back with sendfile, straight from the page cache. Once probed, the cart stays powered up
+// with its lines driven until an eject, and the next job after that probes whatever is in by then.
+#define DAEMON_DEFAULT_SOCKET "/tmp/copyromd.sock"
+
+#define DAEMON_MAX_REQUEST (300)
+#define DAEMON_MAX_REPLY (1024)
+#define DAEMON_MAX_CONNECTIONS (16)
+
+// the biggest SRAM a header can claim, see MAX_SRAM_SIZE
+#define DAEMON_MAX_UPLOAD (1024 << 7)
+
+// how often the accept loop looks for SIGINT/SIGTERM, and how long a client gets to send its request
+#define DAEMON_POLL_MS (200)
+#define DAEMON_REQUEST_TIMEOUT_S (5)
+
+enum class DaemonCommand
+{
+	Probe,
+	Eject,
+	DumpROM,
+	ReadSRAM,
+	WriteSRAM,
+	Status,
+	Cancel
+};
+
+struct DaemonHandlers
+{
+	// Runs a bus job, one at a time. pName and the upload are only there for the commands that take
+	// them. If pFileName is filled in that file is the payload, otherwise pReply is. On failure
+	// pReply says why.
+	std::function<bool(DaemonCommand command, const char* pName, const uint8_t* pUpload, uint32_t uploadSize,
+		char* pReply, uint32_t replySize, char* pFileName, uint32_t fileNameSize)> mRunJob;
+	
+	// a line about the cart that's in, for status
+	std::function<void(char* pText, uint32_t size)> mDescribeCart;
+};
+
+// Serves requests on pSocketPath until SIGINT or SIGTERM, then lets whatever is queued fail and
+// waits for the job that's running. Returns false if it couldn't listen.
+bool RunDaemon(const char* pSocketPath, const DaemonHandlers& handlers);
+
+// Whether a cancel came in for the job that's running. Always false outside the daemon.
+bool IsCancelRequested();
+
+// Sends one request (argv is the command and its arguments) and handles the reply. Payload text is
+// printed, dumps and SRAM are written to the file given after the name, or ./<name>.smc/.srm.
+// Returns false on ERR or if there's no daemon to talk to.
+bool RunDaemonClient(const char* pSocketPath, int argc, const char** argv);
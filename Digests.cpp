@@ -0,0 +1,231 @@
+#include "Digests.h"
+
+#include <cstring>
+
+static inline uint32_t RotateLeft(uint32_t value, uint32_t bits)
+{
+	return (value << bits) | (value >> (32 - bits));
+}
+
+// Both pad the same way: a 1 bit, zeros up to 56 bytes into a block, then the length in bits,
+// little endian for MD5 and big endian for SHA-1.
+static uint32_t GetPadSize(uint64_t numBytes)
+{
+	uint32_t used = (uint32_t)(numBytes % 64);
+	return (used < 56) ? 56 - used : 120 - used;
+}
+
+static const uint8_t gPadding[64] = { 0x80 };
+
+void Md5::Reset()
+{
+	mState[0] = 0x67452301;
+	mState[1] = 0xEFCDAB89;
+	mState[2] = 0x98BADCFE;
+	mState[3] = 0x10325476;
+	mNumBytes = 0;
+}
+
+void Md5::Update(const uint8_t* pData, uint32_t size)
+{
+	uint32_t used = (uint32_t)(mNumBytes % 64);
+	mNumBytes += size;
+	
+	if(used)
+	{
+		uint32_t toCopy = (size < 64 - used) ? size : 64 - used;
+		memcpy(mBlock + used, pData, toCopy);
+		pData += toCopy;
+		size -= toCopy;
+		
+		if(used + toCopy < 64)
+		{
+			return;
+		}
+		
+		ProcessBlock(mBlock);
+	}
+	
+	for(; size >= 64; pData += 64, size -= 64)
+	{
+		ProcessBlock(pData);
+	}
+	
+	memcpy(mBlock, pData, size);
+}
+
+void Md5::Finish(uint8_t* pDigest)
+{
+	uint64_t numBits = mNumBytes * 8;
+	
+	uint8_t length[8];
+	for(uint32_t i = 0; i < 8; i++)
+	{
+		length[i] = (uint8_t)(numBits >> (i * 8));
+	}
+	
+	Update(gPadding, GetPadSize(mNumBytes));
+	Update(length, sizeof(length));
+	
+	for(uint32_t i = 0; i < 16; i++)
+	{
+		pDigest[i] = (uint8_t)(mState[i / 4] >> ((i % 4) * 8));
+	}
+}
+
+void Md5::ProcessBlock(const uint8_t* pBlock)
+{
+	static const uint32_t sines[64] =
+	{
+		0xD76AA478, 0xE8C7B756, 0x242070DB, 0xC1BDCEEE, 0xF57C0FAF, 0x4787C62A, 0xA8304613, 0xFD469501,
+		0x698098D8, 0x8B44F7AF, 0xFFFF5BB1, 0x895CD7BE, 0x6B901122, 0xFD987193, 0xA679438E, 0x49B40821,
+		0xF61E2562, 0xC040B340, 0x265E5A51, 0xE9B6C7AA, 0xD62F105D, 0x02441453, 0xD8A1E681, 0xE7D3FBC8,
+		0x21E1CDE6, 0xC33707D6, 0xF4D50D87, 0x455A14ED, 0xA9E3E905, 0xFCEFA3F8, 0x676F02D9, 0x8D2A4C8A,
+		0xFFFA3942, 0x8771F681, 0x6D9D6122, 0xFDE5380C, 0xA4BEEA44, 0x4BDECFA9, 0xF6BB4B60, 0xBEBFBC70,
+		0x289B7EC6, 0xEAA127FA, 0xD4EF3085, 0x04881D05, 0xD9D4D039, 0xE6DB99E5, 0x1FA27CF8, 0xC4AC5665,
+		0xF4292244, 0x432AFF97, 0xAB9423A7, 0xFC93A039, 0x655B59C3, 0x8F0CCC92, 0xFFEFF47D, 0x85845DD1,
+		0x6FA87E4F, 0xFE2CE6E0, 0xA3014314, 0x4E0811A1, 0xF7537E82, 0xBD3AF235, 0x2AD7D2BB, 0xEB86D391
+	};
+	
+	static const uint32_t shifts[16] = { 7, 12, 17, 22, 5, 9, 14, 20, 4, 11, 16, 23, 6, 10, 15, 21 };
+	
+	uint32_t words[16];
+	for(uint32_t i = 0; i < 16; i++)
+	{
+		words[i] = pBlock[i * 4] | (pBlock[i * 4 + 1] << 8) | (pBlock[i * 4 + 2] << 16) | ((uint32_t)pBlock[i * 4 + 3] << 24);
+	}
+	
+	uint32_t a = mState[0];
+	uint32_t b = mState[1];
+	uint32_t c = mState[2];
+	uint32_t d = mState[3];
+	
+	for(uint32_t i = 0; i < 64; i++)
+	{
+		uint32_t f = 0;
+		uint32_t word = 0;
+		
+		switch(i / 16)
+		{
+			case 0: f = (b & c) | (~b & d); word = i; break;
+			case 1: f = (d & b) | (~d & c); word = (5 * i + 1) % 16; break;
+			case 2: f = b ^ c ^ d; word = (3 * i + 5) % 16; break;
+			default: f = c ^ (b | ~d); word = (7 * i) % 16; break;
+		}
+		
+		uint32_t next = d;
+		d = c;
+		c = b;
+		b = b + RotateLeft(a + f + sines[i] + words[word], shifts[(i / 16) * 4 + (i % 4)]);
+		a = next;
+	}
+	
+	mState[0] += a;
+	mState[1] += b;
+	mState[2] += c;
+	mState[3] += d;
+}
+
+void Sha1::Reset()
+{
+	mState[0] = 0x67452301;
+	mState[1] = 0xEFCDAB89;
+	mState[2] = 0x98BADCFE;
+	mState[3] = 0x10325476;
+	mState[4] = 0xC3D2E1F0;
+	mNumBytes = 0;
+}
+
+void Sha1::Update(const uint8_t* pData, uint32_t size)
+{
+	uint32_t used = (uint32_t)(mNumBytes % 64);
+	mNumBytes += size;
+	
+	if(used)
+	{
+		uint32_t toCopy = (size < 64 - used) ? size : 64 - used;
+		memcpy(mBlock + used, pData, toCopy);
+		pData += toCopy;
+		size -= toCopy;
+		
+		if(used + toCopy < 64)
+		{
+			return;
+		}
+		
+		ProcessBlock(mBlock);
+	}
+	
+	for(; size >= 64; pData += 64, size -= 64)
+	{
+		ProcessBlock(pData);
+	}
+	
+	memcpy(mBlock, pData, size);
+}
+
+void Sha1::Finish(uint8_t* pDigest)
+{
+	uint64_t numBits = mNumBytes * 8;
+	
+	uint8_t length[8];
+	for(uint32_t i = 0; i < 8; i++)
+	{
+		length[i] = (uint8_t)(numBits >> ((7 - i) * 8));
+	}
+	
+	Update(gPadding, GetPadSize(mNumBytes));
+	Update(length, sizeof(length));
+	
+	for(uint32_t i = 0; i < 20; i++)
+	{
+		pDigest[i] = (uint8_t)(mState[i / 4] >> ((3 - (i % 4)) * 8));
+	}
+}
+
+void Sha1::ProcessBlock(const uint8_t* pBlock)
+{
+	uint32_t words[80];
+	for(uint32_t i = 0; i < 16; i++)
+	{
+		words[i] = ((uint32_t)pBlock[i * 4] << 24) | (pBlock[i * 4 + 1] << 16) | (pBlock[i * 4 + 2] << 8) | pBlock[i * 4 + 3];
+	}
+	
+	for(uint32_t i = 16; i < 80; i++)
+	{
+		words[i] = RotateLeft(words[i - 3] ^ words[i - 8] ^ words[i - 14] ^ words[i - 16], 1);
+	}
+	
+	uint32_t a = mState[0];
+	uint32_t b = mState[1];
+	uint32_t c = mState[2];
+	uint32_t d = mState[3];
+	uint32_t e = mState[4];
+	
+	for(uint32_t i = 0; i < 80; i++)
+	{
+		uint32_t f = 0;
+		uint32_t k = 0;
+		
+		switch(i / 20)
+		{
+			case 0: f = (b & c) | (~b & d); k = 0x5A827999; break;
+			case 1: f = b ^ c ^ d; k = 0x6ED9EBA1; break;
+			case 2: f = (b & c) | (b & d) | (c & d); k = 0x8F1BBCDC; break;
+			default: f = b ^ c ^ d; k = 0xCA62C1D6; break;
+		}
+		
+		uint32_t next = RotateLeft(a, 5) + f + e + k + words[i];
+		e = d;
+		d = c;
+		c = RotateLeft(b, 30);
+		b = a;
+		a = next;
+	}
+	
+	mState[0] += a;
+	mState[1] += b;
+	mState[2] += c;
+	mState[3] += d;
+	mState[4] += e;
+}
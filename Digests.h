@@ -0,0 +1,40 @@
+#pragma once
+
+#include <cstdint>
+
+// MD5 and SHA-1, the other two hashes dump databases list, fed a piece at a time.
+// Plain copyable state, so a digest can be snapshotted part way and finished later.
+#define MD5_DIGEST_SIZE (16)
+#define SHA1_DIGEST_SIZE (20)
+
+class Md5
+{
+public:
+	void Reset();
+	void Update(const uint8_t* pData, uint32_t size);
+	void Finish(uint8_t* pDigest);
+	
+private:
+	void ProcessBlock(const uint8_t* pBlock);
+	
+private:
+	uint32_t mState[4];
+	uint64_t mNumBytes;
+	uint8_t mBlock[64];
+};
+
+class Sha1
+{
+public:
+	void Reset();
+	void Update(const uint8_t* pData, uint32_t size);
+	void Finish(uint8_t* pDigest);
+	
+private:
+	void ProcessBlock(const uint8_t* pBlock);
+	
+private:
+	uint32_t mState[5];
+	uint64_t mNumBytes;
+	uint8_t mBlock[64];
+};
@@ -0,0 +1,138 @@
+#include "DumpHasher.h"
+
+#include <stdio.h>
+
+#include "Crc32.h"
+
+static bool IsPowerOfTwo(uint32_t size)
+{
+	return size && (size & (size - 1)) == 0;
+}
+
+static uint32_t GetLargestPowerOfTwo(uint32_t size)
+{
+	uint32_t power = 1;
+	while(power * 2 <= size)
+	{
+		power *= 2;
+	}
+	
+	return power;
+}
+
+void DumpHasher::Reset()
+{
+	mState.mCrc32 = 0;
+	mState.mMd5.Reset();
+	mState.mSha1.Reset();
+	
+	mNumBytes = 0;
+	mNumChunks = 0;
+}
+
+void DumpHasher::AddChunk(const uint8_t* pData, uint32_t size)
+{
+	if(mNumChunks >= MAX_HASHED_CHUNKS)
+	{
+		return;
+	}
+	
+	mChunkStarts[mNumChunks] = mState;
+	
+	mState.mCrc32 = Crc32(pData, size, mState.mCrc32);
+	mState.mMd5.Update(pData, size);
+	mState.mSha1.Update(pData, size);
+	
+	uint32_t sum = 0;
+	for(uint32_t i = 0; i < size; i++)
+	{
+		sum += pData[i];
+	}
+	
+	mChunkSums[mNumChunks++] = sum;
+	mNumBytes += size;
+}
+
+bool DumpHasher::Finish(uint32_t romSize, RomDigests& digests)
+{
+	State state = mState;
+	if(romSize != mNumBytes)
+	{
+		if(romSize % CHUNK_SIZE != 0 || romSize / CHUNK_SIZE >= mNumChunks)
+		{
+			return false;
+		}
+		
+		state = mChunkStarts[romSize / CHUNK_SIZE];
+	}
+	
+	digests.mSize = romSize;
+	digests.mCrc32 = state.mCrc32;
+	state.mMd5.Finish(digests.mMd5);
+	state.mSha1.Finish(digests.mSha1);
+	
+	// The header checksum is the sum of every byte the console sees, and a rom that isn't a power of two
+	// has its last part mirrored to fill it out to one (a 3MB rom sums as 2MB + 1MB + the 1MB again).
+	// That only works out for whole chunks, which is every real rom size.
+	digests.mChecksumValid = (romSize % CHUNK_SIZE) == 0;
+	digests.mChecksum = digests.mChecksumValid ? (uint16_t)MirroredSum(0, romSize, IsPowerOfTwo(romSize) ? romSize : GetLargestPowerOfTwo(romSize) * 2) : 0;
+	
+	return true;
+}
+
+uint32_t DumpHasher::SumChunks(uint32_t offset, uint32_t size) const
+{
+	uint32_t sum = 0;
+	for(uint32_t i = offset / CHUNK_SIZE; i < (offset + size) / CHUNK_SIZE; i++)
+	{
+		sum += mChunkSums[i];
+	}
+	
+	return sum;
+}
+
+// The sum of size bytes at offset, repeated to fill fillSize.
+uint32_t DumpHasher::MirroredSum(uint32_t offset, uint32_t size, uint32_t fillSize) const
+{
+	if(IsPowerOfTwo(size))
+	{
+		return SumChunks(offset, size) * (fillSize / size);
+	}
+	
+	uint32_t lowerSize = GetLargestPowerOfTwo(size);
+	uint32_t sum = SumChunks(offset, lowerSize) + MirroredSum(offset + lowerSize, size - lowerSize, lowerSize);
+	
+	return sum * (fillSize / (lowerSize * 2));
+}
+
+void DumpHasher::Print(const RomDigests& digests, uint16_t headerChecksum)
+{
+	printf("Digests: %dKB, CRC32 %08X\n", digests.mSize / 1024, digests.mCrc32);
+	
+	printf("Digests: MD5   ");
+	for(uint32_t i = 0; i < MD5_DIGEST_SIZE; i++)
+	{
+		printf("%02x", digests.mMd5[i]);
+	}
+	
+	printf("\nDigests: SHA-1 ");
+	for(uint32_t i = 0; i < SHA1_DIGEST_SIZE; i++)
+	{
+		printf("%02x", digests.mSha1[i]);
+	}
+	
+	printf("\n");
+	
+	if(!digests.mChecksumValid)
+	{
+		printf("Digests: Can't work out a checksum for a rom that size\n");
+	}
+	else if(digests.mChecksum == headerChecksum)
+	{
+		printf("Digests: Checksum %04X matches the header\n", digests.mChecksum);
+	}
+	else
+	{
+		printf("Digests: Checksum %04X doesn't match the header's %04X, the dump is bad or the header is wrong\n", digests.mChecksum, headerChecksum);
+	}
+}
@@ -0,0 +1,59 @@
+#pragma once
+
+#include <cstdint>
+
+#include "ChunkWriter.h"
+#include "Digests.h"
+
+// Hashes a dump a chunk at a time as it's written, so the digests are ready the moment the last
+// byte comes off the bus instead of needing another pass over the file.
+#define MAX_HASHED_CHUNKS (MAX_DUMP_SIZE / CHUNK_SIZE)
+
+struct RomDigests
+{
+	uint32_t mSize;
+	uint32_t mCrc32;
+	uint8_t mMd5[MD5_DIGEST_SIZE];
+	uint8_t mSha1[SHA1_DIGEST_SIZE];
+	
+	// what the cart's header checksum should be for this rom
+	uint16_t mChecksum;
+	bool mChecksumValid;
+};
+
+class DumpHasher
+{
+public:
+	void Reset();
+	
+	// From the writer thread, in file order
+	void AddChunk(const uint8_t* pData, uint32_t size);
+	
+	// The digests of the first romSize bytes. Mirror trimming only ever cuts a dump back to the end of
+	// a chunk, so romSize is either everything added or a whole number of chunks.
+	bool Finish(uint32_t romSize, RomDigests& digests);
+	
+	// Prints the digests and how the checksum compares with the one in the header
+	static void Print(const RomDigests& digests, uint16_t headerChecksum);
+	
+private:
+	uint32_t SumChunks(uint32_t offset, uint32_t size) const;
+	uint32_t MirroredSum(uint32_t offset, uint32_t size, uint32_t fillSize) const;
+	
+private:
+	struct State
+	{
+		uint32_t mCrc32;
+		Md5 mMd5;
+		Sha1 mSha1;
+	};
+	
+	State mState;
+	uint32_t mNumBytes = 0;
+	uint32_t mNumChunks = 0;
+	
+	// the state at the start of each chunk, so the digests can be finished wherever the rom ends,
+	// and each chunk's byte sum for the checksum
+	State mChunkStarts[MAX_HASHED_CHUNKS];
+	uint32_t mChunkSums[MAX_HASHED_CHUNKS];
+};
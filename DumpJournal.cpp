@@ -0,0 +1,164 @@
+#include "DumpJournal.h"
+
+#include <cstring>
+#include <stdio.h>
+#include <unistd.h>
+
+static const char gJournalMagic[4] = { 'C', 'R', 'J', '1' };
+
+uint32_t DumpJournal::Begin(const char* pRomFileName, const RomInfo* pRomInfo, uint32_t romSize, bool resume)
+{
+	snprintf(mFileName, sizeof(mFileName) - 1, "%s.journal", pRomFileName);
+	
+	memset(mDone, 0, sizeof(mDone));
+	memset(mPending, 0, sizeof(mPending));
+	memset(mCrcs, 0, sizeof(mCrcs));
+	
+	uint32_t numDone = 0;
+	if(resume && Load(pRomInfo, romSize))
+	{
+		for(uint32_t i = 0; i < mHeader.mNumChunks; i++)
+		{
+			numDone += mDone[i];
+		}
+		
+		return numDone;
+	}
+	
+	memset(&mHeader, 0, sizeof(mHeader));
+	memcpy(mHeader.mMagic, gJournalMagic, sizeof(mHeader.mMagic));
+	mHeader.mChunkSize = CHUNK_SIZE;
+	mHeader.mRomSize = romSize;
+	mHeader.mNumChunks = (romSize + CHUNK_SIZE - 1) / CHUNK_SIZE;
+	memcpy(mHeader.mTitle, pRomInfo->mTitle, sizeof(mHeader.mTitle));
+	mHeader.mChecksum = pRomInfo->mChecksum;
+	mHeader.mMapping = (uint32_t)pRomInfo->mMapping;
+	
+	// whatever an earlier dump left is about to be overwritten, so don't let its journal outlive it
+	Save();
+	return 0;
+}
+
+bool DumpJournal::IsChunkDone(uint32_t chunkIndex, uint32_t& crc) const
+{
+	if(chunkIndex >= mHeader.mNumChunks || !mDone[chunkIndex])
+	{
+		return false;
+	}
+	
+	crc = mCrcs[chunkIndex];
+	return true;
+}
+
+void DumpJournal::AddChunk(uint32_t chunkIndex, uint32_t crc)
+{
+	if(chunkIndex >= mHeader.mNumChunks)
+	{
+		return;
+	}
+	
+	mCrcs[chunkIndex] = crc;
+	mPending[chunkIndex] = 1;
+}
+
+bool DumpJournal::Checkpoint()
+{
+	bool changed = false;
+	for(uint32_t i = 0; i < mHeader.mNumChunks; i++)
+	{
+		if(mPending[i])
+		{
+			mDone[i] = 1;
+			mPending[i] = 0;
+			changed = true;
+		}
+	}
+	
+	return !changed || Save();
+}
+
+void DumpJournal::Remove()
+{
+	unlink(mFileName);
+}
+
+bool DumpJournal::Load(const RomInfo* pRomInfo, uint32_t romSize)
+{
+	FILE* pFile = fopen(mFileName, "rb");
+	if(!pFile)
+	{
+		printf("DumpJournal: No journal '%s', starting from the beginning\n", mFileName);
+		return false;
+	}
+	
+	uint8_t bitmap[MAX_JOURNAL_CHUNKS / 8];
+	
+	bool loaded = fread(&mHeader, sizeof(mHeader), 1, pFile) == 1 &&
+		!memcmp(mHeader.mMagic, gJournalMagic, sizeof(mHeader.mMagic)) &&
+		mHeader.mChunkSize == CHUNK_SIZE &&
+		mHeader.mNumChunks == (mHeader.mRomSize + CHUNK_SIZE - 1) / CHUNK_SIZE &&
+		mHeader.mNumChunks <= MAX_JOURNAL_CHUNKS &&
+		fread(bitmap, (mHeader.mNumChunks + 7) / 8, 1, pFile) == 1 &&
+		fread(mCrcs, sizeof(uint32_t) * mHeader.mNumChunks, 1, pFile) == 1;
+	
+	fclose(pFile);
+	
+	if(!loaded)
+	{
+		printf("DumpJournal: '%s' is unreadable, starting from the beginning\n", mFileName);
+		return false;
+	}
+	
+	// a journal for a different cart would have us splice two roms together
+	if(mHeader.mRomSize != romSize || mHeader.mChecksum != pRomInfo->mChecksum || mHeader.mMapping != (uint32_t)pRomInfo->mMapping ||
+		memcmp(mHeader.mTitle, pRomInfo->mTitle, sizeof(mHeader.mTitle)))
+	{
+		printf("DumpJournal: '%s' is from a different cart, starting from the beginning\n", mFileName);
+		return false;
+	}
+	
+	for(uint32_t i = 0; i < mHeader.mNumChunks; i++)
+	{
+		mDone[i] = (bitmap[i / 8] >> (i % 8)) & 0x1;
+	}
+	
+	return true;
+}
+
+// Writes a new journal and renames it over the old one, so a crash part way through a save
+// still leaves a whole journal behind.
+bool DumpJournal::Save()
+{
+	char tempFileName[sizeof(mFileName) + 4];
+	snprintf(tempFileName, sizeof(tempFileName), "%s.tmp", mFileName);
+	
+	uint8_t bitmap[MAX_JOURNAL_CHUNKS / 8] = { 0 };
+	for(uint32_t i = 0; i < mHeader.mNumChunks; i++)
+	{
+		bitmap[i / 8] |= mDone[i] << (i % 8);
+	}
+	
+	FILE* pFile = fopen(tempFileName, "wb");
+	if(!pFile)
+	{
+		printf("DumpJournal: Failed to open file '%s' for write!\n", tempFileName);
+		return false;
+	}
+	
+	bool saved = fwrite(&mHeader, sizeof(mHeader), 1, pFile) == 1 &&
+		fwrite(bitmap, (mHeader.mNumChunks + 7) / 8, 1, pFile) == 1 &&
+		fwrite(mCrcs, sizeof(uint32_t) * mHeader.mNumChunks, 1, pFile) == 1 &&
+		fflush(pFile) == 0 &&
+		fsync(fileno(pFile)) == 0;
+	
+	fclose(pFile);
+	
+	if(!saved || rename(tempFileName, mFileName) != 0)
+	{
+		printf("DumpJournal: Failed to save '%s'\n", mFileName);
+		unlink(tempFileName);
+		return false;
+	}
+	
+	return true;
+}
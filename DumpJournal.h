@@ -0,0 +1,58 @@
+#pragma once
+
+#include <cstdint>
+
+#include "ChunkWriter.h"
+#include "RomManager.h"
+
+// A sidecar next to the dump (<name>.smc.journal) recording which chunks of it are safely on disk and
+// their CRC32s, so an interrupted dump can pick up where it left off with --resume instead of starting
+// again from bank 0. It only ever claims chunks the rom file has been synced past, and is removed once
+// the dump completes.
+#define MAX_JOURNAL_CHUNKS (MAX_DUMP_SIZE / CHUNK_SIZE)
+
+class DumpJournal
+{
+public:
+	// Starts a journal for dumping romSize bytes of the cart into pRomFileName. With resume it carries on
+	// from the one an earlier dump of the same cart left behind, if there is one. Returns how many chunks
+	// that one had finished.
+	uint32_t Begin(const char* pRomFileName, const RomInfo* pRomInfo, uint32_t romSize, bool resume);
+	
+	// Whether an earlier dump finished this chunk, and what it read
+	bool IsChunkDone(uint32_t chunkIndex, uint32_t& crc) const;
+	
+	// From the writer thread: the chunk is written, but not synced yet
+	void AddChunk(uint32_t chunkIndex, uint32_t crc);
+	
+	// From the writer thread: everything added so far is on disk, so record it
+	bool Checkpoint();
+	
+	// The dump finished, there's nothing to resume
+	void Remove();
+	
+private:
+	bool Load(const RomInfo* pRomInfo, uint32_t romSize);
+	bool Save();
+	
+private:
+	// what's in the file, as is
+	struct Header
+	{
+		char mMagic[4];
+		uint32_t mChunkSize;
+		uint32_t mRomSize;
+		uint32_t mNumChunks;
+		char mTitle[22];
+		uint16_t mChecksum;
+		uint32_t mMapping;
+	};
+	
+	char mFileName[320] = { 0 };
+	Header mHeader;
+	
+	// a byte per chunk here, the file packs them into a bitmap
+	uint8_t mDone[MAX_JOURNAL_CHUNKS];
+	uint8_t mPending[MAX_JOURNAL_CHUNKS];
+	uint32_t mCrcs[MAX_JOURNAL_CHUNKS];
+};
@@ -0,0 +1,288 @@
+#include "GPIODBackend.h"
+
+static const char gRequestingProgram[] = "CopyRom";
+
+GPIODBackend::GPIODBackend(const char* pChipName) : mpChipName(pChipName)
+{
+}
+
+GPIODBackend::~GPIODBackend()
+{
+	Close();
+}
+
+bool GPIODBackend::Open()
+{
+	mpChip = gpiod_chip_open_lookup(mpChipName);
+	if(!mpChip)
+	{
+		printf("open chip '%s' failed\n", mpChipName);
+		return false;
+	}
+	
+	return true;
+}
+
+void GPIODBackend::Close()
+{
+	for(uint32_t i = 0; i < mNumBuses; i++)
+	{
+		Release(mBuses[i].mLineMask);
+	}
+	
+	mNumBuses = 0;
+	
+	if(mpChip)
+	{
+		gpiod_chip_close(mpChip);
+		mpChip = nullptr;
+	}
+}
+
+bool GPIODBackend::Configure(uint32_t lineMask, LineDirection direction, uint32_t levels)
+{
+	Bus* pBus = GetBus(lineMask);
+	if(!pBus)
+	{
+		mNumErrors++;
+		return false;
+	}
+	
+	int lineVals[MAX_BUS_LINES];
+	for(uint32_t i = 0; i < pBus->mNumLines; i++)
+	{
+		lineVals[i] = (levels >> pBus->mGPIOLineNums[i]) & 0x1;
+	}
+	
+	int32_t requestType = GPIOD_LINE_REQUEST_DIRECTION_INPUT;
+	int32_t flags = 0;
+	
+	switch(direction)
+	{
+		case LineDirection::Output:
+		{
+			requestType = GPIOD_LINE_REQUEST_DIRECTION_OUTPUT;
+			break;
+		}
+		
+		case LineDirection::Input:
+		{
+			flags = GPIOD_LINE_REQUEST_FLAG_BIAS_PULL_DOWN;
+			break;
+		}
+		
+		case LineDirection::HiZ:
+		{
+			flags = GPIOD_LINE_REQUEST_FLAG_BIAS_PULL_UP;
+			break;
+		}
+		
+		case LineDirection::Edges:
+		{
+			requestType = GPIOD_LINE_REQUEST_EVENT_BOTH_EDGES;
+			flags = GPIOD_LINE_REQUEST_FLAG_BIAS_PULL_UP;
+			break;
+		}
+		
+		default:
+		{
+			LOG("Invalid direction.");
+			return false;
+		}
+	}
+	
+	// an event request can only be swapped for another request, not changed
+	bool edges = (direction == LineDirection::Edges);
+	if(pBus->mRequested && (edges || pBus->mEdges))
+	{
+		gpiod_line_release_bulk(&pBus->mBulk);
+		mNumKernelCalls++;
+		pBus->mRequested = false;
+	}
+	
+	// one ioctl either way
+	mNumKernelCalls++;
+	
+	int32_t result = 0;
+	if(!pBus->mRequested)
+	{
+		gpiod_line_request_config config = { gRequestingProgram, requestType, flags };
+		result = gpiod_line_request_bulk(&pBus->mBulk, &config, lineVals);
+		
+		pBus->mRequested = (result != -1);
+	}
+	else
+	{
+		result = gpiod_line_set_config_bulk(&pBus->mBulk, requestType, flags, lineVals);
+	}
+	
+	if(result == -1)
+	{
+		mNumErrors++;
+		return false;
+	}
+	
+	pBus->mEdges = edges;
+	return true;
+}
+
+void GPIODBackend::Release(uint32_t lineMask)
+{
+	for(uint32_t i = 0; i < mNumBuses; i++)
+	{
+		if(mBuses[i].mLineMask == lineMask && mBuses[i].mRequested)
+		{
+			gpiod_line_release_bulk(&mBuses[i].mBulk);
+			mNumKernelCalls++;
+			mBuses[i].mRequested = false;
+		}
+	}
+}
+
+void GPIODBackend::Write(uint32_t lineMask, uint32_t levels)
+{
+	Bus* pBus = GetBus(lineMask);
+	if(!pBus)
+	{
+		mNumErrors++;
+		return;
+	}
+	
+	int lineVals[MAX_BUS_LINES];
+	for(uint32_t i = 0; i < pBus->mNumLines; i++)
+	{
+		lineVals[i] = (levels >> pBus->mGPIOLineNums[i]) & 0x1;
+	}
+	
+	mNumKernelCalls++;
+	int32_t result = gpiod_line_set_value_bulk(&pBus->mBulk, lineVals);
+	if(result == -1)
+	{
+		LOG("Failed to write to bus.");
+		mNumErrors++;
+	}
+}
+
+uint32_t GPIODBackend::Read(uint32_t lineMask)
+{
+	Bus* pBus = GetBus(lineMask);
+	if(!pBus)
+	{
+		mNumErrors++;
+		return lineMask;
+	}
+	
+	int lineVals[MAX_BUS_LINES];
+	mNumKernelCalls++;
+	int32_t result = gpiod_line_get_value_bulk(&pBus->mBulk, lineVals);
+	if(result == -1)
+	{
+		LOG("Failed to read value for bus.");
+		mNumErrors++;
+		return lineMask;
+	}
+	
+	uint32_t levels = 0;
+	for(uint32_t i = 0; i < pBus->mNumLines; i++)
+	{
+		levels |= (lineVals[i] != 0 ? 0x1 : 0) << pBus->mGPIOLineNums[i];
+	}
+	
+	return levels;
+}
+
+// The kernel queues every edge on an event request, so this sleeps in gpiod_line_event_wait and
+// nothing that happens between waits is lost. That also means an edge from before the caller last
+// read the lines can still be queued, which just costs the caller another look at them. Only the
+// bus's first line is watched, edges are for single line buses.
+bool GPIODBackend::WaitForEdge(uint32_t lineMask, uint32_t levels, uint32_t timeoutUs)
+{
+	Bus* pBus = GetBus(lineMask);
+	if(!pBus || !pBus->mEdges)
+	{
+		return GPIOBackend::WaitForEdge(lineMask, levels, timeoutUs);
+	}
+	
+	gpiod_line* pLine = pBus->mBulk.lines[0];
+	timespec timeout = { (time_t)(timeoutUs / 1000000), (long)(timeoutUs % 1000000) * 1000 };
+	bool edge = false;
+	
+	// take everything that's queued, a bouncing contact can leave dozens
+	while(true)
+	{
+		mNumKernelCalls++;
+		int32_t result = gpiod_line_event_wait(pLine, &timeout);
+		if(result == -1)
+		{
+			LOG("Failed to wait for an edge.");
+			mNumErrors++;
+			return edge;
+		}
+		
+		if(result == 0)
+		{
+			return edge;
+		}
+		
+		gpiod_line_event event;
+		mNumKernelCalls++;
+		if(gpiod_line_event_read(pLine, &event) == -1)
+		{
+			LOG("Failed to read an edge.");
+			mNumErrors++;
+			return edge;
+		}
+		
+		edge = true;
+		timeout = { 0, 0 };
+	}
+}
+
+// Finds the bulk for a bus, looking its lines up the first time it's seen.
+// Looking a line up costs a line info ioctl, so this only ever happens once per bus.
+GPIODBackend::Bus* GPIODBackend::GetBus(uint32_t lineMask)
+{
+	for(uint32_t i = 0; i < mNumBuses; i++)
+	{
+		if(mBuses[i].mLineMask == lineMask)
+		{
+			return &mBuses[i];
+		}
+	}
+	
+	if(!mpChip)
+	{
+		LOG("Chip invalid");
+		return nullptr;
+	}
+	
+	if(mNumBuses + 1 > MAX_GPIOD_BUSES)
+	{
+		LOG("Too many buses. Increase MAX_GPIOD_BUSES.");
+		return nullptr;
+	}
+	
+	Bus* pBus = &mBuses[mNumBuses];
+	pBus->mLineMask = lineMask;
+	pBus->mNumLines = 0;
+	pBus->mRequested = false;
+	pBus->mEdges = false;
+	
+	for(uint32_t i = 0; i < MAX_BUS_LINES; i++)
+	{
+		if(lineMask & (0x1u << i))
+		{
+			pBus->mGPIOLineNums[pBus->mNumLines++] = i;
+		}
+	}
+	
+	gpiod_line_bulk_init(&pBus->mBulk);
+	if(gpiod_chip_get_lines(mpChip, pBus->mGPIOLineNums, pBus->mNumLines, &pBus->mBulk) != 0)
+	{
+		LOG("Failed to open lines.");
+		return nullptr;
+	}
+	
+	mNumBuses++;
+	return pBus;
+}
@@ -0,0 +1,50 @@
+#pragma once
+
+#include <gpiod.h>
+
+#include "GPIOManager.h"
+
+#define MAX_GPIOD_BUSES (8)
+
+// Drives the pins through libgpiod. Each bus is one bulk line request, so a whole bus is
+// written or read with a single ioctl, and it's requested once then reconfigured in place.
+class GPIODBackend final : public GPIOBackend
+{
+public:
+	GPIODBackend(const char* pChipName);
+	~GPIODBackend();
+	
+	bool Open() override;
+	void Close() override;
+	
+	bool Configure(uint32_t lineMask, LineDirection direction, uint32_t levels) override;
+	void Release(uint32_t lineMask) override;
+	
+	void Write(uint32_t lineMask, uint32_t levels) override;
+	uint32_t Read(uint32_t lineMask) override;
+	
+	bool WaitForEdge(uint32_t lineMask, uint32_t levels, uint32_t timeoutUs) override;
+	
+private:
+	struct Bus
+	{
+		uint32_t mLineMask;
+		uint32_t mNumLines;
+		unsigned int mGPIOLineNums[MAX_BUS_LINES];
+		gpiod_line_bulk mBulk;
+		bool mRequested;
+		
+		// requested for edge events, which the kernel won't reconfigure in place
+		bool mEdges;
+	};
+	
+	Bus* GetBus(uint32_t lineMask);
+	
+private:
+	// name, path, label or number, anything gpiod_chip_open_lookup takes
+	const char* mpChipName = nullptr;
+	gpiod_chip* mpChip = nullptr;
+	
+	Bus mBuses[MAX_GPIOD_BUSES];
+	uint32_t mNumBuses = 0;
+};
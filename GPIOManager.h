@@ -0,0 +1,549 @@
+#pragma once
+
+#include <cstdint>
+#include <stdio.h>
+#include <unistd.h>
+
+#include "AddressShifter.h"
+#include "BusTiming.h"
+#include "PinMap.h"
+#include "Realtime.h"
+
+// goes through the log queue from the bus thread, see Realtime.h
+#define LOG(a) RealtimeLog("%s: %s\n", __FUNCTION__, (a))
+
+#define MAX_BUS_LINES (32)
+
+enum class LineDirection
+{
+	None,
+	Input,
+	Output,
+	HiZ,
+	
+	// pulled up like HiZ, and watched for edges with WaitForEdge
+	Edges
+};
+
+// how often the default WaitForEdge looks at the lines
+#define EDGE_POLL_US (1000)
+
+// Whatever actually moves the pins: libgpiod, the SoC's GPIO registers, or a simulation.
+// Lines are identified by their BCM GPIO number, so any bus (or any set of buses) fits in one
+// 32 bit mask and a byte on a bus is just a pattern of levels within that mask.
+class GPIOBackend
+{
+public:
+	virtual ~GPIOBackend() {}
+	
+	virtual bool Open() = 0;
+	virtual void Close() = 0;
+	
+	// The first Configure of a bus claims its lines, later ones change them in place.
+	// levels is only used for Output, where the lines come up already driven to it.
+	virtual bool Configure(uint32_t lineMask, LineDirection direction, uint32_t levels) = 0;
+	virtual void Release(uint32_t lineMask) = 0;
+	
+	virtual void Write(uint32_t lineMask, uint32_t levels) = 0;
+	
+	// Lines that can't be read come back high.
+	virtual uint32_t Read(uint32_t lineMask) = 0;
+	
+	// Waits up to timeoutUs for lines configured as Edges to change from levels, and returns false if
+	// they didn't. Any edge counts, even one that's been undone by the time the caller reads the lines
+	// again. Without anything better from the backend this polls Read every EDGE_POLL_US.
+	virtual bool WaitForEdge(uint32_t lineMask, uint32_t levels, uint32_t timeoutUs)
+	{
+		for(uint32_t waitedUs = 0; waitedUs < timeoutUs; waitedUs += EDGE_POLL_US)
+		{
+			usleep(EDGE_POLL_US);
+			if(Read(lineMask) != (levels & lineMask))
+			{
+				return true;
+			}
+		}
+		
+		return false;
+	}
+	
+	// failed configures, reads and writes so far, so a caller can tell an operation went bad
+	uint32_t GetNumErrors() const
+	{
+		return mNumErrors;
+	}
+	
+	// trips into the kernel so far (ioctls for gpiod), to see what a byte really costs
+	uint64_t GetNumKernelCalls() const
+	{
+		return mNumKernelCalls;
+	}
+	
+protected:
+	uint32_t mNumErrors = 0;
+	uint64_t mNumKernelCalls = 0;
+};
+
+// A group of lines that is always driven or read together, so the backend can move the
+// whole bus at once instead of one pin at a time.
+class GPIOBus
+{
+public:
+	void Create(GPIOBackend* pBackend, const uint8_t* pGPIOVals, uint32_t numLines)
+	{
+		if(!pBackend)
+		{
+			LOG("Invalid backend passed.");
+			return;
+		}
+		
+		if(numLines > MAX_BUS_LINES)
+		{
+			LOG("Too many lines for one bus.");
+			return;
+		}
+		
+		mpBackend = pBackend;
+		mNumLines = numLines;
+		mLineMask = 0;
+		
+		for(uint32_t i = 0; i < numLines; i++)
+		{
+			mGPIOLineNums[i] = pGPIOVals[i];
+			mLineMask |= (0x1u << pGPIOVals[i]);
+		}
+	}
+	
+	void HiZ()
+	{
+		if(mDirection != LineDirection::HiZ)
+		{
+			Configure(LineDirection::HiZ, 0);
+		}
+	}
+	
+	// levels is already in GPIO terms, see PinEncoder
+	void Write(uint32_t levels)
+	{
+		// configuring the lines as outputs already drives them to levels
+		if(mDirection != LineDirection::Output)
+		{
+			Configure(LineDirection::Output, levels);
+			return;
+		}
+		
+		mpBackend->Write(mLineMask, levels);
+	}
+	
+	uint32_t Read()
+	{
+		// HiZ is already an input, so reading straight after a HiZ doesn't need to touch the lines.
+		// Neither does reading lines being watched for edges.
+		if(mDirection != LineDirection::Input && mDirection != LineDirection::HiZ && mDirection != LineDirection::Edges)
+		{
+			Configure(LineDirection::Input, 0);
+		}
+		
+		return mpBackend->Read(mLineMask);
+	}
+	
+	// Starts watching the lines for edges, after which Read leaves them be. Read them once watching
+	// to get the levels to wait on, so an edge in between isn't missed.
+	void WatchEdges()
+	{
+		if(mDirection != LineDirection::Edges)
+		{
+			Configure(LineDirection::Edges, 0);
+		}
+	}
+	
+	// see GPIOBackend::WaitForEdge
+	bool WaitForEdge(uint32_t levels, uint32_t timeoutUs)
+	{
+		WatchEdges();
+		return mpBackend->WaitForEdge(mLineMask, levels, timeoutUs);
+	}
+	
+	GPIOBackend* GetBackend() const
+	{
+		return mpBackend;
+	}
+	
+	void Release()
+	{
+		if(mDirection != LineDirection::None)
+		{
+			mpBackend->Release(mLineMask);
+			mDirection = LineDirection::None;
+		}
+	}
+	
+	// How many times each line has been switched to a new config after it was first claimed.
+	void PrintStats(const char* pBusName)
+	{
+		for(uint32_t i = 0; i < mNumLines; i++)
+		{
+			printf("%s line %d (gpio %d): %d reconfigs\n", pBusName, i, mGPIOLineNums[i], mReconfigCounts[i]);
+		}
+	}
+	
+	~GPIOBus()
+	{
+		Release();
+		
+		mpBackend = nullptr;
+	}
+	
+private:
+	void Configure(LineDirection direction, uint32_t levels)
+	{
+		if(!mpBackend)
+		{
+			LOG("Backend invalid");
+			return;
+		}
+		
+		if(!mpBackend->Configure(mLineMask, direction, levels))
+		{
+			LOG("Failed to configure bus.");
+			return;
+		}
+		
+		if(mDirection != LineDirection::None)
+		{
+			for(uint32_t i = 0; i < mNumLines; i++)
+			{
+				mReconfigCounts[i]++;
+			}
+		}
+		
+		mDirection = direction;
+	}
+	
+private:
+	uint32_t mNumLines = 0;
+	uint8_t mGPIOLineNums[MAX_BUS_LINES];
+	uint32_t mLineMask = 0;
+	uint32_t mReconfigCounts[MAX_BUS_LINES] = {0};
+	GPIOBackend* mpBackend = nullptr;
+	
+	LineDirection mDirection = LineDirection::None;
+};
+
+template<typename Pins>
+class GPIOLineArray
+{
+public:
+	~GPIOLineArray()
+	{
+		Release();
+	}
+	
+	void Create(GPIOBackend* pBackend)
+	{
+		if(!pBackend)
+		{
+			LOG("Invalid backend passed!");
+			return;
+		}
+		
+		mBus.Create(pBackend, Pins::kLines, Pins::kNumLines);
+	}
+	
+	void Release()
+	{
+		mBus.Release();
+	}
+	
+	void HiZ()
+	{
+		mBus.HiZ();
+	}
+	
+	void Write(uint32_t value)
+	{
+		mBus.Write(PinEncoder<Pins>::ToLevels(value));
+	}
+	
+	uint8_t Read()
+	{
+		return PinEncoder<Pins>::FromLevels(mBus.Read());
+	}
+	
+	void WatchEdges()
+	{
+		mBus.WatchEdges();
+	}
+	
+	// Waits for the lines to change from value, see GPIOBackend::WaitForEdge
+	bool WaitForEdge(uint32_t value, uint32_t timeoutUs)
+	{
+		return mBus.WaitForEdge(PinEncoder<Pins>::ToLevels(value), timeoutUs);
+	}
+	
+	GPIOBackend* GetBackend() const
+	{
+		return mBus.GetBackend();
+	}
+	
+	void PrintStats(const char* pName)
+	{
+		mBus.PrintStats(pName);
+	}
+	
+private:
+	GPIOBus mBus;
+};
+
+template<typename Pins, typename LatchPin, typename BankPins, typename BankLatchPin>
+class GPIOAddressArray
+{
+public:
+	~GPIOAddressArray()
+	{
+		Release();
+	}
+	
+	// Set before Create to put the address out through 74HC595s instead, in which case none of the
+	// address or latch lines get touched.
+	void SetShifter(AddressShifter* pShifter)
+	{
+		mpShifter = pShifter;
+	}
+	
+	AddressShifter* GetShifter() const
+	{
+		return mpShifter;
+	}
+	
+	void Create(GPIOBackend* pBackend)
+	{
+		if(!pBackend)
+		{
+			LOG("Invalid backend passed!");
+			return;
+		}
+		
+		if(mpShifter)
+		{
+			return;
+		}
+		
+		mLines.Create(pBackend, Pins::kLines, Pins::kNumLines);
+		mBankLines.Create(pBackend, BankPins::kLines, BankPins::kNumLines);
+		
+		// the latches stay outputs while the address lines go HiZ, so they need their own buses
+		mLatch.Create(pBackend, LatchPin::kLines, 1);
+		mBankLatch.Create(pBackend, BankLatchPin::kLines, 1);
+	}
+	
+	void Release()
+	{
+		mBankLatch.Release();
+		mLatch.Release();
+		mBankLines.Release();
+		mLines.Release();
+		
+		mAddressValid = false;
+	}
+	
+	void PrintStats()
+	{
+		if(mpShifter)
+		{
+			printf("Shifter: %d addresses shifted, %d skipped\n", mpShifter->GetNumShifts(), mLatchStats[0].mSkipped);
+			return;
+		}
+		
+		mLines.PrintStats("Address");
+		mLatch.PrintStats("Latch");
+		mBankLines.PrintStats("Bank");
+		mBankLatch.PrintStats("BankLatch");
+		
+		printf("Latch: %d performed, %d skipped\n", mLatchStats[0].mPerformed, mLatchStats[0].mSkipped);
+		printf("BankLatch: %d performed, %d skipped\n", mLatchStats[1].mPerformed, mLatchStats[1].mSkipped);
+	}
+	
+	uint32_t GetLatchesPerformed(bool bank) const
+	{
+		return mLatchStats[bank ? 1 : 0].mPerformed;
+	}
+	
+	uint32_t GetLatchesSkipped(bool bank) const
+	{
+		return mLatchStats[bank ? 1 : 0].mSkipped;
+	}
+	
+	void HiZ()
+	{
+		mAddressValid = false;
+		
+		if(mpShifter)
+		{
+			mpShifter->Clear();
+			return;
+		}
+		
+		// prepare the latch 
+		mLatch.Write(LatchPin::Mask());
+		DelayNs(gBusTimings.mLatchNs);
+		
+		mLines.HiZ();
+		
+		// prepare the latch 
+		mLatch.Write(0);
+		DelayNs(gBusTimings.mLatchNs);
+		
+		// prepare the latch 
+		mBankLatch.Write(BankLatchPin::Mask());
+		DelayNs(gBusTimings.mLatchNs);
+		
+		mBankLines.HiZ();
+		
+		// prepare the latch 
+		mBankLatch.Write(0);
+		DelayNs(gBusTimings.mLatchNs);
+	}
+	
+	// Only re-latches what actually changed since the last address. The lines are shared between
+	// the latched half and the directly driven half, so latching a new low byte (or bank nibble)
+	// always means putting the high one back afterwards, but an unchanged half is left alone.
+	// In a linear sweep that makes the bank phase happen once per bank instead of once per byte.
+	void SetAddress(uint32_t value)
+	{
+		uint8_t lowVals = value & 0x00FF;
+		uint8_t highVals = (value & 0xFF00) >> 8;
+		uint8_t bankVals = (value & 0xFF0000) >> 16;
+		
+		//printf("requesting address: %d, low: %d, high: %d\n", value, lowVals, highVals);
+		
+		if(mpShifter)
+		{
+			SetShiftedAddress(value);
+			return;
+		}
+		
+		// SET ADDRESS LINES
+		if(!mAddressValid || lowVals != mLastLowVals)
+		{
+			// prepare the latch 
+			mLatch.Write(LatchPin::Mask());
+			DelayNs(gBusTimings.mLatchNs);
+			
+			// set the low values
+			mLines.Write(PinEncoder<Pins>::ToLevels(lowVals));
+			
+			// set the latch 
+			mLatch.Write(0);
+			DelayNs(gBusTimings.mLatchNs);
+			
+			// set the high values
+			mLines.Write(PinEncoder<Pins>::ToLevels(highVals));
+			
+			mLatchStats[0].mPerformed++;
+		}
+		else
+		{
+			if(highVals != mLastHighVals)
+			{
+				mLines.Write(PinEncoder<Pins>::ToLevels(highVals));
+			}
+			
+			mLatchStats[0].mSkipped++;
+		}
+		
+		
+		// SET BANK LINES
+		uint8_t lowBankVals = bankVals & 0xF;
+		uint8_t highBankVals = (bankVals & 0xF0) >> 4;
+		
+		if(!mAddressValid || lowBankVals != (mLastBankVals & 0xF))
+		{
+			// prepare the bank latch 
+			mBankLatch.Write(BankLatchPin::Mask());
+			DelayNs(gBusTimings.mLatchNs);
+			
+			// set the low values
+			mBankLines.Write(PinEncoder<BankPins>::ToLevels(lowBankVals));
+			
+			// set the latch
+			mBankLatch.Write(0);
+			DelayNs(gBusTimings.mLatchNs);
+			
+			// set the high values 
+			mBankLines.Write(PinEncoder<BankPins>::ToLevels(highBankVals));
+			
+			mLatchStats[1].mPerformed++;
+		}
+		else
+		{
+			if(highBankVals != (mLastBankVals >> 4))
+			{
+				mBankLines.Write(PinEncoder<BankPins>::ToLevels(highBankVals));
+			}
+			
+			mLatchStats[1].mSkipped++;
+		}
+		
+		mLastLowVals = lowVals;
+		mLastHighVals = highVals;
+		mLastBankVals = bankVals;
+		mAddressValid = true;
+	}
+	
+private:
+	// The 595s take the whole address at once, so it's all or nothing
+	void SetShiftedAddress(uint32_t value)
+	{
+		if(mAddressValid && value == (uint32_t)((mLastBankVals << 16) | (mLastHighVals << 8) | mLastLowVals))
+		{
+			mLatchStats[0].mSkipped++;
+			return;
+		}
+		
+		mpShifter->SetAddress(value);
+		
+		mLastLowVals = value & 0x00FF;
+		mLastHighVals = (value & 0xFF00) >> 8;
+		mLastBankVals = (value & 0xFF0000) >> 16;
+		mAddressValid = true;
+		mLatchStats[0].mPerformed++;
+	}
+	
+public:
+	// For when something else (a BusProgram) has driven the lines straight through the backend:
+	// the last address it left latched, and how many low byte latches it took to get there.
+	void NoteAddress(uint32_t value, uint32_t numLatches)
+	{
+		mLastLowVals = value & 0x00FF;
+		mLastHighVals = (value & 0xFF00) >> 8;
+		mLastBankVals = (value & 0xFF0000) >> 16;
+		mAddressValid = true;
+		
+		mLatchStats[0].mPerformed += numLatches;
+		mLatchStats[1].mSkipped += numLatches;
+	}
+	
+private:
+	GPIOBus mLines;
+	GPIOBus mBankLines;
+	GPIOBus mLatch;
+	GPIOBus mBankLatch;
+	
+	AddressShifter* mpShifter = nullptr;
+	
+	// what the latches and lines were last left holding, valid until they're HiZ'd or released
+	bool mAddressValid = false;
+	uint8_t mLastLowVals = 0;
+	uint8_t mLastHighVals = 0;
+	uint8_t mLastBankVals = 0;
+	
+	struct LatchStats
+	{
+		uint32_t mPerformed = 0;
+		uint32_t mSkipped = 0;
+	};
+	
+	// [0] is the address latch, [1] the bank latch
+	LatchStats mLatchStats[2];
+};
+
@@ -0,0 +1,462 @@
+#include "MMIOBackend.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <sys/mman.h>
+
+#include "SimCart.h"
+
+// BCM2835/BCM2711 GPIO block, as word offsets into /dev/gpiomem
+#define BCM_GPFSEL0 (0x00 / 4)
+#define BCM_GPSET0 (0x1C / 4)
+#define BCM_GPCLR0 (0x28 / 4)
+#define BCM_GPLEV0 (0x34 / 4)
+#define BCM2835_GPPUD (0x94 / 4)
+#define BCM2835_GPPUDCLK0 (0x98 / 4)
+#define BCM2711_PUP_PDN_CNTRL0 (0xE4 / 4)
+#define BCM_MAP_SIZE (4096)
+
+// RP1 io_bank0, sys_rio0 and pads_bank0, as word offsets into /dev/gpiomem0
+#define RP1_IO_CTRL(pin) ((0x0004 + (pin) * 8) / 4)
+#define RP1_RIO_OUT ((0x10000 + 0x00) / 4)
+#define RP1_RIO_OE ((0x10000 + 0x04) / 4)
+#define RP1_RIO_SYNC_IN ((0x10000 + 0x0C) / 4)
+#define RP1_XOR (0x1000 / 4)
+#define RP1_SET (0x2000 / 4)
+#define RP1_CLR (0x3000 / 4)
+#define RP1_PADS(pin) ((0x20000 + 0x4 + (pin) * 4) / 4)
+#define RP1_MAP_SIZE (0x30000)
+
+#define RP1_FUNCSEL_SYS_RIO (5)
+#define RP1_PAD_IE (0x1 << 6)
+#define RP1_PAD_DRIVE_4MA (0x1 << 4)
+#define RP1_PAD_PUE (0x1 << 3)
+#define RP1_PAD_PDE (0x1 << 2)
+#define RP1_PAD_SCHMITT (0x1 << 1)
+
+MMIOBackend::MMIOBackend(SoC soc) : mSoC(soc)
+{
+}
+
+MMIOBackend::MMIOBackend(SimCart* pSimCart, SoC soc) : mSoC(soc), mpSimCart(pSimCart)
+{
+}
+
+MMIOBackend::~MMIOBackend()
+{
+	Close();
+}
+
+bool MMIOBackend::Open()
+{
+	if(mpSimCart)
+	{
+		if(mSoC == SoC::Detect)
+		{
+			mSoC = SoC::BCM2711;
+		}
+		
+		mMapSize = (mSoC == SoC::RP1) ? RP1_MAP_SIZE : BCM_MAP_SIZE;
+		
+		void* pMap = mmap(nullptr, mMapSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+		if(pMap == MAP_FAILED)
+		{
+			LOG("Failed to map fake registers.");
+			return false;
+		}
+		
+		mpRegs = (volatile uint32_t*)pMap;
+		UpdateFakeRegisters();
+		return true;
+	}
+	
+	if(mSoC == SoC::Detect)
+	{
+		mSoC = DetectSoC();
+	}
+	
+	const char* pDevice = (mSoC == SoC::RP1) ? "/dev/gpiomem0" : "/dev/gpiomem";
+	mMapSize = (mSoC == SoC::RP1) ? RP1_MAP_SIZE : BCM_MAP_SIZE;
+	
+	int fd = open(pDevice, O_RDWR | O_SYNC);
+	if(fd == -1)
+	{
+		printf("Failed to open '%s'\n", pDevice);
+		return false;
+	}
+	
+	void* pMap = mmap(nullptr, mMapSize, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	close(fd);
+	
+	if(pMap == MAP_FAILED)
+	{
+		printf("Failed to map '%s'\n", pDevice);
+		return false;
+	}
+	
+	mpRegs = (volatile uint32_t*)pMap;
+	
+	if(mSoC == SoC::RP1)
+	{
+		mRIOOut = mpRegs[RP1_RIO_OUT];
+	}
+	
+	return true;
+}
+
+void MMIOBackend::Close()
+{
+	if(mpRegs)
+	{
+		// leave everything we touched as an input, same as releasing a gpiod request
+		Release(mClaimedMask);
+		
+		munmap((void*)mpRegs, mMapSize);
+		mpRegs = nullptr;
+	}
+	
+	mClaimedMask = 0;
+}
+
+bool MMIOBackend::Configure(uint32_t lineMask, LineDirection direction, uint32_t levels)
+{
+	if(!mpRegs)
+	{
+		LOG("Registers not mapped.");
+		return false;
+	}
+	
+	if(direction == LineDirection::None)
+	{
+		LOG("Invalid direction.");
+		return false;
+	}
+	
+	// no interrupts through /dev/gpiomem, so a line watched for edges is a pulled up input that
+	// the default WaitForEdge polls
+	if(direction == LineDirection::Edges)
+	{
+		direction = LineDirection::HiZ;
+	}
+	
+	if(mSoC == SoC::RP1)
+	{
+		ConfigureRP1(lineMask, direction, levels);
+	}
+	else
+	{
+		ConfigureBCM(lineMask, direction, levels);
+	}
+	
+	mClaimedMask |= lineMask;
+	
+	if(mpSimCart)
+	{
+		UpdateFakeRegisters();
+	}
+	
+	return true;
+}
+
+void MMIOBackend::Release(uint32_t lineMask)
+{
+	lineMask &= mClaimedMask;
+	if(!lineMask || !mpRegs)
+	{
+		return;
+	}
+	
+	if(mSoC == SoC::RP1)
+	{
+		mpRegs[RP1_RIO_OE + RP1_CLR] = lineMask;
+	}
+	else
+	{
+		ConfigureBCM(lineMask, LineDirection::Input, 0);
+	}
+	
+	mOutputMask &= ~lineMask;
+	mClaimedMask &= ~lineMask;
+	
+	if(mpSimCart)
+	{
+		UpdateFakeRegisters();
+	}
+}
+
+void MMIOBackend::Write(uint32_t lineMask, uint32_t levels)
+{
+	if(mSoC == SoC::RP1)
+	{
+		// flip just the bits that differ, in one store
+		mpRegs[RP1_RIO_OUT + RP1_XOR] = (mRIOOut ^ levels) & lineMask;
+		mRIOOut = (mRIOOut & ~lineMask) | (levels & lineMask);
+	}
+	else
+	{
+		mpRegs[BCM_GPSET0] = levels & lineMask;
+		mpRegs[BCM_GPCLR0] = ~levels & lineMask;
+	}
+	
+	if(mpSimCart)
+	{
+		UpdateFakeRegisters();
+	}
+}
+
+uint32_t MMIOBackend::Read(uint32_t lineMask)
+{
+	if(mpSimCart)
+	{
+		if(mpSimCart->IsStale())
+		{
+			UpdateFakeRegisters();
+		}
+		
+		mpSimCart->OnRead(lineMask);
+	}
+	
+	if(mSoC == SoC::RP1)
+	{
+		return mpRegs[RP1_RIO_SYNC_IN] & lineMask;
+	}
+	
+	return mpRegs[BCM_GPLEV0] & lineMask;
+}
+
+MMIOBackend::SoC MMIOBackend::DetectSoC()
+{
+	char compatible[256] = { 0 };
+	
+	FILE* pFile = fopen("/proc/device-tree/compatible", "rb");
+	if(pFile)
+	{
+		size_t size = fread(compatible, 1, sizeof(compatible) - 1, pFile);
+		fclose(pFile);
+		pFile = NULL;
+		
+		// it's a list of nul separated strings
+		for(size_t i = 0; i < size; i++)
+		{
+			if(compatible[i] == 0)
+			{
+				compatible[i] = ' ';
+			}
+		}
+	}
+	
+	if(strstr(compatible, "bcm2712"))
+	{
+		return SoC::RP1;
+	}
+	else if(strstr(compatible, "bcm2711"))
+	{
+		return SoC::BCM2711;
+	}
+	
+	return SoC::BCM2835;
+}
+
+void MMIOBackend::ConfigureBCM(uint32_t lineMask, LineDirection direction, uint32_t levels)
+{
+	bool output = (direction == LineDirection::Output);
+	
+	// set the levels first so the lines don't glitch when they turn into outputs
+	if(output)
+	{
+		mpRegs[BCM_GPSET0] = levels & lineMask;
+		mpRegs[BCM_GPCLR0] = ~levels & lineMask;
+	}
+	
+	// 3 function select bits per pin, 10 pins per register. 000 is input, 001 is output.
+	for(uint32_t reg = 0; reg < 3; reg++)
+	{
+		uint32_t clearBits = 0;
+		uint32_t setBits = 0;
+		
+		for(uint32_t pin = reg * 10; pin < reg * 10 + 10 && pin < 32; pin++)
+		{
+			if(lineMask & (0x1u << pin))
+			{
+				clearBits |= 0x7 << ((pin % 10) * 3);
+				setBits |= (output ? 0x1 : 0x0) << ((pin % 10) * 3);
+			}
+		}
+		
+		if(clearBits)
+		{
+			mpRegs[BCM_GPFSEL0 + reg] = (mpRegs[BCM_GPFSEL0 + reg] & ~clearBits) | setBits;
+		}
+	}
+	
+	if(output)
+	{
+		mOutputMask |= lineMask;
+		return;
+	}
+	
+	mOutputMask &= ~lineMask;
+	
+	uint32_t pullUpMask = (direction == LineDirection::HiZ) ? lineMask : 0;
+	uint32_t pullDownMask = (direction == LineDirection::Input) ? lineMask : 0;
+	
+	// pulls only change when switching between HiZ and a plain read, so usually there's nothing to do
+	uint32_t changedMask = ((mPullUpMask & lineMask) ^ pullUpMask) | ((mPullDownMask & lineMask) ^ pullDownMask);
+	if(!changedMask)
+	{
+		return;
+	}
+	
+	if(mSoC == SoC::BCM2711)
+	{
+		// 2 bits per pin, 16 pins per register. 01 is pull up, 10 is pull down.
+		for(uint32_t reg = 0; reg < 2; reg++)
+		{
+			uint32_t clearBits = 0;
+			uint32_t setBits = 0;
+			
+			for(uint32_t pin = reg * 16; pin < reg * 16 + 16; pin++)
+			{
+				if(changedMask & (0x1u << pin))
+				{
+					clearBits |= 0x3 << ((pin % 16) * 2);
+					setBits |= (pullUpMask & (0x1u << pin) ? 0x1 : 0x2) << ((pin % 16) * 2);
+				}
+			}
+			
+			if(clearBits)
+			{
+				mpRegs[BCM2711_PUP_PDN_CNTRL0 + reg] = (mpRegs[BCM2711_PUP_PDN_CNTRL0 + reg] & ~clearBits) | setBits;
+			}
+		}
+	}
+	else
+	{
+		SetPullsBCM2835(changedMask & pullUpMask, 0x2);
+		SetPullsBCM2835(changedMask & pullDownMask, 0x1);
+	}
+	
+	mPullUpMask = (mPullUpMask & ~lineMask) | pullUpMask;
+	mPullDownMask = (mPullDownMask & ~lineMask) | pullDownMask;
+}
+
+// The BCM2835 sets pulls by clocking a control value into the pins, with a 150 cycle wait either side.
+void MMIOBackend::SetPullsBCM2835(uint32_t lineMask, uint32_t pud)
+{
+	if(!lineMask)
+	{
+		return;
+	}
+	
+	mpRegs[BCM2835_GPPUD] = pud;
+	for(volatile uint32_t i = 0; i < 150; i++)
+	{
+	}
+	
+	mpRegs[BCM2835_GPPUDCLK0] = lineMask;
+	for(volatile uint32_t i = 0; i < 150; i++)
+	{
+	}
+	
+	mpRegs[BCM2835_GPPUD] = 0;
+	mpRegs[BCM2835_GPPUDCLK0] = 0;
+}
+
+void MMIOBackend::ConfigureRP1(uint32_t lineMask, LineDirection direction, uint32_t levels)
+{
+	// first time we see a line, hand it to RIO so the registers below actually drive it
+	uint32_t newMask = lineMask & ~mClaimedMask;
+	for(uint32_t pin = 0; pin < 28; pin++)
+	{
+		if(newMask & (0x1u << pin))
+		{
+			mpRegs[RP1_IO_CTRL(pin)] = RP1_FUNCSEL_SYS_RIO;
+		}
+	}
+	
+	if(direction == LineDirection::Output)
+	{
+		mpRegs[RP1_RIO_OUT + RP1_XOR] = (mRIOOut ^ levels) & lineMask;
+		mRIOOut = (mRIOOut & ~lineMask) | (levels & lineMask);
+		
+		mpRegs[RP1_RIO_OE + RP1_SET] = lineMask;
+		mOutputMask |= lineMask;
+		return;
+	}
+	
+	mpRegs[RP1_RIO_OE + RP1_CLR] = lineMask;
+	mOutputMask &= ~lineMask;
+	
+	uint32_t pullUpMask = (direction == LineDirection::HiZ) ? lineMask : 0;
+	uint32_t pullDownMask = (direction == LineDirection::Input) ? lineMask : 0;
+	
+	uint32_t changedMask = ((mPullUpMask & lineMask) ^ pullUpMask) | ((mPullDownMask & lineMask) ^ pullDownMask);
+	changedMask |= newMask;
+	
+	for(uint32_t pin = 0; pin < 28; pin++)
+	{
+		if(changedMask & (0x1u << pin))
+		{
+			uint32_t pad = RP1_PAD_IE | RP1_PAD_DRIVE_4MA | RP1_PAD_SCHMITT;
+			pad |= (pullUpMask & (0x1u << pin)) ? RP1_PAD_PUE : RP1_PAD_PDE;
+			
+			mpRegs[RP1_PADS(pin)] = pad;
+		}
+	}
+	
+	mPullUpMask = (mPullUpMask & ~lineMask) | pullUpMask;
+	mPullDownMask = (mPullDownMask & ~lineMask) | pullDownMask;
+}
+
+// Works out what the pins are doing from what's been stored to the registers, lets the cart
+// respond, then puts the result where a read of the level register will find it. Pulls are
+// taken from what was asked for rather than decoded, since the BCM2835 ones are write only.
+void MMIOBackend::UpdateFakeRegisters()
+{
+	uint32_t outputMask = 0;
+	uint32_t levelReg = 0;
+	
+	if(mSoC == SoC::RP1)
+	{
+		// the atomic aliases are plain memory here, so fold them into the registers by hand
+		uint32_t oe = mpRegs[RP1_RIO_OE];
+		oe = (oe | mpRegs[RP1_RIO_OE + RP1_SET]) & ~mpRegs[RP1_RIO_OE + RP1_CLR];
+		mpRegs[RP1_RIO_OE] = oe;
+		mpRegs[RP1_RIO_OE + RP1_SET] = 0;
+		mpRegs[RP1_RIO_OE + RP1_CLR] = 0;
+		
+		mFakeOut ^= mpRegs[RP1_RIO_OUT + RP1_XOR];
+		mpRegs[RP1_RIO_OUT] = mFakeOut;
+		mpRegs[RP1_RIO_OUT + RP1_XOR] = 0;
+		
+		outputMask = oe;
+		levelReg = RP1_RIO_SYNC_IN;
+	}
+	else
+	{
+		mFakeOut = (mFakeOut | mpRegs[BCM_GPSET0]) & ~mpRegs[BCM_GPCLR0];
+		mpRegs[BCM_GPSET0] = 0;
+		mpRegs[BCM_GPCLR0] = 0;
+		
+		for(uint32_t pin = 0; pin < 30; pin++)
+		{
+			if(((mpRegs[BCM_GPFSEL0 + pin / 10] >> ((pin % 10) * 3)) & 0x7) == 0x1)
+			{
+				outputMask |= 0x1u << pin;
+			}
+		}
+		
+		levelReg = BCM_GPLEV0;
+	}
+	
+	uint32_t levels = (mFakeOut & outputMask) | (mPullUpMask & ~outputMask);
+	
+	uint32_t driveMask = 0;
+	uint32_t cartLevels = mpSimCart->Update(outputMask, levels, driveMask);
+	
+	// the cart only wins on pins the Pi isn't driving
+	driveMask &= ~outputMask;
+	levels = (levels & ~driveMask) | (cartLevels & driveMask);
+	
+	mpRegs[levelReg] = levels;
+}
@@ -0,0 +1,66 @@
+#pragma once
+
+#include <cstddef>
+
+#include "GPIOManager.h"
+
+class SimCart;
+
+// Drives the pins straight through the SoC's GPIO registers, mapped from /dev/gpiomem, so
+// a whole bus is set with a masked register store instead of a trip into the kernel.
+// Covers the BCM2835/BCM2711 register block (Pi 1-4) and RP1's RIO block (Pi 5).
+//
+// Given a SimCart instead, the registers are an anonymous mapping and the cart sees
+// whatever the registers say the pins are doing, so this can run on any Linux host.
+class MMIOBackend final : public GPIOBackend
+{
+public:
+	enum class SoC
+	{
+		Detect,
+		BCM2835,
+		BCM2711,
+		RP1
+	};
+	
+	MMIOBackend(SoC soc = SoC::Detect);
+	MMIOBackend(SimCart* pSimCart, SoC soc = SoC::Detect);
+	~MMIOBackend();
+	
+	bool Open() override;
+	void Close() override;
+	
+	bool Configure(uint32_t lineMask, LineDirection direction, uint32_t levels) override;
+	void Release(uint32_t lineMask) override;
+	
+	void Write(uint32_t lineMask, uint32_t levels) override;
+	uint32_t Read(uint32_t lineMask) override;
+	
+private:
+	SoC DetectSoC();
+	
+	void ConfigureBCM(uint32_t lineMask, LineDirection direction, uint32_t levels);
+	void SetPullsBCM2835(uint32_t lineMask, uint32_t pud);
+	void ConfigureRP1(uint32_t lineMask, LineDirection direction, uint32_t levels);
+	
+	// plays the part of the GPIO block for the fake register file
+	void UpdateFakeRegisters();
+	
+private:
+	SoC mSoC = SoC::Detect;
+	
+	volatile uint32_t* mpRegs = nullptr;
+	size_t mMapSize = 0;
+	
+	// what each line was last configured as, so pulls are only touched when they change
+	uint32_t mOutputMask = 0;
+	uint32_t mPullUpMask = 0;
+	uint32_t mPullDownMask = 0;
+	uint32_t mClaimedMask = 0;
+	
+	// RP1 only: RIO_OUT, so a bus can be written with a single store to the XOR alias
+	uint32_t mRIOOut = 0;
+	
+	SimCart* mpSimCart = nullptr;
+	uint32_t mFakeOut = 0;
+};
@@ -0,0 +1,282 @@
+#include "Mapper.h"
+
+#include <stdio.h>
+
+#include "SimCart.h"
+
+uint32_t Mapper::GetRomBatch(uint32_t romOffset, uint32_t length, BusRun* pRuns, uint32_t maxRuns) const
+{
+	return GetBatch(&Mapper::GetRomRun, romOffset, length, pRuns, maxRuns);
+}
+
+uint32_t Mapper::GetSRAMBatch(uint32_t sramOffset, uint32_t length, BusRun* pRuns, uint32_t maxRuns) const
+{
+	return GetBatch(&Mapper::GetSRAMRun, sramOffset, length, pRuns, maxRuns);
+}
+
+uint32_t Mapper::GetBatch(GetRunFunc getRun, uint32_t offset, uint32_t length, BusRun* pRuns, uint32_t maxRuns) const
+{
+	uint32_t numRuns = 0;
+	uint32_t end = offset + length;
+	
+	while(offset < end && numRuns < maxRuns)
+	{
+		BusRun run = (this->*getRun)(offset);
+		if(run.mLength > end - offset)
+		{
+			run.mLength = end - offset;
+		}
+		
+		pRuns[numRuns++] = run;
+		offset += run.mLength;
+	}
+	
+	return numRuns;
+}
+
+// A block of same sized windows, one per bank, starting at mBank.
+struct MapperWindow
+{
+	uint8_t mBank;
+	uint16_t mStart;
+	uint32_t mSize;
+	bool mRomSel;
+	
+	BusRun GetRun(uint32_t offset) const
+	{
+		BusRun run;
+		run.mAddress = ((mBank + (offset / mSize)) << 16) | (mStart + (offset % mSize));
+		run.mLength = mSize - (offset % mSize);
+		run.mRomSel = mRomSel;
+		
+		return run;
+	}
+};
+
+// Every mapping we know is a rom window and an sram window, apart from ExHiROM's split rom.
+// See https://snes.nesdev.org/wiki/Memory_map
+class WindowMapper : public Mapper
+{
+public:
+	WindowMapper(const char* pName, MapperWindow rom, MapperWindow sram) : mpName(pName), mRom(rom), mSRAM(sram)
+	{
+	}
+	
+	const char* GetName() const override
+	{
+		return mpName;
+	}
+	
+	BusRun GetRomRun(uint32_t romOffset) const override
+	{
+		return mRom.GetRun(romOffset);
+	}
+	
+	BusRun GetSRAMRun(uint32_t sramOffset) const override
+	{
+		return mSRAM.GetRun(sramOffset);
+	}
+	
+protected:
+	const char* mpName;
+	MapperWindow mRom;
+	MapperWindow mSRAM;
+};
+
+// The first 4MB is at C0-FF like HiROM, the rest at 40-7D.
+class ExHiROMMapper : public WindowMapper
+{
+public:
+	ExHiROMMapper() : WindowMapper("ExHiROM", { 0xC0, 0x0000, 0x10000, true }, { 0xB0, 0x6000, 0x2000, false })
+	{
+	}
+	
+	BusRun GetRomRun(uint32_t romOffset) const override
+	{
+		if(romOffset < 0x400000)
+		{
+			return mRom.GetRun(romOffset);
+		}
+		
+		MapperWindow upper = { 0x40, 0x0000, 0x10000, true };
+		return upper.GetRun(romOffset - 0x400000);
+	}
+};
+
+// LoROM reads through the 80-FF mirror so A15 is high, the way the SNES itself sees the rom.
+// HiROM sram is decoded at 20-3F or 30-3F depending on the board, 30 works for both.
+// The coprocessor carts are read in their power-on state: the SA-1 and S-DD1 MMCs map the rom linearly
+// at C0-FF, the SuperFX gives the bus to the SNES until the GSU is started.
+static const WindowMapper gLoROMMapper("LoROM", { 0x80, 0x8000, 0x8000, true }, { 0x70, 0x0000, 0x8000, true });
+static const WindowMapper gHiROMMapper("HiROM", { 0xC0, 0x0000, 0x10000, true }, { 0x30, 0x6000, 0x2000, false });
+static const ExHiROMMapper gExHiROMMapper;
+static const WindowMapper gSA1Mapper("SA-1", { 0xC0, 0x0000, 0x10000, true }, { 0x40, 0x0000, 0x10000, true });
+static const WindowMapper gSuperFXMapper("SuperFX", { 0x40, 0x0000, 0x10000, true }, { 0x70, 0x0000, 0x10000, true });
+static const WindowMapper gSDD1Mapper("S-DD1", { 0xC0, 0x0000, 0x10000, true }, { 0x70, 0x0000, 0x8000, true });
+
+const Mapper* GetMapper(RomMapping mapping)
+{
+	switch(mapping)
+	{
+		case RomMapping::HiROM: return &gHiROMMapper;
+		case RomMapping::ExHiROM: return &gExHiROMMapper;
+		case RomMapping::SA1: return &gSA1Mapper;
+		case RomMapping::SuperFX: return &gSuperFXMapper;
+		case RomMapping::SDD1: return &gSDD1Mapper;
+		default: return &gLoROMMapper;
+	}
+}
+
+struct MapperTestCase
+{
+	RomMapping mMapping;
+	uint32_t mRomSize;
+	uint32_t mSRAMSize;
+	
+	// header fields
+	uint32_t mHeaderOffset;
+	uint8_t mMapMode;
+	uint8_t mCartType;
+	uint8_t mRomSizeByte;
+	uint8_t mRamSizeByte;
+};
+
+static const MapperTestCase gMapperTestCases[] =
+{
+	{ RomMapping::LoROM, 0x200000, 0x8000, 0x7FB0, 0x20, 0x02, 0x0B, 0x05 },
+	{ RomMapping::HiROM, 0x400000, 0x2000, 0xFFB0, 0x31, 0x02, 0x0C, 0x03 },
+	{ RomMapping::ExHiROM, 0x600000, 0x2000, 0x40FFB0, 0x35, 0x02, 0x0D, 0x03 },
+	{ RomMapping::SA1, 0x400000, 0x10000, 0x7FB0, 0x23, 0x35, 0x0C, 0x06 },
+	{ RomMapping::SuperFX, 0x200000, 0x10000, 0x7FB0, 0x20, 0x15, 0x0B, 0x06 },
+	{ RomMapping::SDD1, 0x400000, 0x2000, 0x7FB0, 0x32, 0x43, 0x0C, 0x03 },
+};
+
+static SimCart* gpTestCart = nullptr;
+
+static uint8_t ReadTestCart(uint32_t address)
+{
+	uint8_t value = 0xFF;
+	gpTestCart->ReadBus(address, true, value);
+	return value;
+}
+
+static void BuildTestImage(const MapperTestCase& test, uint8_t* pImage)
+{
+	// different everywhere, so a mapper that lands on a mirror or the wrong bank gets caught
+	for(uint32_t i = 0; i < test.mRomSize; i++)
+	{
+		pImage[i] = (uint8_t)((i * 2654435761u) >> 24);
+	}
+	
+	uint8_t* pHeader = &pImage[test.mHeaderOffset];
+	memcpy(&pHeader[HEADER_TITLE], "MAPPER SELF TEST     ", 21);
+	pHeader[HEADER_MAP_MODE] = test.mMapMode;
+	pHeader[HEADER_CART_TYPE] = test.mCartType;
+	pHeader[HEADER_ROM_SIZE] = test.mRomSizeByte;
+	pHeader[HEADER_RAM_SIZE] = (test.mMapping == RomMapping::SuperFX) ? 0 : test.mRamSizeByte;
+	pHeader[HEADER_DEVELOPER_ID] = (test.mMapping == RomMapping::SuperFX) ? 0x33 : 0x01;
+	pHeader[HEADER_EXPANSION_RAM] = (test.mMapping == RomMapping::SuperFX) ? test.mRamSizeByte : 0;
+	pHeader[HEADER_RESET_VECTOR] = 0x00;
+	pHeader[HEADER_RESET_VECTOR + 1] = 0x80;
+	
+	// sei at $8000 of the bank the header was found in, which is the start of the rom for LoROM placement
+	uint32_t resetOffset = (test.mHeaderOffset == 0x7FB0) ? 0 : ((test.mHeaderOffset & ~0xFFFF) | 0x8000);
+	pImage[resetOffset] = 0x78;
+	
+	pHeader[HEADER_CHECKSUM] = 0x00;
+	pHeader[HEADER_CHECKSUM + 1] = 0x00;
+	pHeader[HEADER_COMPLEMENT] = 0xFF;
+	pHeader[HEADER_COMPLEMENT + 1] = 0xFF;
+	
+	uint16_t checksum = 0;
+	for(uint32_t i = 0; i < test.mRomSize; i++)
+	{
+		checksum += pImage[i];
+	}
+	
+	pHeader[HEADER_CHECKSUM] = checksum & 0xFF;
+	pHeader[HEADER_CHECKSUM + 1] = checksum >> 8;
+	pHeader[HEADER_COMPLEMENT] = ~checksum & 0xFF;
+	pHeader[HEADER_COMPLEMENT + 1] = (~checksum >> 8) & 0xFF;
+}
+
+static bool TestMapper(const MapperTestCase& test)
+{
+	const Mapper* pMapper = GetMapper(test.mMapping);
+	
+	SimCart cart;
+	if(!cart.Create(test.mRomSize))
+	{
+		return false;
+	}
+	
+	BuildTestImage(test, cart.GetRom());
+	cart.SetMapping(test.mMapping, test.mSRAMSize);
+	
+	uint32_t numBad = 0;
+	BusRun runs[MAX_BUS_RUNS];
+	
+	for(uint32_t offset = 0; offset < test.mRomSize;)
+	{
+		uint32_t numRuns = pMapper->GetRomBatch(offset, test.mRomSize - offset, runs, MAX_BUS_RUNS);
+		for(uint32_t r = 0; r < numRuns; r++)
+		{
+			for(uint32_t i = 0; i < runs[r].mLength; i++, offset++)
+			{
+				int32_t romOffset = -1;
+				int32_t sramOffset = -1;
+				cart.Decode(runs[r].mAddress + i, runs[r].mRomSel, romOffset, sramOffset);
+				
+				if(romOffset != (int32_t)offset && numBad++ < 8)
+				{
+					printf("  rom offset %06x -> %06x decodes to rom %x, sram %x\n", offset, runs[r].mAddress + i, romOffset, sramOffset);
+				}
+			}
+		}
+	}
+	
+	for(uint32_t offset = 0; offset < test.mSRAMSize;)
+	{
+		uint32_t numRuns = pMapper->GetSRAMBatch(offset, test.mSRAMSize - offset, runs, MAX_BUS_RUNS);
+		for(uint32_t r = 0; r < numRuns; r++)
+		{
+			for(uint32_t i = 0; i < runs[r].mLength; i++, offset++)
+			{
+				int32_t romOffset = -1;
+				int32_t sramOffset = -1;
+				cart.Decode(runs[r].mAddress + i, runs[r].mRomSel, romOffset, sramOffset);
+				
+				if((sramOffset != (int32_t)offset || romOffset != -1) && numBad++ < 8)
+				{
+					printf("  sram offset %06x -> %06x decodes to rom %x, sram %x\n", offset, runs[r].mAddress + i, romOffset, sramOffset);
+				}
+			}
+		}
+	}
+	
+	gpTestCart = &cart;
+	RomInfo romInfo;
+	bool probed = ProbeRomInfo(ReadTestCart, &romInfo);
+	gpTestCart = nullptr;
+	
+	if(!probed || romInfo.mMapping != test.mMapping || romInfo.mSRAMSize != test.mSRAMSize || romInfo.mRomSize != (1024u << test.mRomSizeByte))
+	{
+		printf("  probe found %s, %d rom, %d sram\n", GetMappingName(romInfo.mMapping), romInfo.mRomSize, romInfo.mSRAMSize);
+		numBad++;
+	}
+	
+	printf("%-8s %s (%d errors)\n", pMapper->GetName(), numBad ? "FAILED" : "ok", numBad);
+	return numBad == 0;
+}
+
+bool RunMapperSelfTest()
+{
+	bool passed = true;
+	for(uint32_t i = 0; i < sizeof(gMapperTestCases) / sizeof(gMapperTestCases[0]); i++)
+	{
+		passed &= TestMapper(gMapperTestCases[i]);
+	}
+	
+	printf("Mapper self test %s\n", passed ? "passed" : "FAILED");
+	return passed;
+}
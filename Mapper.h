@@ -0,0 +1,49 @@
+#pragma once
+
+#include <cstdint>
+
+#include "RomManager.h"
+
+// A run of consecutive bus addresses that all hit the same window, so reading it in order only ever
+// changes the low address byte between bytes (see GPIOAddressArray::SetAddress) and re-latches the
+// high byte every 256.
+struct BusRun
+{
+	uint32_t mAddress;
+	uint32_t mLength;
+	
+	// whether /ROMSEL is asserted for this run. Carts decode their own /CS lines (rom, sram,
+	// coprocessor registers) from the address and /ROMSEL, so this is all we have to drive.
+	bool mRomSel;
+};
+
+#define MAX_BUS_RUNS (64)
+
+// Where a cart's rom and sram show up on the bus. Linear rom/sram offsets go in, bus addresses come out.
+class Mapper
+{
+public:
+	virtual ~Mapper() {}
+	
+	virtual const char* GetName() const = 0;
+	
+	// The run that starts at romOffset and goes to the end of its window.
+	virtual BusRun GetRomRun(uint32_t romOffset) const = 0;
+	virtual BusRun GetSRAMRun(uint32_t sramOffset) const = 0;
+	
+	// Fills pRuns with the runs covering length bytes from offset, in offset order.
+	// Returns the number of runs, which stops at maxRuns, so call again from where it stopped.
+	uint32_t GetRomBatch(uint32_t romOffset, uint32_t length, BusRun* pRuns, uint32_t maxRuns) const;
+	uint32_t GetSRAMBatch(uint32_t sramOffset, uint32_t length, BusRun* pRuns, uint32_t maxRuns) const;
+	
+private:
+	typedef BusRun (Mapper::*GetRunFunc)(uint32_t offset) const;
+	uint32_t GetBatch(GetRunFunc getRun, uint32_t offset, uint32_t length, BusRun* pRuns, uint32_t maxRuns) const;
+};
+
+// Returns the mapper for a mapping, LoROM for Unknown. These are shared, don't delete them.
+const Mapper* GetMapper(RomMapping mapping);
+
+// Checks every mapper against a SimCart holding a synthetic image of that mapping: every rom and sram
+// offset has to land where the cart decodes it, and the header probe has to find it.
+bool RunMapperSelfTest();
@@ -0,0 +1,102 @@
+#include "MirrorDetector.h"
+
+#include <stdio.h>
+
+#define FNV_OFFSET_BASIS (0xCBF29CE484222325ull)
+#define FNV_PRIME (0x100000001B3ull)
+
+static bool IsPowerOfTwo(uint32_t size)
+{
+	return size && (size & (size - 1)) == 0;
+}
+
+void MirrorDetector::Reset()
+{
+	mNumBlocks = 0;
+	mPartialHash = FNV_OFFSET_BASIS;
+	mPartialSize = 0;
+}
+
+// FNV-1a per block
+void MirrorDetector::Add(const uint8_t* pData, uint32_t size)
+{
+	if(mPartialSize == 0)
+	{
+		mPartialHash = FNV_OFFSET_BASIS;
+	}
+	
+	for(uint32_t i = 0; i < size && mNumBlocks < MAX_MIRROR_BLOCKS; i++)
+	{
+		mPartialHash ^= pData[i];
+		mPartialHash *= FNV_PRIME;
+		
+		if(++mPartialSize == MIN_MIRROR_SIZE)
+		{
+			mBlockHashes[mNumBlocks++] = mPartialHash;
+			mPartialHash = FNV_OFFSET_BASIS;
+			mPartialSize = 0;
+		}
+	}
+}
+
+// Whether [baseOffset + size / 2, baseOffset + size) repeats [baseOffset, baseOffset + size / 2).
+bool MirrorDetector::IsRegionMirrored(uint32_t baseOffset, uint32_t size) const
+{
+	if(size < MIN_MIRROR_SIZE * 2 || !IsPowerOfTwo(size))
+	{
+		return false;
+	}
+	
+	uint32_t firstBlock = baseOffset / MIN_MIRROR_SIZE;
+	uint32_t halfBlocks = (size / 2) / MIN_MIRROR_SIZE;
+	if(firstBlock + (halfBlocks * 2) > mNumBlocks)
+	{
+		return false;
+	}
+	
+	for(uint32_t i = 0; i < halfBlocks; i++)
+	{
+		if(mBlockHashes[firstBlock + i] != mBlockHashes[firstBlock + halfBlocks + i])
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+bool MirrorDetector::IsUpperHalfMirrored(uint32_t size) const
+{
+	return IsRegionMirrored(0, size);
+}
+
+// Halves size for as long as the upper half repeats the lower one.
+uint32_t MirrorDetector::StripMirrors(uint32_t baseOffset, uint32_t size) const
+{
+	while(IsRegionMirrored(baseOffset, size))
+	{
+		size /= 2;
+		printf("Mirror: %06X-%06X repeats %06X-%06X\n", baseOffset + size, baseOffset + (size * 2) - 1, baseOffset, baseOffset + size - 1);
+	}
+	
+	return size;
+}
+
+uint32_t MirrorDetector::FindRomSize(uint32_t size) const
+{
+	uint32_t romSize = StripMirrors(0, size);
+	
+	// no whole copies, but the upper half may be a smaller second chip mirrored to fill it
+	if(romSize == size && IsPowerOfTwo(size) && size >= MIN_MIRROR_SIZE * 4)
+	{
+		uint32_t half = size / 2;
+		romSize = half + StripMirrors(half, half);
+	}
+	
+	if(romSize != size)
+	{
+		printf("Mirror: rom is %dKB, not the %dKB read\n", romSize / 1024, size / 1024);
+	}
+	
+	return romSize;
+}
@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+// Carts only decode as many address lines as their rom needs, so past the end of the rom the bus
+// sees the rom again. This spots that in a dump so it can stop reading copies and be trimmed.
+//
+// The dump streams to disk as it's read, so rather than keep it all around this hashes each
+// MIN_MIRROR_SIZE block once as it comes in and compares regions by their block hashes.
+
+// Smallest region compared. Anything smaller is too likely to repeat for real.
+#define MIN_MIRROR_SIZE (0x8000)
+
+// Most rom it keeps hashes for, past this it just stops looking
+#define MAX_MIRROR_ROM_SIZE (16 * 1024 * 1024)
+#define MAX_MIRROR_BLOCKS (MAX_MIRROR_ROM_SIZE / MIN_MIRROR_SIZE)
+
+class MirrorDetector
+{
+public:
+	void Reset();
+	
+	// Takes the next size bytes of the dump. Only the very last call may leave a partial block.
+	void Add(const uint8_t* pData, uint32_t size);
+	
+	// Whether the upper half of the first size bytes is a copy of the lower half, in which case the rom
+	// is at most size / 2. Cheap enough to call at every power of two while dumping.
+	bool IsUpperHalfMirrored(uint32_t size) const;
+	
+	// The real size of a dump of size bytes, with trailing mirrors removed: whole copies of the lower half,
+	// and a smaller chip repeated to fill the upper half (a 3MB rom reads as 2MB + 1MB + the 1MB again).
+	// Logs what it finds.
+	uint32_t FindRomSize(uint32_t size) const;
+	
+private:
+	bool IsRegionMirrored(uint32_t baseOffset, uint32_t size) const;
+	uint32_t StripMirrors(uint32_t baseOffset, uint32_t size) const;
+	
+private:
+	uint64_t mBlockHashes[MAX_MIRROR_BLOCKS];
+	uint32_t mNumBlocks = 0;
+	
+	// the block being filled, when Add doesn't get whole ones
+	uint64_t mPartialHash = 0;
+	uint32_t mPartialSize = 0;
+};
@@ -0,0 +1,124 @@
+#pragma once
+
+#include <cstdint>
+
+// A fixed set of Pi GPIOs making up one bus, line i of the bus being the i-th GPIO listed.
+// Everything here is constexpr, so translating a value to pin levels and back costs nothing
+// more than the shifts and ors the compiler folds it down to.
+template<uint8_t... Lines>
+struct PinList
+{
+	static constexpr uint32_t kNumLines = sizeof...(Lines);
+	static constexpr uint8_t kLines[kNumLines] = { Lines... };
+	
+	static constexpr uint32_t Mask()
+	{
+		uint32_t mask = 0;
+		for(uint32_t i = 0; i < kNumLines; i++)
+		{
+			mask |= 0x1u << kLines[i];
+		}
+		
+		return mask;
+	}
+	
+	// bit i of value goes to the level of line i
+	static constexpr uint32_t ToLevels(uint32_t value)
+	{
+		uint32_t levels = 0;
+		for(uint32_t i = 0; i < kNumLines; i++)
+		{
+			levels |= ((value >> i) & 0x1) << kLines[i];
+		}
+		
+		return levels;
+	}
+	
+	static constexpr uint32_t FromLevels(uint32_t levels)
+	{
+		uint32_t value = 0;
+		for(uint32_t i = 0; i < kNumLines; i++)
+		{
+			value |= ((levels >> kLines[i]) & 0x1) << i;
+		}
+		
+		return value;
+	}
+};
+
+template<uint8_t... Lines>
+constexpr uint8_t PinList<Lines...>::kLines[];
+
+// Pin levels for every value a bus can hold, and the value for every pattern of levels a
+// byte of the GPIO register can hold, worked out at compile time. Putting a value on the bus
+// is then a single table load, and pulling one off it is four loads and three ors.
+template<typename Pins>
+struct PinEncoder
+{
+	static_assert(Pins::kNumLines <= 8, "PinEncoder only handles buses up to 8 lines wide");
+	
+	static constexpr uint32_t kNumValues = 0x1 << Pins::kNumLines;
+	
+	struct Table
+	{
+		constexpr Table() : mLevels(), mValues()
+		{
+			for(uint32_t i = 0; i < kNumValues; i++)
+			{
+				mLevels[i] = Pins::ToLevels(i);
+			}
+			
+			for(uint32_t byte = 0; byte < 4; byte++)
+			{
+				for(uint32_t i = 0; i < 256; i++)
+				{
+					mValues[byte][i] = Pins::FromLevels(i << (byte * 8));
+				}
+			}
+		}
+		
+		uint32_t mLevels[kNumValues];
+		uint8_t mValues[4][256];
+	};
+	
+	static constexpr Table kTable = Table();
+	
+	static uint32_t ToLevels(uint8_t value)
+	{
+		return kTable.mLevels[value & (kNumValues - 1)];
+	}
+	
+	static uint8_t FromLevels(uint32_t levels)
+	{
+		return kTable.mValues[0][levels & 0xFF] | kTable.mValues[1][(levels >> 8) & 0xFF] |
+			kTable.mValues[2][(levels >> 16) & 0xFF] | kTable.mValues[3][(levels >> 24) & 0xFF];
+	}
+};
+
+template<typename Pins>
+constexpr typename PinEncoder<Pins>::Table PinEncoder<Pins>::kTable;
+
+// Which Pi GPIO is wired to which cart signal. See gpio-mapping.txt.
+// Shared by the bus code and the simulated cart so both sides agree on the wiring.
+
+// Controls address lines A0 - A15 with support of a latch and A16-A23 (Bank Addresses BA0-BA7) with another latch.
+// The latch holds A0-A7 (A16-A19 for the bank latch) and the lines themselves drive A8-A15 (A20-A23).
+typedef PinList<2,3,4,17,27,22,10,9> AddressPins;
+typedef PinList<6,13,19,26> BankAddressPins;
+typedef PinList<5> Latch8Thru15Pin;
+typedef PinList<16> Latch16Thru19Pin;
+
+typedef PinList<14,15,18,23,24,25,8,7> DataPins;
+
+// drives /WR directly and /RD through an inverter, so 1 is read and 0 is write
+typedef PinList<12> WritePin;
+
+typedef PinList<21> ResetPin;
+
+// /ROMSEL
+typedef PinList<20> CartEnablePin;
+
+// Optional, for --cart-detect=sense. Wired to one of the slot's ground contacts (pin 36) instead of to ground
+// and pulled up, so it reads high with the slot empty and the cart's ground plane pulls it low.
+// It's SPI0's SCLK, so it can't be used with --address-spi.
+typedef PinList<11> CartSensePin;
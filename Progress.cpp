@@ -0,0 +1,129 @@
+#include "Progress.h"
+
+#include <stdio.h>
+#include <time.h>
+
+#include "BusTiming.h"
+#include "Realtime.h"
+
+ProgressReporter gProgress;
+TraceBuffer gTrace;
+
+void ProgressReporter::Begin(const char* pOperation, uint32_t totalBytes)
+{
+	mpOperation = pOperation;
+	mTotalBytes = totalBytes;
+	mBytesDone.store(0, std::memory_order_relaxed);
+	mStartNs = GetTimeNs();
+	mLastReportNs = mStartNs;
+}
+
+void ProgressReporter::End(uint32_t bytesDone)
+{
+	uint64_t nowNs = GetTimeNs();
+	double seconds = (double)(nowNs - mStartNs) / 1000000000.0;
+	mBytesDone.store(bytesDone, std::memory_order_relaxed);
+	
+	RealtimeLog("\r%s: %d bytes in %.1fs (%.1f KB/s)          \n", mpOperation, bytesDone, seconds,
+		seconds > 0 ? bytesDone / seconds / 1024.0 : 0.0);
+	
+	// whatever the bus thread prints next comes after this
+	RealtimeLogFlush();
+}
+
+void ProgressReporter::SetRate(uint32_t reportsPerSecond)
+{
+	mReportIntervalNs = 1000000000ull / (reportsPerSecond ? reportsPerSecond : 1);
+}
+
+void ProgressReporter::CheckReport(uint32_t bytesDone, uint32_t address)
+{
+	mBytesDone.store(bytesDone, std::memory_order_relaxed);
+	
+	uint64_t nowNs = GetTimeNs();
+	if(nowNs - mLastReportNs < mReportIntervalNs)
+	{
+		return;
+	}
+	
+	mLastReportNs = nowNs;
+	Report(bytesDone, address, nowNs);
+}
+
+void ProgressReporter::Report(uint32_t bytesDone, uint32_t address, uint64_t nowNs)
+{
+	double seconds = (double)(nowNs - mStartNs) / 1000000000.0;
+	double bytesPerSecond = seconds > 0 ? bytesDone / seconds : 0.0;
+	
+	uint32_t etaSeconds = 0;
+	if(bytesPerSecond > 0 && mTotalBytes > bytesDone)
+	{
+		etaSeconds = (uint32_t)((mTotalBytes - bytesDone) / bytesPerSecond);
+	}
+	
+	// overwrite the same line each time so an ssh session isn't flooded
+	RealtimeLog("\r%s: %d/%d bytes (%d%%), %.1f KB/s, ETA %d:%02d, bank $%02X   ", mpOperation, bytesDone, mTotalBytes,
+		mTotalBytes ? (uint32_t)((uint64_t)bytesDone * 100 / mTotalBytes) : 0, bytesPerSecond / 1024.0,
+		etaSeconds / 60, etaSeconds % 60, (address >> 16) & 0xFF);
+}
+
+TraceBuffer::~TraceBuffer()
+{
+	delete[] mpRecords;
+	mpRecords = nullptr;
+}
+
+void TraceBuffer::Enable()
+{
+	if(!mpRecords)
+	{
+		mpRecords = new TraceRecord[TRACE_NUM_RECORDS];
+		mNext = 0;
+	}
+}
+
+void TraceBuffer::Dump(const char* pFileName)
+{
+	if(!mpRecords || mNext == 0)
+	{
+		return;
+	}
+	
+	FILE* pFile = fopen(pFileName, "wb");
+	if(!pFile)
+	{
+		printf("Failed to open file '%s' for write!\n", pFileName);
+		return;
+	}
+	
+	uint64_t first = mNext > TRACE_NUM_RECORDS ? mNext - TRACE_NUM_RECORDS : 0;
+	for(uint64_t i = first; i < mNext; i++)
+	{
+		fwrite(&mpRecords[i % TRACE_NUM_RECORDS], sizeof(TraceRecord), 1, pFile);
+	}
+	
+	fclose(pFile);
+	pFile = NULL;
+	
+	printf("Wrote last %d bus accesses to trace file '%s'\n", (uint32_t)(mNext - first), pFileName);
+	mNext = 0;
+}
+
+void PrintTraceFile(const char* pFileName)
+{
+	FILE* pFile = fopen(pFileName, "rb");
+	if(!pFile)
+	{
+		printf("Failed to open file '%s' for read!\n", pFileName);
+		return;
+	}
+	
+	TraceRecord record;
+	while(fread(&record, sizeof(record), 1, pFile) == 1)
+	{
+		printf("%c %x: %x\n", (char)record.mOp, record.mAddress, record.mValue);
+	}
+	
+	fclose(pFile);
+	pFile = NULL;
+}
@@ -0,0 +1,106 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// Reports how a long bus operation is getting on at most a few times a second, instead of
+// a printf per byte. Update is cheap enough to call every byte: it only looks at the clock
+// once every PROGRESS_CHECK_INTERVAL bytes.
+#define PROGRESS_CHECK_INTERVAL (1024)
+
+class ProgressReporter
+{
+public:
+	void Begin(const char* pOperation, uint32_t totalBytes);
+	
+	inline void Update(uint32_t bytesDone, uint32_t address)
+	{
+		if(bytesDone % PROGRESS_CHECK_INTERVAL != 0)
+		{
+			return;
+		}
+		
+		CheckReport(bytesDone, address);
+	}
+	
+	void End(uint32_t bytesDone);
+	
+	// how many reports a second, at most
+	void SetRate(uint32_t reportsPerSecond);
+	
+	// For asking how it's going from another thread (see the daemon's status). Only as up to date
+	// as the last PROGRESS_CHECK_INTERVAL bytes.
+	const char* GetOperation() const { return mpOperation; }
+	uint32_t GetBytesDone() const { return mBytesDone.load(std::memory_order_relaxed); }
+	uint32_t GetTotalBytes() const { return mTotalBytes; }
+	
+private:
+	void CheckReport(uint32_t bytesDone, uint32_t address);
+	void Report(uint32_t bytesDone, uint32_t address, uint64_t nowNs);
+	
+private:
+	const char* mpOperation = "";
+	uint32_t mTotalBytes = 0;
+	uint64_t mStartNs = 0;
+	uint64_t mLastReportNs = 0;
+	uint64_t mReportIntervalNs = 500000000;
+	std::atomic<uint32_t> mBytesDone{0};
+};
+
+extern ProgressReporter gProgress;
+
+// With --verbose-trace every bus access is recorded in a fixed size ring buffer, which is only
+// written out if something goes wrong, so tracing costs a few stores per byte and no I/O.
+#define TRACE_NUM_RECORDS (65536)
+
+enum class TraceOp : uint8_t
+{
+	ReadROM = 'R',
+	ReadSRAM = 'S',
+	WriteSRAM = 'W'
+};
+
+struct TraceRecord
+{
+	uint32_t mAddress;
+	uint8_t mValue;
+	TraceOp mOp;
+	uint16_t mPad;
+};
+
+class TraceBuffer
+{
+public:
+	~TraceBuffer();
+	
+	void Enable();
+	bool IsEnabled() const { return mpRecords != nullptr; }
+	
+	inline void Record(TraceOp op, uint32_t address, uint8_t value)
+	{
+		if(!mpRecords)
+		{
+			return;
+		}
+		
+		TraceRecord& record = mpRecords[mNext % TRACE_NUM_RECORDS];
+		record.mAddress = address;
+		record.mValue = value;
+		record.mOp = op;
+		record.mPad = 0;
+		
+		mNext++;
+	}
+	
+	// Writes the buffered records out oldest first, then starts over.
+	void Dump(const char* pFileName);
+	
+private:
+	TraceRecord* mpRecords = nullptr;
+	uint64_t mNext = 0;
+};
+
+extern TraceBuffer gTrace;
+
+// Prints a trace file written by TraceBuffer::Dump
+void PrintTraceFile(const char* pFileName);
@@ -0,0 +1,159 @@
+#include "ReadVerifier.h"
+
+#include <cstring>
+#include <stdio.h>
+
+#include "BusTiming.h"
+#include "CartBus.h"
+
+void ReadVerifier::Configure(uint32_t baseSamples, uint32_t maxSamples, uint32_t stretchPercent)
+{
+	mBaseSamples = baseSamples;
+	
+	// odd, so every bit's vote has a winner
+	mMaxSamples = (maxSamples > baseSamples) ? maxSamples : baseSamples + 1;
+	mMaxSamples |= 0x1;
+	mMaxSamples = (mMaxSamples > VERIFY_MAX_SAMPLES) ? VERIFY_MAX_SAMPLES : mMaxSamples;
+	
+	mStretchPercent = (stretchPercent < 100) ? 100 : stretchPercent;
+}
+
+void ReadVerifier::Begin()
+{
+	mNumBlocks = 0;
+	mNumEscalated = 0;
+	memset(mUnstableBytes, 0, sizeof(mUnstableBytes));
+	memset(mWeakBytes, 0, sizeof(mWeakBytes));
+}
+
+void ReadVerifier::ReadRun(const BusRun& run, uint8_t* pData)
+{
+	for(uint32_t offset = 0; offset < run.mLength; offset += VERIFY_BLOCK_SIZE)
+	{
+		uint32_t length = (run.mLength - offset < VERIFY_BLOCK_SIZE) ? run.mLength - offset : VERIFY_BLOCK_SIZE;
+		ReadBlock(run.mAddress + offset, run.mRomSel, length, pData + offset);
+	}
+}
+
+void ReadVerifier::ReadBlock(uint32_t address, bool romSel, uint32_t length, uint8_t* pData)
+{
+	mNumBlocks++;
+	
+	BusRun block = { address, length, romSel };
+	ReadCartRun(block, pData);
+	
+	// which bytes the base samples didn't agree on, which the vote counts as unstable whatever it finds
+	bool unstable[VERIFY_BLOCK_SIZE];
+	memset(unstable, 0, sizeof(unstable));
+	
+	bool agreed = true;
+	for(uint32_t sample = 1; sample < mBaseSamples; sample++)
+	{
+		uint8_t values[VERIFY_BLOCK_SIZE];
+		ReadCartRun(block, values);
+		
+		for(uint32_t i = 0; i < length; i++)
+		{
+			unstable[i] = unstable[i] || (values[i] != pData[i]);
+			agreed = agreed && !unstable[i];
+		}
+	}
+	
+	if(!agreed)
+	{
+		mNumEscalated++;
+		VoteBlock(address, romSel, length, pData, unstable);
+	}
+}
+
+// Reads the block mMaxSamples times with the bus slowed down and takes each bit's majority. pUnstable
+// comes in with the bytes the base samples disagreed on, and any the stretched samples disagree on
+// (with each other, or with the first base sample in pData) are added to it.
+void ReadVerifier::VoteBlock(uint32_t address, bool romSel, uint32_t length, uint8_t* pData, bool* pUnstable)
+{
+	BusTimings timings = gBusTimings;
+	gBusTimings.mLatchNs = timings.mLatchNs * mStretchPercent / 100;
+	gBusTimings.mSetupNs = timings.mSetupNs * mStretchPercent / 100;
+	gBusTimings.mAccessNs = timings.mAccessNs * mStretchPercent / 100;
+	gBusTimings.mHoldNs = timings.mHoldNs * mStretchPercent / 100;
+	
+	uint8_t oneCounts[VERIFY_BLOCK_SIZE][8];
+	uint8_t firstValues[VERIFY_BLOCK_SIZE];
+	memset(oneCounts, 0, sizeof(oneCounts));
+	
+	BusRun block = { address, length, romSel };
+	
+	for(uint32_t sample = 0; sample < mMaxSamples; sample++)
+	{
+		uint8_t values[VERIFY_BLOCK_SIZE];
+		ReadCartRun(block, values);
+		
+		for(uint32_t i = 0; i < length; i++)
+		{
+			uint8_t value = values[i];
+			if(sample == 0)
+			{
+				firstValues[i] = value;
+			}
+			
+			pUnstable[i] = pUnstable[i] || (value != firstValues[i]) || (value != pData[i]);
+			
+			for(uint32_t bit = 0; bit < 8; bit++)
+			{
+				oneCounts[i][bit] += (value >> bit) & 0x1;
+			}
+		}
+	}
+	
+	gBusTimings = timings;
+	
+	uint32_t bank = (address >> 16) & 0xFF;
+	for(uint32_t i = 0; i < length; i++)
+	{
+		uint8_t value = 0;
+		bool weak = false;
+		
+		for(uint32_t bit = 0; bit < 8; bit++)
+		{
+			uint32_t ones = oneCounts[i][bit];
+			uint32_t zeros = mMaxSamples - ones;
+			value |= (ones > zeros ? 0x1 : 0x0) << bit;
+			
+			// a bit that's only winning narrowly can't be trusted, want at least 3 to 1
+			uint32_t winner = (ones > zeros) ? ones : zeros;
+			weak = weak || (winner * 4 < mMaxSamples * 3);
+		}
+		
+		pData[i] = value;
+		mUnstableBytes[bank] += pUnstable[i] ? 1 : 0;
+		mWeakBytes[bank] += weak ? 1 : 0;
+	}
+}
+
+bool ReadVerifier::PrintErrorMap() const
+{
+	uint32_t totalUnstable = 0;
+	uint32_t totalWeak = 0;
+	
+	for(uint32_t bank = 0; bank < 256; bank++)
+	{
+		if(mUnstableBytes[bank] == 0)
+		{
+			continue;
+		}
+		
+		printf("Verify: bank $%02X: %d bytes disagreed, %d still weak after %d samples\n", bank, mUnstableBytes[bank], mWeakBytes[bank], mMaxSamples);
+		totalUnstable += mUnstableBytes[bank];
+		totalWeak += mWeakBytes[bank];
+	}
+	
+	printf("Verify: %d of %d blocks needed more than %d samples, %d bytes disagreed, %d weak\n", mNumEscalated, mNumBlocks, mBaseSamples,
+		totalUnstable, totalWeak);
+	
+	if(totalWeak > 0)
+	{
+		printf("Verify: The weak bytes are a best guess. Clean the contacts and dump again\n");
+	}
+	
+	return totalWeak == 0;
+}
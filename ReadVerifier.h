@@ -0,0 +1,46 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Mapper.h"
+
+// Majority voted reads for carts with dodgy contacts. Every block is read a few times, and only a
+// block whose reads disagree gets read again many more times, with stretched bus timings, and voted
+// on bit by bit. A clean cart costs the base samples and nothing more. What it found is kept per
+// bank, so a dump says how much it can be trusted and where the trouble was.
+#define VERIFY_BLOCK_SIZE (256)
+#define VERIFY_MAX_SAMPLES (31)
+
+class ReadVerifier
+{
+public:
+	// baseSamples reads of every block, up to maxSamples with timings stretched by stretchPercent
+	// for the ones that disagree. Fewer than 2 base samples turns it off.
+	void Configure(uint32_t baseSamples, uint32_t maxSamples, uint32_t stretchPercent);
+	bool IsEnabled() const { return mBaseSamples >= 2; }
+	
+	void Begin();
+	
+	// Reads a whole run into pData
+	void ReadRun(const BusRun& run, uint8_t* pData);
+	
+	// Per bank counts of bytes that disagreed, and those that still weren't convincing after
+	// the extra samples. Returns false if any were unconvincing.
+	bool PrintErrorMap() const;
+	
+private:
+	void ReadBlock(uint32_t address, bool romSel, uint32_t length, uint8_t* pData);
+	void VoteBlock(uint32_t address, bool romSel, uint32_t length, uint8_t* pData, bool* pUnstable);
+	
+private:
+	uint32_t mBaseSamples = 0;
+	uint32_t mMaxSamples = 7;
+	uint32_t mStretchPercent = 200;
+	
+	uint32_t mNumBlocks = 0;
+	uint32_t mNumEscalated = 0;
+	
+	// indexed by bus bank
+	uint32_t mUnstableBytes[256];
+	uint32_t mWeakBytes[256];
+};
@@ -0,0 +1,209 @@
+#include "Realtime.h"
+
+#include <atomic>
+#include <cstdarg>
+#include <cstring>
+#include <malloc.h>
+#include <sched.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <thread>
+#include <unistd.h>
+
+#include "BusProgram.h"
+#include "SpscQueue.h"
+
+struct LogMessage
+{
+	char mText[REALTIME_LOG_MESSAGE_SIZE];
+};
+
+static bool gRealtimeEnabled = false;
+static int32_t gRealtimeCpu = -1;
+static bool gRealtimeFifo = false;
+
+static SpscQueue<LogMessage, REALTIME_LOG_QUEUE_SIZE> gLogQueue;
+static std::atomic<uint32_t> gNumDroppedLogs{0};
+
+// only set on the bus thread, so RealtimeLog knows where it's being called from
+static thread_local bool gOnBusThread = false;
+
+// The first core in /sys/devices/system/cpu/isolated (isolcpus= on the kernel command line), which
+// nothing else gets scheduled on, or failing that the last one.
+static int32_t PickBusCpu()
+{
+	FILE* pFile = fopen("/sys/devices/system/cpu/isolated", "r");
+	if(pFile)
+	{
+		int32_t cpu = -1;
+		int32_t result = fscanf(pFile, "%d", &cpu);
+		fclose(pFile);
+		pFile = NULL;
+		
+		if(result == 1 && cpu >= 0)
+		{
+			return cpu;
+		}
+	}
+	
+	printf("Realtime: No isolated cores, add isolcpus=3 to the kernel command line to keep everything else off the bus thread's core\n");
+	
+	long numCpus = sysconf(_SC_NPROCESSORS_ONLN);
+	return numCpus > 0 ? (int32_t)numCpus - 1 : 0;
+}
+
+void EnableRealtime(int32_t cpu)
+{
+	// freed memory stays in the heap instead of going back to the kernel and having to be faulted in again
+	mallopt(M_TRIM_THRESHOLD, -1);
+	mallopt(M_MMAP_MAX, 0);
+	
+	// everything mapped from here on is faulted in and locked as it's mapped, the chunk pool and
+	// thread stacks included
+	if(mlockall(MCL_CURRENT | MCL_FUTURE) != 0)
+	{
+		printf("Realtime: mlockall failed (not root, or RLIMIT_MEMLOCK too low), memory can still page\n");
+	}
+	
+	gRealtimeCpu = cpu >= 0 ? cpu : PickBusCpu();
+	gRealtimeEnabled = true;
+	
+	// With one core a FIFO thread that never sleeps would starve the writer and the printing
+	// (apart from the kernel's RT throttling), which is worse than the jitter.
+	gRealtimeFifo = sysconf(_SC_NPROCESSORS_ONLN) >= 2;
+	if(!gRealtimeFifo)
+	{
+		printf("Realtime: Only one core, the bus thread stays SCHED_OTHER\n");
+	}
+}
+
+bool IsRealtimeEnabled()
+{
+	return gRealtimeEnabled;
+}
+
+static void PrefaultStack()
+{
+	uint8_t stack[REALTIME_PREFAULT_STACK_BYTES];
+	memset(stack, 0, sizeof(stack));
+	
+	// so the compiler can't drop the memset as dead
+	__asm__ __volatile__("" : : "r"(stack) : "memory");
+}
+
+static void SetUpBusThread()
+{
+	gOnBusThread = true;
+	
+	cpu_set_t cpus;
+	CPU_ZERO(&cpus);
+	CPU_SET(gRealtimeCpu, &cpus);
+	
+	if(sched_setaffinity(0, sizeof(cpus), &cpus) != 0)
+	{
+		printf("Realtime: Couldn't pin the bus thread to cpu %d\n", gRealtimeCpu);
+	}
+	
+	if(gRealtimeFifo)
+	{
+		sched_param param;
+		memset(&param, 0, sizeof(param));
+		param.sched_priority = REALTIME_PRIORITY;
+		
+		if(sched_setscheduler(0, SCHED_FIFO, &param) != 0)
+		{
+			printf("Realtime: Couldn't switch the bus thread to SCHED_FIFO (needs root or CAP_SYS_NICE)\n");
+		}
+	}
+	
+	PrefaultStack();
+}
+
+static void PrintLogs()
+{
+	LogMessage message;
+	bool printed = false;
+	
+	while(gLogQueue.Pop(message))
+	{
+		fputs(message.mText, stdout);
+		printed = true;
+	}
+	
+	if(printed)
+	{
+		fflush(stdout);
+	}
+}
+
+void RunBusCommand(const std::function<void()>& command)
+{
+	if(!gRealtimeEnabled)
+	{
+		command();
+		return;
+	}
+	
+	BusLoopStats loopStats;
+	loopStats.Reset();
+	gNumDroppedLogs = 0;
+	
+	std::atomic<bool> done{false};
+	std::thread busThread([&]
+	{
+		SetUpBusThread();
+		
+		gpBusLoopStats = &loopStats;
+		command();
+		gpBusLoopStats = nullptr;
+		
+		done.store(true, std::memory_order_release);
+	});
+	
+	while(!done.load(std::memory_order_acquire))
+	{
+		PrintLogs();
+		usleep(REALTIME_LOG_POLL_US);
+	}
+	
+	busThread.join();
+	PrintLogs();
+	
+	if(gNumDroppedLogs > 0)
+	{
+		printf("Realtime: Dropped %d log messages from the bus thread\n", gNumDroppedLogs.load());
+	}
+	
+	loopStats.Print("Realtime");
+}
+
+void RealtimeLog(const char* pFormat, ...)
+{
+	va_list args;
+	va_start(args, pFormat);
+	
+	if(!gOnBusThread)
+	{
+		vprintf(pFormat, args);
+		va_end(args);
+		fflush(stdout);
+		return;
+	}
+	
+	LogMessage message;
+	vsnprintf(message.mText, sizeof(message.mText), pFormat, args);
+	va_end(args);
+	
+	if(!gLogQueue.Push(message))
+	{
+		gNumDroppedLogs++;
+	}
+}
+
+void RealtimeLogFlush()
+{
+	while(gOnBusThread && !gLogQueue.IsEmpty())
+	{
+		usleep(REALTIME_LOG_POLL_US / 10);
+	}
+}
@@ -0,0 +1,39 @@
+#pragma once
+
+#include <cstdint>
+#include <functional>
+
+// --realtime: the bus work of a command runs on its own thread, pinned to a core (an isolcpus one
+// if there is one) under SCHED_FIFO, with all memory locked so it never takes a page fault. That
+// thread never blocks on anything: chunks go to the writer thread over SpscQueues (see ChunkWriter)
+// and anything it logs goes over another one to the main thread, which does the actual printing.
+// At the end of each command the worst bus cycle seen is reported, to know how much slack the
+// timings in BusTiming really need.
+#define REALTIME_PRIORITY (80)
+
+// how much of the bus thread's stack gets touched up front so it's all faulted in
+#define REALTIME_PREFAULT_STACK_BYTES (256 * 1024)
+
+#define REALTIME_LOG_QUEUE_SIZE (64)
+#define REALTIME_LOG_MESSAGE_SIZE (160)
+
+// how often the main thread looks for something to print while the bus thread runs
+#define REALTIME_LOG_POLL_US (10000)
+
+// Locks memory and remembers the core for RunBusCommand. cpu < 0 picks one.
+void EnableRealtime(int32_t cpu);
+
+bool IsRealtimeEnabled();
+
+// Runs command on the bus thread and prints what it logs until it's done, or just runs it if
+// --realtime isn't on. command should be the bus loop and nothing else: files are opened, read,
+// finished and closed by the caller, before and after.
+void RunBusCommand(const std::function<void()>& command);
+
+// printf, except from the bus thread it only formats into the log queue. Messages that don't fit
+// are dropped and counted rather than waited on.
+void RealtimeLog(const char* pFormat, ...) __attribute__((format(printf, 1, 2)));
+
+// From the bus thread, waits until everything it logged has been printed, so it can go back to
+// printing directly without things coming out of order. Anywhere else it does nothing.
+void RealtimeLogFlush();
@@ -0,0 +1,477 @@
+#include "RomDatabase.h"
+
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <stdio.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+static const char gDatIndexMagic[4] = { 'C', 'R', 'D', 'X' };
+
+// Reads a whole file into a zero terminated buffer the caller frees.
+static char* LoadTextFile(const char* pFileName)
+{
+	FILE* pFile = fopen(pFileName, "rb");
+	if(!pFile)
+	{
+		return nullptr;
+	}
+	
+	fseek(pFile, 0, SEEK_END);
+	long size = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+	
+	char* pText = (char*)malloc(size + 1);
+	if(pText && size >= 0 && fread(pText, 1, size, pFile) == (size_t)size)
+	{
+		pText[size] = 0;
+	}
+	else
+	{
+		free(pText);
+		pText = nullptr;
+	}
+	
+	fclose(pFile);
+	return pText;
+}
+
+// Copies the value of attribute pName out of the tag running from pTag to pTagEnd, undoing the XML escapes.
+static bool GetAttribute(const char* pTag, const char* pTagEnd, const char* pName, char* pValue, uint32_t valueSize)
+{
+	uint32_t nameLength = strlen(pName);
+	
+	for(const char* p = pTag + 1; p + nameLength + 2 < pTagEnd; p++)
+	{
+		if(p[-1] != ' ' && p[-1] != '\t' && p[-1] != '\n' && p[-1] != '\r')
+		{
+			continue;
+		}
+		
+		if(strncmp(p, pName, nameLength) || p[nameLength] != '=' || p[nameLength + 1] != '"')
+		{
+			continue;
+		}
+		
+		static const char* entities[][2] = { { "&amp;", "&" }, { "&apos;", "'" }, { "&quot;", "\"" }, { "&lt;", "<" }, { "&gt;", ">" } };
+		
+		uint32_t length = 0;
+		for(p += nameLength + 2; p < pTagEnd && *p != '"' && length + 1 < valueSize; )
+		{
+			bool unescaped = false;
+			for(uint32_t i = 0; i < sizeof(entities) / sizeof(entities[0]) && !unescaped; i++)
+			{
+				uint32_t entityLength = strlen(entities[i][0]);
+				if(!strncmp(p, entities[i][0], entityLength))
+				{
+					pValue[length++] = entities[i][1][0];
+					p += entityLength;
+					unescaped = true;
+				}
+			}
+			
+			if(!unescaped)
+			{
+				pValue[length++] = *p++;
+			}
+		}
+		
+		pValue[length] = 0;
+		return true;
+	}
+	
+	return false;
+}
+
+static bool ParseSha1(const char* pText, uint8_t* pSha1)
+{
+	if(strlen(pText) != SHA1_DIGEST_SIZE * 2)
+	{
+		return false;
+	}
+	
+	for(uint32_t i = 0; i < SHA1_DIGEST_SIZE; i++)
+	{
+		char byteText[3] = { pText[i * 2], pText[i * 2 + 1], 0 };
+		char* pEnd = nullptr;
+		
+		pSha1[i] = (uint8_t)strtoul(byteText, &pEnd, 16);
+		if(*pEnd)
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+static int CompareByCrc32(const void* pA, const void* pB)
+{
+	const DatIndexEntry* pEntryA = (const DatIndexEntry*)pA;
+	const DatIndexEntry* pEntryB = (const DatIndexEntry*)pB;
+	
+	if(pEntryA->mCrc32 != pEntryB->mCrc32)
+	{
+		return pEntryA->mCrc32 < pEntryB->mCrc32 ? -1 : 1;
+	}
+	
+	if(pEntryA->mSize != pEntryB->mSize)
+	{
+		return pEntryA->mSize < pEntryB->mSize ? -1 : 1;
+	}
+	
+	return memcmp(pEntryA->mSha1, pEntryB->mSha1, SHA1_DIGEST_SIZE);
+}
+
+// qsort has no context pointer, so the SHA-1 order is sorted against this
+static const DatIndexEntry* gpSortEntries = nullptr;
+
+static int CompareBySha1(const void* pA, const void* pB)
+{
+	return memcmp(gpSortEntries[*(const uint32_t*)pA].mSha1, gpSortEntries[*(const uint32_t*)pB].mSha1, SHA1_DIGEST_SIZE);
+}
+
+bool CompileDat(const char* pDatFileName, const char* pIndexFileName)
+{
+	char* pDat = LoadTextFile(pDatFileName);
+	if(!pDat)
+	{
+		printf("CompileDat: Failed to read '%s'\n", pDatFileName);
+		return false;
+	}
+	
+	DatIndexEntry* pEntries = nullptr;
+	uint32_t numEntries = 0;
+	uint32_t maxEntries = 0;
+	
+	char* pNames = nullptr;
+	uint32_t namesSize = 0;
+	uint32_t maxNamesSize = 0;
+	
+	uint32_t numSkipped = 0;
+	bool failed = false;
+	
+	const char* pGame = pDat;
+	while(!failed && (pGame = strstr(pGame, "<game")) != nullptr)
+	{
+		const char* pGameTagEnd = strchr(pGame, '>');
+		const char* pGameEnd = strstr(pGame, "</game>");
+		if(!pGameTagEnd || !pGameEnd)
+		{
+			break;
+		}
+		
+		char name[512];
+		if(!GetAttribute(pGame, pGameTagEnd, "name", name, sizeof(name)))
+		{
+			numSkipped++;
+			pGame = pGameEnd;
+			continue;
+		}
+		
+		uint32_t nameLength = strlen(name) + 1;
+		uint32_t nameOffset = namesSize;
+		bool nameAdded = false;
+		
+		// a game can have more than one rom in it, they all go by the game's name
+		const char* pRom = pGameTagEnd;
+		while((pRom = strstr(pRom, "<rom ")) != nullptr && pRom < pGameEnd)
+		{
+			const char* pRomTagEnd = strchr(pRom, '>');
+			if(!pRomTagEnd)
+			{
+				break;
+			}
+			
+			char size[32];
+			char crc[32];
+			char sha1[64] = { 0 };
+			
+			DatIndexEntry entry;
+			memset(&entry, 0, sizeof(entry));
+			
+			if(!GetAttribute(pRom, pRomTagEnd, "size", size, sizeof(size)) || !GetAttribute(pRom, pRomTagEnd, "crc", crc, sizeof(crc)))
+			{
+				numSkipped++;
+				pRom = pRomTagEnd;
+				continue;
+			}
+			
+			entry.mSize = strtoul(size, nullptr, 10);
+			entry.mCrc32 = strtoul(crc, nullptr, 16);
+			
+			// not every DAT has SHA-1s, those entries are matched on CRC32 and size alone
+			if(GetAttribute(pRom, pRomTagEnd, "sha1", sha1, sizeof(sha1)) && !ParseSha1(sha1, entry.mSha1))
+			{
+				memset(entry.mSha1, 0, sizeof(entry.mSha1));
+			}
+			
+			if(!nameAdded)
+			{
+				if(namesSize + nameLength > maxNamesSize)
+				{
+					maxNamesSize = (maxNamesSize + nameLength) * 2;
+					pNames = (char*)realloc(pNames, maxNamesSize);
+				}
+				
+				if(!pNames)
+				{
+					failed = true;
+					break;
+				}
+				
+				memcpy(pNames + namesSize, name, nameLength);
+				namesSize += nameLength;
+				nameAdded = true;
+			}
+			
+			if(numEntries + 1 > maxEntries)
+			{
+				maxEntries = (maxEntries + 1) * 2;
+				pEntries = (DatIndexEntry*)realloc(pEntries, maxEntries * sizeof(DatIndexEntry));
+			}
+			
+			if(!pEntries)
+			{
+				failed = true;
+				break;
+			}
+			
+			entry.mNameOffset = nameOffset;
+			pEntries[numEntries++] = entry;
+			
+			pRom = pRomTagEnd;
+		}
+		
+		pGame = pGameEnd;
+	}
+	
+	free(pDat);
+	
+	uint32_t* pSha1Order = failed ? nullptr : (uint32_t*)malloc((numEntries + 1) * sizeof(uint32_t));
+	if(!pSha1Order)
+	{
+		printf("CompileDat: Out of memory\n");
+		free(pEntries);
+		free(pNames);
+		return false;
+	}
+	
+	qsort(pEntries, numEntries, sizeof(DatIndexEntry), CompareByCrc32);
+	
+	for(uint32_t i = 0; i < numEntries; i++)
+	{
+		pSha1Order[i] = i;
+	}
+	
+	gpSortEntries = pEntries;
+	qsort(pSha1Order, numEntries, sizeof(uint32_t), CompareBySha1);
+	gpSortEntries = nullptr;
+	
+	DatIndexHeader header;
+	memcpy(header.mMagic, gDatIndexMagic, sizeof(header.mMagic));
+	header.mVersion = DAT_INDEX_VERSION;
+	header.mNumEntries = numEntries;
+	header.mEntriesOffset = sizeof(header);
+	header.mSha1OrderOffset = header.mEntriesOffset + (numEntries * sizeof(DatIndexEntry));
+	header.mNamesOffset = header.mSha1OrderOffset + (numEntries * sizeof(uint32_t));
+	header.mNamesSize = namesSize;
+	
+	FILE* pFile = fopen(pIndexFileName, "wb");
+	bool written = pFile &&
+		fwrite(&header, sizeof(header), 1, pFile) == 1 &&
+		fwrite(pEntries, sizeof(DatIndexEntry), numEntries, pFile) == numEntries &&
+		fwrite(pSha1Order, sizeof(uint32_t), numEntries, pFile) == numEntries &&
+		fwrite(pNames, 1, namesSize, pFile) == namesSize;
+	
+	if(pFile)
+	{
+		written = (fclose(pFile) == 0) && written;
+	}
+	
+	free(pEntries);
+	free(pSha1Order);
+	free(pNames);
+	
+	if(!written)
+	{
+		printf("CompileDat: Failed to write '%s'\n", pIndexFileName);
+		return false;
+	}
+	
+	printf("CompileDat: %d roms from '%s' into '%s'", numEntries, pDatFileName, pIndexFileName);
+	if(numSkipped)
+	{
+		printf(", skipped %d without a name, size or crc", numSkipped);
+	}
+	
+	printf("\n");
+	return true;
+}
+
+RomDatabase::~RomDatabase()
+{
+	Close();
+}
+
+bool RomDatabase::Open(const char* pIndexFileName)
+{
+	Close();
+	
+	int file = open(pIndexFileName, O_RDONLY);
+	if(file == -1)
+	{
+		return false;
+	}
+	
+	struct stat fileStat;
+	if(fstat(file, &fileStat) != 0 || fileStat.st_size < (off_t)sizeof(DatIndexHeader))
+	{
+		close(file);
+		return false;
+	}
+	
+	mMappingSize = (uint32_t)fileStat.st_size;
+	mpMapping = mmap(nullptr, mMappingSize, PROT_READ, MAP_SHARED, file, 0);
+	close(file);
+	
+	if(mpMapping == MAP_FAILED)
+	{
+		mpMapping = nullptr;
+		return false;
+	}
+	
+	const uint8_t* pBase = (const uint8_t*)mpMapping;
+	mpHeader = (const DatIndexHeader*)pBase;
+	
+	if(!IsValid(mMappingSize))
+	{
+		printf("RomDatabase: '%s' isn't an index, or is from another version. Compile it again with --compile-dat\n", pIndexFileName);
+		Close();
+		return false;
+	}
+	
+	mpEntries = (const DatIndexEntry*)(pBase + mpHeader->mEntriesOffset);
+	mpSha1Order = (const uint32_t*)(pBase + mpHeader->mSha1OrderOffset);
+	mpNames = (const char*)(pBase + mpHeader->mNamesOffset);
+	return true;
+}
+
+void RomDatabase::Close()
+{
+	if(mpMapping)
+	{
+		munmap(mpMapping, mMappingSize);
+	}
+	
+	mpMapping = nullptr;
+	mMappingSize = 0;
+	mpHeader = nullptr;
+	mpEntries = nullptr;
+	mpSha1Order = nullptr;
+	mpNames = nullptr;
+}
+
+bool RomDatabase::IsValid(uint32_t fileSize) const
+{
+	if(memcmp(mpHeader->mMagic, gDatIndexMagic, sizeof(mpHeader->mMagic)) || mpHeader->mVersion != DAT_INDEX_VERSION)
+	{
+		return false;
+	}
+	
+	uint64_t numEntries = mpHeader->mNumEntries;
+	return mpHeader->mEntriesOffset + (numEntries * sizeof(DatIndexEntry)) <= mpHeader->mSha1OrderOffset &&
+		mpHeader->mSha1OrderOffset + (numEntries * sizeof(uint32_t)) <= mpHeader->mNamesOffset &&
+		(uint64_t)mpHeader->mNamesOffset + mpHeader->mNamesSize <= fileSize &&
+		(mpHeader->mNamesSize == 0 || ((const char*)mpMapping)[mpHeader->mNamesOffset + mpHeader->mNamesSize - 1] == 0);
+}
+
+const DatIndexEntry* RomDatabase::FindByCrc32(uint32_t crc32, uint32_t size, const uint8_t* pSha1) const
+{
+	if(!mpHeader)
+	{
+		return nullptr;
+	}
+	
+	// first entry that isn't below crc32/size
+	uint32_t low = 0;
+	uint32_t high = mpHeader->mNumEntries;
+	while(low < high)
+	{
+		uint32_t middle = low + (high - low) / 2;
+		const DatIndexEntry& entry = mpEntries[middle];
+		
+		if(entry.mCrc32 < crc32 || (entry.mCrc32 == crc32 && entry.mSize < size))
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	
+	static const uint8_t noSha1[SHA1_DIGEST_SIZE] = { 0 };
+	
+	// a CRC32 can collide, so with a SHA-1 to hand make sure it's the same rom
+	for(uint32_t i = low; i < mpHeader->mNumEntries && mpEntries[i].mCrc32 == crc32 && mpEntries[i].mSize == size; i++)
+	{
+		if(!pSha1 || !memcmp(mpEntries[i].mSha1, pSha1, SHA1_DIGEST_SIZE) || !memcmp(mpEntries[i].mSha1, noSha1, SHA1_DIGEST_SIZE))
+		{
+			return &mpEntries[i];
+		}
+	}
+	
+	return nullptr;
+}
+
+const DatIndexEntry* RomDatabase::FindBySha1(const uint8_t* pSha1) const
+{
+	if(!mpHeader)
+	{
+		return nullptr;
+	}
+	
+	uint32_t low = 0;
+	uint32_t high = mpHeader->mNumEntries;
+	while(low < high)
+	{
+		uint32_t middle = low + (high - low) / 2;
+		const DatIndexEntry& entry = mpEntries[mpSha1Order[middle]];
+		
+		int compare = memcmp(entry.mSha1, pSha1, SHA1_DIGEST_SIZE);
+		if(compare == 0)
+		{
+			return &entry;
+		}
+		
+		if(compare < 0)
+		{
+			low = middle + 1;
+		}
+		else
+		{
+			high = middle;
+		}
+	}
+	
+	return nullptr;
+}
+
+const DatIndexEntry* RomDatabase::Find(const RomDigests& digests) const
+{
+	const DatIndexEntry* pEntry = FindBySha1(digests.mSha1);
+	return pEntry ? pEntry : FindByCrc32(digests.mCrc32, digests.mSize, digests.mSha1);
+}
+
+const char* RomDatabase::GetName(const DatIndexEntry* pEntry) const
+{
+	return (pEntry && pEntry->mNameOffset < mpHeader->mNamesSize) ? mpNames + pEntry->mNameOffset : "";
+}
+
+uint32_t RomDatabase::GetNumEntries() const
+{
+	return mpHeader ? mpHeader->mNumEntries : 0;
+}
@@ -0,0 +1,68 @@
+#pragma once
+
+#include <cstdint>
+
+#include "Digests.h"
+#include "DumpHasher.h"
+
+// Known good dumps from a No-Intro style DAT, for naming and checking what we dumped.
+//
+// The DAT is XML and big, so it's compiled once (--compile-dat) into a flat index: entries sorted by
+// CRC32, a second order sorted by SHA-1, and the names. Opening that is an mmap and a lookup is a
+// binary search, with no parsing at startup.
+#define DAT_INDEX_VERSION (1)
+
+struct DatIndexHeader
+{
+	char mMagic[4];
+	uint32_t mVersion;
+	uint32_t mNumEntries;
+	uint32_t mEntriesOffset;
+	uint32_t mSha1OrderOffset;
+	uint32_t mNamesOffset;
+	uint32_t mNamesSize;
+};
+
+struct DatIndexEntry
+{
+	uint32_t mCrc32;
+	uint32_t mSize;
+	uint8_t mSha1[SHA1_DIGEST_SIZE];
+	
+	// into the names at the end of the index
+	uint32_t mNameOffset;
+};
+
+// Parses pDatFileName and writes the index for it to pIndexFileName.
+bool CompileDat(const char* pDatFileName, const char* pIndexFileName);
+
+class RomDatabase
+{
+public:
+	~RomDatabase();
+	
+	bool Open(const char* pIndexFileName);
+	void Close();
+	
+	// The entry with this CRC32 and size, checked against the SHA-1 if there is one. nullptr if there's no match.
+	const DatIndexEntry* FindByCrc32(uint32_t crc32, uint32_t size, const uint8_t* pSha1 = nullptr) const;
+	const DatIndexEntry* FindBySha1(const uint8_t* pSha1) const;
+	
+	// By SHA-1, then by CRC32 and size for DATs without SHA-1s
+	const DatIndexEntry* Find(const RomDigests& digests) const;
+	
+	const char* GetName(const DatIndexEntry* pEntry) const;
+	uint32_t GetNumEntries() const;
+	
+private:
+	bool IsValid(uint32_t fileSize) const;
+	
+private:
+	void* mpMapping = nullptr;
+	uint32_t mMappingSize = 0;
+	
+	const DatIndexHeader* mpHeader = nullptr;
+	const DatIndexEntry* mpEntries = nullptr;
+	const uint32_t* mpSha1Order = nullptr;
+	const char* mpNames = nullptr;
+};
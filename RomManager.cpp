@@ -0,0 +1,235 @@
+#include <cstring>
+#include <stdio.h>
+
+#include "RomManager.h"
+
+struct HeaderCandidate
+{
+	uint32_t mBank;
+	
+	// what the low nibble of the map mode should be for a header found here
+	uint8_t mMapMode;
+	const char* mpName;
+};
+
+// LoROM puts the header at the end of the first 32KB, HiROM at the end of the first 64KB and
+// ExHiROM at the end of the first 64KB of the upper 4MB, which only $40 reaches.
+static const HeaderCandidate gHeaderCandidates[] =
+{
+	{ 0x00, 0x0, "LoROM $00:FFC0" },
+	{ 0xC0, 0x1, "HiROM $C0:FFC0" },
+	{ 0x40, 0x5, "ExHiROM $40:FFC0" },
+};
+
+// Opcodes a reset handler plausibly starts with
+static bool IsLikelyResetOpcode(uint8_t opcode)
+{
+	switch(opcode)
+	{
+		case 0x78: // sei
+		case 0x18: // clc
+		case 0x38: // sec
+		case 0x9C: // stz abs
+		case 0x4C: // jmp abs
+		case 0x5C: // jml long
+		case 0xC2: // rep
+		case 0xE2: // sep
+		case 0xA9: // lda #
+		case 0x8D: // sta abs
+		{
+			return true;
+		}
+	}
+	
+	return false;
+}
+
+static int32_t ScoreHeader(const uint8_t* pHeader, const HeaderCandidate& candidate, uint8_t resetOpcode)
+{
+	int32_t score = 0;
+	
+	uint16_t resetVector = pHeader[HEADER_RESET_VECTOR] | (pHeader[HEADER_RESET_VECTOR + 1] << 8);
+	uint8_t mapMode = pHeader[HEADER_MAP_MODE];
+	
+	// a checksum and its complement that add up is by far the best sign
+	if(IsRomHeaderChecksumValid(pHeader))
+	{
+		score += 8;
+	}
+	
+	// 001s0mmm, and the mapping has to match where we found it. SA-1 (3) and
+	// S-DD1 (2) use LoROM style header placement.
+	if((mapMode & 0xE0) == 0x20)
+	{
+		uint8_t mode = mapMode & 0x0F;
+		if(mode == candidate.mMapMode || (candidate.mMapMode == 0x0 && (mode == 0x2 || mode == 0x3)))
+		{
+			score += 4;
+		}
+	}
+	else
+	{
+		score -= 4;
+	}
+	
+	// the cpu starts in bank 0 and rom is only at $8000 and up there
+	if(resetVector >= 0x8000)
+	{
+		score += 2;
+		
+		if(IsLikelyResetOpcode(resetOpcode))
+		{
+			score += 2;
+		}
+	}
+	else
+	{
+		score -= 4;
+	}
+	
+	// 256KB - 8MB
+	if(pHeader[HEADER_ROM_SIZE] >= 0x08 && pHeader[HEADER_ROM_SIZE] <= 0x0D)
+	{
+		score += 1;
+	}
+	
+	if(pHeader[HEADER_RAM_SIZE] <= 0x07)
+	{
+		score += 1;
+	}
+	
+	bool printableTitle = true;
+	for(uint32_t i = 0; i < 21; i++)
+	{
+		uint8_t c = pHeader[HEADER_TITLE + i];
+		if(c < 0x20 || c > 0x7E)
+		{
+			printableTitle = false;
+		}
+	}
+	
+	if(printableTitle)
+	{
+		score += 1;
+	}
+	
+	return score;
+}
+
+static RomMapping GetMapping(const uint8_t* pHeader)
+{
+	uint8_t mode = pHeader[HEADER_MAP_MODE] & 0x0F;
+	uint8_t coprocessor = pHeader[HEADER_CART_TYPE] >> 4;
+	bool hasCoprocessor = (pHeader[HEADER_CART_TYPE] & 0x0F) >= 0x03;
+	
+	if(mode == 0x3 || (hasCoprocessor && coprocessor == 0x3))
+	{
+		return RomMapping::SA1;
+	}
+	else if(mode == 0x2 || (hasCoprocessor && coprocessor == 0x4))
+	{
+		return RomMapping::SDD1;
+	}
+	else if(hasCoprocessor && coprocessor == 0x1)
+	{
+		return RomMapping::SuperFX;
+	}
+	else if(mode == 0x5)
+	{
+		return RomMapping::ExHiROM;
+	}
+	else if(mode == 0x1)
+	{
+		return RomMapping::HiROM;
+	}
+	
+	return RomMapping::LoROM;
+}
+
+bool ProbeRomInfo(ReadByteFunc pReadByte, RomInfo* pRomInfo)
+{
+	uint8_t bestHeader[HEADER_READ_SIZE] = { 0 };
+	int32_t bestScore = 0;
+	const HeaderCandidate* pBest = nullptr;
+	
+	for(uint32_t c = 0; c < sizeof(gHeaderCandidates) / sizeof(gHeaderCandidates[0]); c++)
+	{
+		const HeaderCandidate& candidate = gHeaderCandidates[c];
+		
+		uint8_t header[HEADER_READ_SIZE];
+		for(uint32_t i = 0; i < HEADER_READ_SIZE; i++)
+		{
+			header[i] = pReadByte((candidate.mBank << 16) | (HEADER_READ_BASE + i));
+		}
+		
+		uint16_t resetVector = header[HEADER_RESET_VECTOR] | (header[HEADER_RESET_VECTOR + 1] << 8);
+		uint8_t resetOpcode = pReadByte((candidate.mBank << 16) | resetVector);
+		
+		int32_t score = ScoreHeader(header, candidate, resetOpcode);
+		printf("ProbeRomInfo: %s scores %d\n", candidate.mpName, score);
+		
+		if(score > bestScore)
+		{
+			bestScore = score;
+			pBest = &candidate;
+			memcpy(bestHeader, header, sizeof(bestHeader));
+		}
+	}
+	
+	if(!pBest)
+	{
+		printf("ProbeRomInfo: No believable header found. Is the cart seated?\n");
+		return false;
+	}
+	
+	ParseRomHeader(bestHeader, pRomInfo);
+	pRomInfo->mHeaderScore = bestScore;
+	
+	printf("ProbeRomInfo: '%s' %s%s, %dKB rom, %dKB sram, checksum %04X\n", pRomInfo->mTitle, GetMappingName(pRomInfo->mMapping),
+		pRomInfo->mFastROM ? " (FastROM)" : "", pRomInfo->mRomSize / 1024, pRomInfo->mSRAMSize / 1024, pRomInfo->mChecksum);
+	
+	return true;
+}
+
+void ParseRomHeader(const uint8_t* pHeader, RomInfo* pRomInfo)
+{
+	memcpy(pRomInfo->mTitle, &pHeader[HEADER_TITLE], 21);
+	pRomInfo->mTitle[21] = 0;
+	
+	pRomInfo->mMapping = GetMapping(pHeader);
+	pRomInfo->mFastROM = (pHeader[HEADER_MAP_MODE] & 0x10) != 0;
+	pRomInfo->mRomSize = 1024 << (pHeader[HEADER_ROM_SIZE] & 0x0F);
+	pRomInfo->mChecksum = pHeader[HEADER_CHECKSUM] | (pHeader[HEADER_CHECKSUM + 1] << 8);
+	
+	uint8_t ramSize = pHeader[HEADER_RAM_SIZE];
+	
+	// SuperFX carts keep their work ram size in the extended header instead
+	if(pRomInfo->mMapping == RomMapping::SuperFX && pHeader[HEADER_DEVELOPER_ID] == 0x33)
+	{
+		ramSize = pHeader[HEADER_EXPANSION_RAM];
+	}
+	
+	pRomInfo->mSRAMSize = (ramSize > 0 && ramSize <= 0x07) ? (1024 << ramSize) : 0;
+}
+
+bool IsRomHeaderChecksumValid(const uint8_t* pHeader)
+{
+	uint16_t complement = pHeader[HEADER_COMPLEMENT] | (pHeader[HEADER_COMPLEMENT + 1] << 8);
+	uint16_t checksum = pHeader[HEADER_CHECKSUM] | (pHeader[HEADER_CHECKSUM + 1] << 8);
+	
+	return (uint16_t)(checksum + complement) == 0xFFFF;
+}
+
+const char* GetMappingName(RomMapping mapping)
+{
+	switch(mapping)
+	{
+		case RomMapping::LoROM: return "LoROM";
+		case RomMapping::HiROM: return "HiROM";
+		case RomMapping::ExHiROM: return "ExHiROM";
+		case RomMapping::SA1: return "SA-1";
+		case RomMapping::SuperFX: return "SuperFX";
+		case RomMapping::SDD1: return "S-DD1";
+		default: return "Unknown";
+	}
+}
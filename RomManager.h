@@ -0,0 +1,70 @@
+#pragma once
+
+#include <cstdint>
+#include <cstring>
+
+enum class RomMapping
+{
+	Unknown,
+	LoROM,
+	HiROM,
+	ExHiROM,
+	SA1,
+	SuperFX,
+	SDD1
+};
+
+struct RomInfo
+{
+public:
+	RomInfo() : mSRAMSize(0), mRomSize(0), mMapping(RomMapping::Unknown), mFastROM(false), mChecksum(0), mHeaderScore(0)
+	{
+		memset(mRomName, 0, sizeof(mRomName));
+		memset(mTitle, 0, sizeof(mTitle));
+	}
+	
+	char mRomName[256];
+	uint32_t mSRAMSize;	
+	
+	// everything below comes from the cart's internal header, see ProbeRomInfo
+	char mTitle[22];
+	uint32_t mRomSize;
+	RomMapping mMapping;
+	bool mFastROM;
+	uint16_t mChecksum;
+	int32_t mHeaderScore;
+};
+
+// Offsets into the 0x50 bytes read from $xx:FFB0, which covers the extended header, the header
+// at FFC0 and the vectors.
+#define HEADER_READ_BASE (0xFFB0)
+#define HEADER_READ_SIZE (0x50)
+#define HEADER_EXPANSION_RAM (0xFFBD - HEADER_READ_BASE)
+#define HEADER_TITLE (0xFFC0 - HEADER_READ_BASE)
+#define HEADER_MAP_MODE (0xFFD5 - HEADER_READ_BASE)
+#define HEADER_CART_TYPE (0xFFD6 - HEADER_READ_BASE)
+#define HEADER_ROM_SIZE (0xFFD7 - HEADER_READ_BASE)
+#define HEADER_RAM_SIZE (0xFFD8 - HEADER_READ_BASE)
+#define HEADER_DEVELOPER_ID (0xFFDA - HEADER_READ_BASE)
+#define HEADER_COMPLEMENT (0xFFDC - HEADER_READ_BASE)
+#define HEADER_CHECKSUM (0xFFDE - HEADER_READ_BASE)
+#define HEADER_RESET_VECTOR (0xFFFC - HEADER_READ_BASE)
+
+// The biggest SRAM a header's RAM size byte can claim (0x07), which every SRAM buffer is sized for.
+#define MAX_SRAM_SIZE (1024 << 7)
+
+// Reads a byte from the cart at a 24 bit bus address.
+typedef uint8_t (*ReadByteFunc)(uint32_t address);
+
+// Reads the candidate internal header locations (LoROM $00:FFC0, HiROM $40:FFC0 / $C0:FFC0,
+// ExHiROM $40:FFC0 at 4MB in), scores each one on how believable it is and fills pRomInfo in
+// from the winner. Returns false if nothing looked like a header.
+bool ProbeRomInfo(ReadByteFunc pReadByte, RomInfo* pRomInfo);
+
+// Fills in the header derived fields of pRomInfo from HEADER_READ_SIZE bytes starting at $xx:FFB0.
+void ParseRomHeader(const uint8_t* pHeader, RomInfo* pRomInfo);
+
+// Whether the checksum and its complement in the header add up.
+bool IsRomHeaderChecksumValid(const uint8_t* pHeader);
+
+const char* GetMappingName(RomMapping mapping);
@@ -0,0 +1,121 @@
+#include "SimBackend.h"
+
+#include <time.h>
+
+#include "BusTiming.h"
+#include "SimCart.h"
+
+SimBackend::SimBackend(SimCart* pSimCart) : mpSimCart(pSimCart)
+{
+}
+
+bool SimBackend::Open()
+{
+	if(!mpSimCart)
+	{
+		LOG("No cart to simulate.");
+		return false;
+	}
+	
+	Update();
+	return true;
+}
+
+void SimBackend::Close()
+{
+	mOutputMask = 0;
+	mPullUpMask = 0;
+}
+
+bool SimBackend::Configure(uint32_t lineMask, LineDirection direction, uint32_t levels)
+{
+	if(direction == LineDirection::Output)
+	{
+		mOutputMask |= lineMask;
+		mOutputLevels = (mOutputLevels & ~lineMask) | (levels & lineMask);
+	}
+	else
+	{
+		// HiZ (and a line watched for edges) is pulled up so a floating bus reads 0xFF, inputs are pulled down
+		mOutputMask &= ~lineMask;
+		
+		if(direction == LineDirection::HiZ || direction == LineDirection::Edges)
+		{
+			mPullUpMask |= lineMask;
+		}
+		else
+		{
+			mPullUpMask &= ~lineMask;
+		}
+	}
+	
+	Update();
+	return true;
+}
+
+void SimBackend::Release(uint32_t lineMask)
+{
+	mOutputMask &= ~lineMask;
+	mPullUpMask &= ~lineMask;
+	
+	Update();
+}
+
+void SimBackend::Write(uint32_t lineMask, uint32_t levels)
+{
+	mOutputLevels = (mOutputLevels & ~lineMask) | (levels & lineMask);
+	
+	Update();
+}
+
+uint32_t SimBackend::Read(uint32_t lineMask)
+{
+	if(mpSimCart->IsStale())
+	{
+		Update();
+	}
+	
+	mpSimCart->OnRead(lineMask);
+	
+	return mLevels & lineMask;
+}
+
+// The cart knows when its contacts can next change, so this sleeps until then rather than polling,
+// which is as close as the sim gets to the gpiod backend sleeping on an edge.
+bool SimBackend::WaitForEdge(uint32_t lineMask, uint32_t levels, uint32_t timeoutUs)
+{
+	uint64_t deadlineNs = GetTimeNs() + timeoutUs * 1000ull;
+	
+	while(true)
+	{
+		Update();
+		if((mLevels & lineMask) != (levels & lineMask))
+		{
+			return true;
+		}
+		
+		uint64_t nowNs = GetTimeNs();
+		if(nowNs >= deadlineNs)
+		{
+			return false;
+		}
+		
+		uint64_t wakeNs = mpSimCart->GetNextContactChangeNs(nowNs);
+		wakeNs = (wakeNs < deadlineNs) ? wakeNs : deadlineNs;
+		
+		timespec wake = { (time_t)(wakeNs / 1000000000ull), (long)(wakeNs % 1000000000ull) };
+		clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &wake, nullptr);
+	}
+}
+
+void SimBackend::Update()
+{
+	uint32_t levels = (mOutputLevels & mOutputMask) | (mPullUpMask & ~mOutputMask);
+	
+	uint32_t driveMask = 0;
+	uint32_t cartLevels = mpSimCart->Update(mOutputMask, levels, driveMask);
+	
+	// the cart only wins on pins the Pi isn't driving
+	driveMask &= ~mOutputMask;
+	mLevels = (levels & ~driveMask) | (cartLevels & driveMask);
+}
@@ -0,0 +1,37 @@
+#pragma once
+
+#include "GPIOManager.h"
+
+class SimCart;
+
+// Pins that only exist in memory, wired straight to a SimCart. No registers and no kernel, so it's
+// the cheapest way to run the bus code, and every pin change reaches the cart's timing checks.
+class SimBackend final : public GPIOBackend
+{
+public:
+	SimBackend(SimCart* pSimCart);
+	
+	bool Open() override;
+	void Close() override;
+	
+	bool Configure(uint32_t lineMask, LineDirection direction, uint32_t levels) override;
+	void Release(uint32_t lineMask) override;
+	
+	void Write(uint32_t lineMask, uint32_t levels) override;
+	uint32_t Read(uint32_t lineMask) override;
+	
+	bool WaitForEdge(uint32_t lineMask, uint32_t levels, uint32_t timeoutUs) override;
+	
+private:
+	// lets the cart see the new pin state and works out what every pin reads as
+	void Update();
+	
+private:
+	SimCart* mpSimCart = nullptr;
+	
+	uint32_t mOutputMask = 0;
+	uint32_t mOutputLevels = 0;
+	uint32_t mPullUpMask = 0;
+	
+	uint32_t mLevels = 0;
+};
@@ -0,0 +1,662 @@
+#include "SimCart.h"
+
+#include <cstring>
+#include <stdio.h>
+#include <time.h>
+
+#include "BusTiming.h"
+#include "PinMap.h"
+
+static const SimTimings gSlowROMSimTimings = { 15, 5, 10, 200, 60, 50, 25 };
+static const SimTimings gFastROMSimTimings = { 15, 5, 10, 120, 40, 50, 25 };
+
+static const char* gViolationNames[] =
+{
+	"latch setup",
+	"latch hold",
+	"read before data valid",
+	"bus contention",
+	"write pulse too short",
+	"write data setup",
+	"address changed during write",
+};
+
+// Timestamps are taken a clock read away from the pin change they stand for, so anything
+// closer than that can't be told apart from measurement error.
+static uint32_t MeasureClockSlackNs()
+{
+	uint64_t start = GetTimeNs();
+	for(uint32_t i = 0; i < 1000; i++)
+	{
+		GetTimeNs();
+	}
+	
+	return (uint32_t)((GetTimeNs() - start) / 1000);
+}
+
+SimCart::~SimCart()
+{
+	delete[] mpRom;
+	mpRom = nullptr;
+	
+	delete[] mpSRAM;
+	mpSRAM = nullptr;
+}
+
+bool SimCart::Load(const char* pRomFileName)
+{
+	FILE* pFile = fopen(pRomFileName, "rb");
+	if(!pFile)
+	{
+		printf("SimCart: Failed to open rom '%s'\n", pRomFileName);
+		return false;
+	}
+	
+	fseek(pFile, 0, SEEK_END);
+	mRomSize = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+	
+	mpRom = new uint8_t[mRomSize];
+	if(mRomSize == 0 || fread(mpRom, mRomSize, 1, pFile) != 1)
+	{
+		printf("SimCart: Failed to read rom '%s'\n", pRomFileName);
+		fclose(pFile);
+		return false;
+	}
+	
+	fclose(pFile);
+	pFile = NULL;
+	
+	printf("SimCart: Loaded '%s' (%d bytes)\n", pRomFileName, mRomSize);
+	mTimings = gSlowROMSimTimings;
+	mClockSlackNs = MeasureClockSlackNs();
+	
+	// the header is at the end of the first 32KB for LoROM, 64KB for HiROM and 64KB into the upper 4MB for ExHiROM
+	const uint32_t headerOffsets[] = { 0x7FB0, 0xFFB0, 0x40FFB0 };
+	for(uint32_t i = 0; i < sizeof(headerOffsets) / sizeof(headerOffsets[0]); i++)
+	{
+		if(headerOffsets[i] + HEADER_READ_SIZE > mRomSize || !IsRomHeaderChecksumValid(&mpRom[headerOffsets[i]]))
+		{
+			continue;
+		}
+		
+		RomInfo romInfo;
+		ParseRomHeader(&mpRom[headerOffsets[i]], &romInfo);
+		SetMapping(romInfo.mMapping, romInfo.mSRAMSize);
+		mTimings = romInfo.mFastROM ? gFastROMSimTimings : gSlowROMSimTimings;
+		break;
+	}
+	
+	printf("SimCart: %s, %d bytes of sram\n", GetMappingName(mMapping), mSRAMSize);
+	return true;
+}
+
+bool SimCart::LoadSRAM(const char* pSRAMFileName)
+{
+	FILE* pFile = fopen(pSRAMFileName, "rb");
+	if(!pFile)
+	{
+		printf("SimCart: Failed to open sram '%s'\n", pSRAMFileName);
+		return false;
+	}
+	
+	fseek(pFile, 0, SEEK_END);
+	uint32_t sramSize = ftell(pFile);
+	fseek(pFile, 0, SEEK_SET);
+	
+	SetMapping(mMapping, sramSize);
+	if(sramSize == 0 || fread(mpSRAM, sramSize, 1, pFile) != 1)
+	{
+		printf("SimCart: Failed to read sram '%s'\n", pSRAMFileName);
+		fclose(pFile);
+		return false;
+	}
+	
+	fclose(pFile);
+	pFile = NULL;
+	
+	mpSRAMFileName = pSRAMFileName;
+	printf("SimCart: Loaded sram '%s' (%d bytes)\n", pSRAMFileName, sramSize);
+	return true;
+}
+
+void SimCart::SaveSRAM()
+{
+	if(!mpSRAMFileName || !mpSRAM)
+	{
+		return;
+	}
+	
+	FILE* pFile = fopen(mpSRAMFileName, "wb");
+	if(!pFile)
+	{
+		printf("SimCart: Failed to open sram '%s' for write!\n", mpSRAMFileName);
+		return;
+	}
+	
+	fwrite(mpSRAM, mSRAMSize, 1, pFile);
+	fclose(pFile);
+	pFile = NULL;
+}
+
+bool SimCart::Create(uint32_t romSize)
+{
+	delete[] mpRom;
+	
+	mRomSize = romSize;
+	mpRom = new uint8_t[mRomSize];
+	mTimings = gSlowROMSimTimings;
+	mClockSlackNs = MeasureClockSlackNs();
+	
+	return mRomSize != 0;
+}
+
+void SimCart::SetMapping(RomMapping mapping, uint32_t sramSize)
+{
+	mMapping = mapping;
+	
+	if(sramSize != mSRAMSize)
+	{
+		delete[] mpSRAM;
+		mpSRAM = sramSize ? new uint8_t[sramSize] : nullptr;
+		mSRAMSize = sramSize;
+		
+		// what an SRAM with a flat battery tends to hold
+		if(mpSRAM)
+		{
+			memset(mpSRAM, 0xFF, mSRAMSize);
+		}
+	}
+}
+
+// See https://snes.nesdev.org/wiki/Memory_map. Only the rom and sram are decoded, coprocessor
+// registers and the SA-1/S-DD1 bank switching are left in their power-on state.
+void SimCart::Decode(uint32_t address, bool romSel, int32_t& romOffset, int32_t& sramOffset) const
+{
+	romOffset = -1;
+	sramOffset = -1;
+	
+	uint32_t bank = (address >> 16) & 0xFF;
+	uint32_t addr = address & 0xFFFF;
+	bool a15 = (addr & 0x8000) != 0;
+	
+	switch(mMapping)
+	{
+		case RomMapping::HiROM:
+		case RomMapping::ExHiROM:
+		{
+			// ExHiROM puts the upper 4MB at 40-7D and (A15 high) 00-3F
+			uint32_t upper = (mMapping == RomMapping::ExHiROM && bank < 0x80) ? 0x400000 : 0;
+			
+			if(romSel && ((bank & 0x7F) >= 0x40 || a15))
+			{
+				romOffset = upper | ((bank & 0x3F) << 16) | addr;
+			}
+			else if(!romSel && (bank & 0x60) == 0x20 && (addr & 0xE000) == 0x6000 && (mMapping == RomMapping::HiROM || bank >= 0x80))
+			{
+				sramOffset = ((bank & 0x0F) << 13) | (addr & 0x1FFF);
+			}
+			
+			break;
+		}
+		
+		case RomMapping::SA1:
+		{
+			if(romSel && bank >= 0xC0)
+			{
+				romOffset = ((bank & 0x3F) << 16) | addr;
+			}
+			else if(romSel && bank < 0xC0 && (bank & 0x40) == 0 && a15)
+			{
+				// the 00-3F/80-BF LoROM windows each see 1MB, at 0, 1, 2 and 3MB
+				romOffset = (((bank >> 7) << 21) | ((bank & 0x3F) << 15)) | (addr & 0x7FFF);
+			}
+			else if(romSel && (bank & 0xF0) == 0x40)
+			{
+				sramOffset = ((bank & 0x0F) << 16) | addr;
+			}
+			
+			break;
+		}
+		
+		case RomMapping::SuperFX:
+		{
+			if(romSel && (bank & 0x7F) < 0x40 && a15)
+			{
+				romOffset = ((bank & 0x3F) << 15) | (addr & 0x7FFF);
+			}
+			else if(romSel && (bank & 0x60) == 0x40)
+			{
+				romOffset = ((bank & 0x1F) << 16) | addr;
+			}
+			else if(romSel && (bank & 0x7E) == 0x70)
+			{
+				sramOffset = ((bank & 0x01) << 16) | addr;
+			}
+			
+			break;
+		}
+		
+		case RomMapping::SDD1:
+		{
+			if(romSel && bank >= 0xC0)
+			{
+				romOffset = ((bank & 0x3F) << 16) | addr;
+			}
+			else if(romSel && (bank & 0x7F) < 0x40 && a15)
+			{
+				romOffset = ((bank & 0x3F) << 15) | (addr & 0x7FFF);
+			}
+			else if(romSel && (bank & 0x7F) >= 0x70 && (bank & 0x7F) < 0x7E && !a15)
+			{
+				sramOffset = (((bank & 0x7F) - 0x70) << 15) | addr;
+			}
+			
+			break;
+		}
+		
+		default:
+		{
+			// LoROM: A15 doesn't go to the rom, so 0000-7FFF of a bank is the same 32KB as 8000-FFFF,
+			// apart from 70-7D where a cart with sram puts it below $8000
+			if(romSel && mSRAMSize && (bank & 0x7F) >= 0x70 && (bank & 0x7F) < 0x7E && !a15)
+			{
+				sramOffset = (((bank & 0x7F) - 0x70) << 15) | addr;
+			}
+			else if(romSel)
+			{
+				romOffset = ((bank & 0x7F) << 15) | (addr & 0x7FFF);
+			}
+			
+			break;
+		}
+	}
+	
+	// past the end of the chips it's mirrors
+	if(romOffset >= 0 && mRomSize)
+	{
+		romOffset %= mRomSize;
+	}
+	
+	if(sramOffset >= 0)
+	{
+		sramOffset = mSRAMSize ? (sramOffset % mSRAMSize) : -1;
+	}
+}
+
+bool SimCart::ReadBus(uint32_t address, bool romSel, uint8_t& value) const
+{
+	int32_t romOffset = -1;
+	int32_t sramOffset = -1;
+	Decode(address, romSel, romOffset, sramOffset);
+	
+	if(romOffset >= 0 && mpRom)
+	{
+		value = mpRom[romOffset];
+		return true;
+	}
+	
+	if(sramOffset >= 0 && mpSRAM)
+	{
+		value = mpSRAM[sramOffset];
+		return true;
+	}
+	
+	return false;
+}
+
+void SimCart::UpdateLatch(Latch& latch, uint8_t inputs, bool enabled, uint64_t nowNs)
+{
+	if(inputs != latch.mInputs)
+	{
+		// changing the inputs just after the latch closed can still get caught
+		if(!enabled)
+		{
+			CheckTiming(SimViolation::LatchHold, nowNs - latch.mEnableFellNs, mTimings.mLatchHoldNs);
+		}
+		
+		latch.mInputs = inputs;
+		latch.mInputsChangedNs = nowNs;
+	}
+	
+	// the latches are transparent while their enable is high and hold when it drops
+	if(latch.mEnabled && !enabled)
+	{
+		CheckTiming(SimViolation::LatchSetup, nowNs - latch.mInputsChangedNs, mTimings.mLatchSetupNs);
+		latch.mEnableFellNs = nowNs;
+	}
+	
+	latch.mEnabled = enabled;
+	if(enabled)
+	{
+		latch.mHeld = inputs;
+	}
+}
+
+uint32_t SimCart::Update(uint32_t outputMask, uint32_t pinLevels, uint32_t& driveMask)
+{
+	uint64_t nowNs = GetTimeNs();
+	driveMask = 0;
+	mStale = false;
+	
+	uint32_t address = mShiftedAddress;
+	if(!mAddressShifted)
+	{
+		uint8_t addressLines = AddressPins::FromLevels(pinLevels);
+		uint8_t bankLines = BankAddressPins::FromLevels(pinLevels);
+		
+		UpdateLatch(mAddressLatch, addressLines, (pinLevels & Latch8Thru15Pin::Mask()) != 0, nowNs);
+		UpdateLatch(mBankLatch, bankLines, (pinLevels & Latch16Thru19Pin::Mask()) != 0, nowNs);
+		
+		address = (bankLines << 20) | (mBankLatch.mHeld << 16) | (addressLines << 8) | mAddressLatch.mHeld;
+	}
+	
+	// /ROMSEL is the cart enable line. /WR is the write line itself and /RD comes off an
+	// inverter on it, so /RD lags by the inverter delay. SRAM is only enabled with /RESET high.
+	bool romSel = (pinLevels & CartEnablePin::Mask()) == 0;
+	bool writeLine = (pinLevels & WritePin::Mask()) != 0;
+	bool readEnabled = writeLine;
+	bool writeEnabled = !writeLine;
+	bool sramEnabled = (pinLevels & ResetPin::Mask()) != 0;
+	
+	uint8_t piData = DataPins::FromLevels(pinLevels);
+	if((outputMask & DataPins::Mask()) && piData != mPiData)
+	{
+		mPiData = piData;
+		mPiDataChangedNs = nowNs;
+	}
+	
+	int32_t romOffset = -1;
+	int32_t sramOffset = -1;
+	Decode(address, romSel, romOffset, sramOffset);
+	if(!sramEnabled)
+	{
+		sramOffset = -1;
+	}
+	
+	// out of the slot, or only partly in, nothing on the cart sees the bus
+	mContacting = !mSwapPeriodNs || IsContacting(nowNs);
+	if(!mContacting)
+	{
+		romOffset = -1;
+		sramOffset = -1;
+	}
+	
+	SetAddress(address, nowNs);
+	
+	if(romSel != mRomSel)
+	{
+		mRomSel = romSel;
+		mRomSelChangedNs = nowNs;
+	}
+	
+	if(readEnabled != mReadEnabled)
+	{
+		mReadEnabled = readEnabled;
+		mReadEnabledNs = nowNs + mTimings.mInverterNs;
+	}
+	
+	// an SRAM write lasts as long as /WR is low with the SRAM selected, and the SRAM takes the data
+	// when either of those ends
+	int32_t writeOffset = (writeEnabled && mpSRAM) ? sramOffset : -1;
+	if(writeOffset != mWriteOffset)
+	{
+		if(mWriteOffset >= 0)
+		{
+			CheckTiming(SimViolation::WritePulse, nowNs - mWriteStartNs, mTimings.mWritePulseNs);
+			CheckTiming(SimViolation::WriteDataSetup, nowNs - mPiDataChangedNs, mTimings.mWriteDataSetupNs);
+			
+			mpSRAM[mWriteOffset] = piData;
+		}
+		
+		mWriteOffset = writeOffset;
+		mWriteStartNs = nowNs;
+	}
+	
+	// Both ends driving the data bus. The cart's outputs only come on once /RD has made it through the
+	// inverter, so the Pi can let go of the bus right after raising the write line without a fight.
+	bool piDriving = (outputMask & DataPins::Mask()) != 0;
+	if(mDriving && mPiDriving && nowNs > mDrivingNs)
+	{
+		if(!mContention)
+		{
+			AddViolation(SimViolation::BusContention, nowNs - mDrivingNs);
+		}
+		
+		mContention = true;
+	}
+	else
+	{
+		mContention = false;
+	}
+	
+	uint8_t value = 0;
+	bool driving = readEnabled && (romOffset >= 0 || sramOffset >= 0) && ReadBus(address, romSel, value);
+	if(driving && mFlakyPerMillion && NextRandom() % 1000000 < mFlakyPerMillion)
+	{
+		value ^= 0x1 << (NextRandom() % 8);
+	}
+	if(driving && !mDriving)
+	{
+		mDrivingNs = (mReadEnabledNs > nowNs) ? mReadEnabledNs : nowNs;
+	}
+	
+	mDriving = driving;
+	mPiDriving = piDriving;
+	
+	// the cart's ground plane pulls the sense line low
+	if(mContacting)
+	{
+		driveMask |= CartSensePin::Mask();
+	}
+	
+	if(!mDriving)
+	{
+		return 0;
+	}
+	
+	driveMask |= DataPins::Mask();
+	return DataPins::ToLevels(value);
+}
+
+void SimCart::SetAddress(uint32_t address, uint64_t nowNs)
+{
+	if(address != mAddress)
+	{
+		if(mWriteOffset >= 0)
+		{
+			AddViolation(SimViolation::AddressDuringWrite, 0);
+		}
+		
+		mAddress = address;
+		mAddressChangedNs = nowNs;
+	}
+}
+
+// The pins haven't changed, so what the cart drives back only catches up at the backend's next
+// Update. A serial read writes /ROMSEL after setting the address, which is one, but a pipelined
+// read goes straight from the shift to sampling the data bus, so the backends check IsStale first.
+void SimCart::OnShiftRegistersLatched(uint32_t address)
+{
+	mShiftedAddress = address;
+	mStale = true;
+	SetAddress(address, GetTimeNs());
+}
+
+// chattering contacts make or break every SIM_CHATTER_NS, at random but the same every time it's asked
+#define SIM_CHATTER_NS (1000000ull)
+
+static bool IsChatterTouching(uint64_t phase, uint64_t slot)
+{
+	uint32_t x = (uint32_t)(phase * 2654435761u) ^ (uint32_t)(slot * 40503u) ^ 0x9E3779B9;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	return (x & 0x100) != 0;
+}
+
+void SimCart::SetSwapSchedule(uint32_t periodMs, uint32_t bounceMs, uint32_t glitchMs)
+{
+	mSwapStartNs = GetTimeNs();
+	mSwapPeriodNs = periodMs * 1000000ull;
+	mBounceNs = bounceMs * 1000000ull;
+	mGlitchNs = glitchMs * 1000000ull;
+}
+
+// The schedule goes in phases of half a period, out first, so odd phases are the cart being in.
+bool SimCart::IsContacting(uint64_t nowNs) const
+{
+	if(!mSwapPeriodNs)
+	{
+		return true;
+	}
+	
+	uint64_t halfNs = mSwapPeriodNs / 2;
+	uint64_t sinceNs = (nowNs > mSwapStartNs) ? nowNs - mSwapStartNs : 0;
+	uint64_t phase = sinceNs / halfNs;
+	uint64_t intoNs = sinceNs % halfNs;
+	bool inserted = (phase & 0x1) != 0;
+	
+	if(intoNs < mBounceNs)
+	{
+		return IsChatterTouching(phase, intoNs / SIM_CHATTER_NS);
+	}
+	
+	if((phase & 0x2) && intoNs >= halfNs / 2 && intoNs < halfNs / 2 + mGlitchNs)
+	{
+		return IsChatterTouching(phase, intoNs / SIM_CHATTER_NS);
+	}
+	
+	return inserted;
+}
+
+bool SimCart::IsInserted(uint64_t nowNs) const
+{
+	if(!mSwapPeriodNs)
+	{
+		return true;
+	}
+	
+	uint64_t sinceNs = (nowNs > mSwapStartNs) ? nowNs - mSwapStartNs : 0;
+	return ((sinceNs / (mSwapPeriodNs / 2)) & 0x1) != 0;
+}
+
+uint64_t SimCart::GetLastSwapNs(uint64_t nowNs) const
+{
+	if(!mSwapPeriodNs)
+	{
+		return 0;
+	}
+	
+	uint64_t halfNs = mSwapPeriodNs / 2;
+	uint64_t sinceNs = (nowNs > mSwapStartNs) ? nowNs - mSwapStartNs : 0;
+	return mSwapStartNs + (sinceNs / halfNs) * halfNs;
+}
+
+uint64_t SimCart::GetNextContactChangeNs(uint64_t nowNs) const
+{
+	if(!mSwapPeriodNs)
+	{
+		return UINT64_MAX;
+	}
+	
+	uint64_t halfNs = mSwapPeriodNs / 2;
+	uint64_t sinceNs = (nowNs > mSwapStartNs) ? nowNs - mSwapStartNs : 0;
+	uint64_t phaseStartNs = nowNs - sinceNs % halfNs;
+	uint64_t intoNs = sinceNs % halfNs;
+	uint64_t nextChatterNs = nowNs - intoNs % SIM_CHATTER_NS + SIM_CHATTER_NS;
+	
+	if(intoNs < mBounceNs)
+	{
+		return nextChatterNs;
+	}
+	
+	if(((sinceNs / halfNs) & 0x2) && mGlitchNs)
+	{
+		if(intoNs < halfNs / 2)
+		{
+			return phaseStartNs + halfNs / 2;
+		}
+		
+		if(intoNs < halfNs / 2 + mGlitchNs)
+		{
+			return nextChatterNs;
+		}
+	}
+	
+	return phaseStartNs + halfNs;
+}
+
+void SimCart::OnRead(uint32_t lineMask)
+{
+	if(!mDriving || !(lineMask & DataPins::Mask()))
+	{
+		return;
+	}
+	
+	uint64_t nowNs = GetTimeNs();
+	
+	// the data is only good once the address, /ROMSEL and /RD have all been there long enough
+	uint64_t validNs = mAddressChangedNs + mTimings.mAccessNs;
+	validNs = (mRomSelChangedNs + mTimings.mAccessNs > validNs) ? mRomSelChangedNs + mTimings.mAccessNs : validNs;
+	validNs = (mReadEnabledNs + mTimings.mOutputEnableNs > validNs) ? mReadEnabledNs + mTimings.mOutputEnableNs : validNs;
+	
+	if(nowNs + mClockSlackNs < validNs)
+	{
+		AddViolation(SimViolation::ReadBeforeValid, validNs - nowNs);
+	}
+}
+
+// xorshift32
+uint32_t SimCart::NextRandom()
+{
+	mRandomState ^= mRandomState << 13;
+	mRandomState ^= mRandomState >> 17;
+	mRandomState ^= mRandomState << 5;
+	return mRandomState;
+}
+
+void SimCart::CheckTiming(SimViolation violation, uint64_t elapsedNs, uint32_t requiredNs)
+{
+	if(elapsedNs + mClockSlackNs < requiredNs)
+	{
+		AddViolation(violation, requiredNs - elapsedNs);
+	}
+}
+
+void SimCart::AddViolation(SimViolation violation, uint64_t byNs)
+{
+	uint32_t& count = mViolationCounts[(uint32_t)violation];
+	
+	// the first few are worth seeing, after that it's the counts that matter
+	if(count < 4)
+	{
+		printf("SimCart: %s at %06X (%lluns short)\n", gViolationNames[(uint32_t)violation], mAddress, (unsigned long long)byNs);
+	}
+	
+	count++;
+}
+
+uint32_t SimCart::GetNumViolations() const
+{
+	uint32_t numViolations = 0;
+	for(uint32_t i = 0; i < (uint32_t)SimViolation::Count; i++)
+	{
+		numViolations += mViolationCounts[i];
+	}
+	
+	return numViolations;
+}
+
+void SimCart::PrintViolations() const
+{
+	printf("SimCart: %d timing violations\n", GetNumViolations());
+	
+	for(uint32_t i = 0; i < (uint32_t)SimViolation::Count; i++)
+	{
+		if(mViolationCounts[i])
+		{
+			printf("  %-30s %d\n", gViolationNames[i], mViolationCounts[i]);
+		}
+	}
+}
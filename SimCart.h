@@ -0,0 +1,181 @@
+#pragma once
+
+#include <cstdint>
+
+#include "BusTiming.h"
+#include "RomManager.h"
+
+// Timing the sim cart holds the Pi to, from the 74HC373, 74HC04 and typical SNES rom/SRAM data sheets.
+struct SimTimings
+{
+	// 74HC373: address steady before the latch enable drops, and after
+	uint32_t mLatchSetupNs;
+	uint32_t mLatchHoldNs;
+	
+	// 74HC04 between the write line and /RD
+	uint32_t mInverterNs;
+	
+	// rom/sram address (or /ROMSEL) to data valid, and /RD to data valid
+	uint32_t mAccessNs;
+	uint32_t mOutputEnableNs;
+	
+	// SRAM: /WR low time, and data steady before /WR goes back up
+	uint32_t mWritePulseNs;
+	uint32_t mWriteDataSetupNs;
+};
+
+enum class SimViolation
+{
+	LatchSetup,
+	LatchHold,
+	ReadBeforeValid,
+	BusContention,
+	WritePulse,
+	WriteDataSetup,
+	AddressDuringWrite,
+	Count
+};
+
+// A cart on the far side of the address latches, backed by a rom image (and optionally an SRAM
+// image), so the bus code can run on a host with no Pi or cart attached. It only ever sees pin
+// levels, so it can sit behind any backend that can tell it what the Pi is driving.
+//
+// Every pin change is timestamped, and anything that would be too fast for the real chips
+// (latching before the address settled, sampling the data bus before the rom could have driven it,
+// a short /WR pulse, both ends driving the data bus) is counted as a violation, so a change to
+// the bus timing can be checked without a cart. Times are real CLOCK_MONOTONIC times, so only
+// delays that are too short get flagged; being preempted just makes everything slower.
+class SimCart
+{
+public:
+	~SimCart();
+	
+	// Loads a rom image and picks the mapping from its header.
+	bool Load(const char* pRomFileName);
+	
+	// Loads the SRAM contents, which replaces the size from the header. They're written back
+	// to the same file by SaveSRAM.
+	bool LoadSRAM(const char* pSRAMFileName);
+	void SaveSRAM();
+	
+	// An empty image of romSize bytes to fill in through GetRom, for tests.
+	bool Create(uint32_t romSize);
+	uint8_t* GetRom() { return mpRom; }
+	
+	void SetMapping(RomMapping mapping, uint32_t sramSize);
+	
+	// What the cart's own decoding does with a bus address: the rom or sram offset it selects, or -1.
+	void Decode(uint32_t address, bool romSel, int32_t& romOffset, int32_t& sramOffset) const;
+	
+	// Returns false if nothing on the cart drives the data bus for this access.
+	bool ReadBus(uint32_t address, bool romSel, uint8_t& value) const;
+	
+	// outputMask is the pins the Pi is driving, pinLevels the level of every pin.
+	// Returns the levels the cart drives back, with the pins it's driving in driveMask.
+	uint32_t Update(uint32_t outputMask, uint32_t pinLevels, uint32_t& driveMask);
+	
+	// The Pi is sampling lineMask right now.
+	void OnRead(uint32_t lineMask);
+	
+	uint32_t GetNumViolations() const;
+	void PrintViolations() const;
+	
+	// Flips a data bit in about perMillion of the reads the cart answers, like a dirty contact.
+	void SetFlakiness(uint32_t perMillion) { mFlakyPerMillion = perMillion; }
+	
+	// With the address on 74HC595s (see SimSpiDevice) the latches and the address pins are out of
+	// the picture and the address only changes when the 595s' storage registers are clocked.
+	void SetAddressShifted(bool shifted) { mAddressShifted = shifted; }
+	void OnShiftRegistersLatched(uint32_t address);
+	
+	// Whether the cart's outputs have moved on since the last Update without any pin changing, in
+	// which case the backend has to Update again before it samples them.
+	bool IsStale() const { return mStale || (mSwapPeriodNs && IsContacting(GetTimeNs()) != mContacting); }
+	
+	// Takes the cart out and puts it back in over and over from now, for checking CartDetector: out
+	// for half of periodMs, in for the other half. For bounceMs after each change the contacts
+	// chatter, and every other time it's out (or in) the cart gets knocked for glitchMs halfway
+	// through, touching (or losing) the contacts on and off without going in (or coming out).
+	// A cart that isn't touching drives nothing, and a cart that is grounds CartSensePin. A periodMs
+	// of 0 leaves it in for good.
+	void SetSwapSchedule(uint32_t periodMs, uint32_t bounceMs, uint32_t glitchMs);
+	
+	// Whether the cart is in at nowNs (a GetTimeNs) as far as a detector ought to be concerned, from the start of
+	// going in to the start of coming out, and when the latest of those started.
+	bool IsInserted(uint64_t nowNs) const;
+	uint64_t GetLastSwapNs(uint64_t nowNs) const;
+	
+	// The next time after nowNs the contacts could change, so a backend can sleep until then the way
+	// it would on an edge interrupt.
+	uint64_t GetNextContactChangeNs(uint64_t nowNs) const;
+	
+private:
+	struct Latch
+	{
+		uint8_t mHeld = 0;
+		uint8_t mInputs = 0;
+		bool mEnabled = false;
+		uint64_t mInputsChangedNs = 0;
+		uint64_t mEnableFellNs = 0;
+	};
+	
+	bool IsContacting(uint64_t nowNs) const;
+	void UpdateLatch(Latch& latch, uint8_t inputs, bool enabled, uint64_t nowNs);
+	void SetAddress(uint32_t address, uint64_t nowNs);
+	void CheckTiming(SimViolation violation, uint64_t elapsedNs, uint32_t requiredNs);
+	void AddViolation(SimViolation violation, uint64_t byNs);
+	uint32_t NextRandom();
+	
+private:
+	uint8_t* mpRom = nullptr;
+	uint32_t mRomSize = 0;
+	
+	uint8_t* mpSRAM = nullptr;
+	const char* mpSRAMFileName = nullptr;
+	
+	RomMapping mMapping = RomMapping::LoROM;
+	uint32_t mSRAMSize = 0;
+	SimTimings mTimings;
+	uint32_t mClockSlackNs = 0;
+	
+	// the two 74HC373s
+	Latch mAddressLatch;
+	Latch mBankLatch;
+	
+	// or the 595s, and what they last latched
+	bool mAddressShifted = false;
+	uint32_t mShiftedAddress = 0;
+	bool mStale = false;
+	
+	// what the cart sees, and when it last changed
+	uint32_t mAddress = 0;
+	uint64_t mAddressChangedNs = 0;
+	bool mRomSel = false;
+	uint64_t mRomSelChangedNs = 0;
+	bool mReadEnabled = false;
+	uint64_t mReadEnabledNs = 0;
+	uint8_t mPiData = 0;
+	uint64_t mPiDataChangedNs = 0;
+	bool mPiDriving = false;
+	
+	// the SRAM offset being written while /WR is low, or -1
+	int32_t mWriteOffset = -1;
+	uint64_t mWriteStartNs = 0;
+	
+	// whether the cart is driving the data bus, and since when
+	bool mDriving = false;
+	uint64_t mDrivingNs = 0;
+	bool mContention = false;
+	
+	uint32_t mViolationCounts[(uint32_t)SimViolation::Count] = { 0 };
+	
+	// the swap schedule, and whether the contacts were touching at the last Update
+	uint64_t mSwapStartNs = 0;
+	uint64_t mSwapPeriodNs = 0;
+	uint64_t mBounceNs = 0;
+	uint64_t mGlitchNs = 0;
+	bool mContacting = true;
+	
+	uint32_t mFlakyPerMillion = 0;
+	uint32_t mRandomState = 0x2545F491;
+};
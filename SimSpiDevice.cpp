@@ -0,0 +1,40 @@
+#include "SimSpiDevice.h"
+
+#include "SimCart.h"
+
+SimSpiDevice::SimSpiDevice(SimCart* pSimCart) : mpSimCart(pSimCart)
+{
+}
+
+bool SimSpiDevice::Open()
+{
+	if(!mpSimCart)
+	{
+		return false;
+	}
+	
+	mpSimCart->SetAddressShifted(true);
+	return true;
+}
+
+void SimSpiDevice::Close()
+{
+	if(mpSimCart)
+	{
+		mpSimCart->SetAddressShifted(false);
+	}
+}
+
+bool SimSpiDevice::Write(const uint8_t* pData, uint32_t size)
+{
+	// every bit moves the chain along one, most significant bit first, so what was shifted in first
+	// ends up furthest down the chain
+	for(uint32_t i = 0; i < size; i++)
+	{
+		mShiftRegister = ((mShiftRegister << 8) | pData[i]) & 0xFFFFFF;
+	}
+	
+	// chip select going back up is RCLK
+	mpSimCart->OnShiftRegistersLatched(mShiftRegister);
+	return true;
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include "SpiDevice.h"
+
+class SimCart;
+
+// Stands in for spidev with a chain of three 74HC595s on the end of it, wired to a SimCart's
+// address pins the way AddressShifter expects, so --address-spi=sim runs the shift register
+// address path against the sim cart on any host.
+class SimSpiDevice final : public SpiDevice
+{
+public:
+	SimSpiDevice(SimCart* pSimCart);
+	
+	bool Open() override;
+	void Close() override;
+	
+	bool Write(const uint8_t* pData, uint32_t size) override;
+	
+private:
+	SimCart* mpSimCart = nullptr;
+	
+	// the 595s' shift registers, first 595 in the low byte. Only the last 24 bits shifted in survive.
+	uint32_t mShiftRegister = 0;
+};
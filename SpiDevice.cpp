@@ -0,0 +1,70 @@
+#include "SpiDevice.h"
+
+#include <cstring>
+#include <fcntl.h>
+#include <linux/spi/spidev.h>
+#include <stdio.h>
+#include <sys/ioctl.h>
+#include <unistd.h>
+
+SpidevDevice::SpidevDevice(const char* pDeviceName, uint32_t speedHz) : mpDeviceName(pDeviceName), mSpeedHz(speedHz)
+{
+}
+
+SpidevDevice::~SpidevDevice()
+{
+	Close();
+}
+
+bool SpidevDevice::Open()
+{
+	mFile = open(mpDeviceName, O_RDWR);
+	if(mFile == -1)
+	{
+		printf("SpidevDevice: Failed to open '%s' (is dtparam=spi=on set?)\n", mpDeviceName);
+		return false;
+	}
+	
+	// the 595s shift on the rising edge of SRCLK, so mode 0, most significant bit first
+	uint8_t mode = SPI_MODE_0;
+	uint8_t bitsPerWord = 8;
+	
+	if(ioctl(mFile, SPI_IOC_WR_MODE, &mode) == -1 || ioctl(mFile, SPI_IOC_WR_BITS_PER_WORD, &bitsPerWord) == -1 ||
+		ioctl(mFile, SPI_IOC_WR_MAX_SPEED_HZ, &mSpeedHz) == -1)
+	{
+		printf("SpidevDevice: Failed to set up '%s'\n", mpDeviceName);
+		Close();
+		return false;
+	}
+	
+	mNumKernelCalls += 3;
+	return true;
+}
+
+void SpidevDevice::Close()
+{
+	if(mFile != -1)
+	{
+		close(mFile);
+		mFile = -1;
+	}
+}
+
+bool SpidevDevice::Write(const uint8_t* pData, uint32_t size)
+{
+	spi_ioc_transfer transfer;
+	memset(&transfer, 0, sizeof(transfer));
+	transfer.tx_buf = (uintptr_t)pData;
+	transfer.len = size;
+	transfer.speed_hz = mSpeedHz;
+	transfer.bits_per_word = 8;
+	
+	mNumKernelCalls++;
+	if(ioctl(mFile, SPI_IOC_MESSAGE(1), &transfer) != (int)size)
+	{
+		printf("SpidevDevice: Write to '%s' failed\n", mpDeviceName);
+		return false;
+	}
+	
+	return true;
+}
@@ -0,0 +1,45 @@
+#pragma once
+
+#include <cstdint>
+
+// An SPI bus with one device on it, write only. Chip select is asserted for the whole of each
+// Write and released at the end of it, which is what clocks a chain of 74HC595s' storage
+// registers (see AddressShifter).
+class SpiDevice
+{
+public:
+	virtual ~SpiDevice() {}
+	
+	virtual bool Open() = 0;
+	virtual void Close() = 0;
+	
+	virtual bool Write(const uint8_t* pData, uint32_t size) = 0;
+	
+	// trips into the kernel so far, the same as GPIOBackend's
+	uint64_t GetNumKernelCalls() const
+	{
+		return mNumKernelCalls;
+	}
+	
+protected:
+	uint64_t mNumKernelCalls = 0;
+};
+
+// The Pi's SPI peripheral through /dev/spidevB.C. Each Write is one SPI_IOC_MESSAGE, which the
+// controller driver does by DMA once it's long enough.
+class SpidevDevice final : public SpiDevice
+{
+public:
+	SpidevDevice(const char* pDeviceName, uint32_t speedHz);
+	~SpidevDevice();
+	
+	bool Open() override;
+	void Close() override;
+	
+	bool Write(const uint8_t* pData, uint32_t size) override;
+	
+private:
+	const char* mpDeviceName = nullptr;
+	uint32_t mSpeedHz = 0;
+	int mFile = -1;
+};
@@ -0,0 +1,62 @@
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+
+// A fixed size ring for exactly one thread pushing and one popping, with no locks: each side only
+// ever stores its own index, so neither can be held up by the other being descheduled mid-operation.
+// That's what lets the bus thread hand things off without ever blocking on a mutex (see Realtime.h).
+// Size has to be a power of two.
+template<typename T, uint32_t Size>
+class SpscQueue
+{
+	static_assert((Size & (Size - 1)) == 0, "SpscQueue size has to be a power of two");
+	
+public:
+	// false if it's full
+	bool Push(const T& value)
+	{
+		uint32_t tail = mTail.load(std::memory_order_relaxed);
+		if(tail - mHead.load(std::memory_order_acquire) == Size)
+		{
+			return false;
+		}
+		
+		mItems[tail & (Size - 1)] = value;
+		mTail.store(tail + 1, std::memory_order_release);
+		return true;
+	}
+	
+	// false if it's empty
+	bool Pop(T& value)
+	{
+		uint32_t head = mHead.load(std::memory_order_relaxed);
+		if(head == mTail.load(std::memory_order_acquire))
+		{
+			return false;
+		}
+		
+		value = mItems[head & (Size - 1)];
+		mHead.store(head + 1, std::memory_order_release);
+		return true;
+	}
+	
+	bool IsEmpty() const
+	{
+		return mHead.load(std::memory_order_acquire) == mTail.load(std::memory_order_acquire);
+	}
+	
+	// Only safe while neither side is using it
+	void Clear()
+	{
+		mHead.store(0, std::memory_order_relaxed);
+		mTail.store(0, std::memory_order_relaxed);
+	}
+	
+private:
+	T mItems[Size];
+	
+	// on their own cache lines so the two sides aren't fighting over one
+	alignas(64) std::atomic<uint32_t> mHead{0};
+	alignas(64) std::atomic<uint32_t> mTail{0};
+};
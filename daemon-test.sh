@@ -0,0 +1,103 @@
+#!/bin/sh
+# Checks copyromd end to end over its socket against the simulated cart, so it runs on any Linux
+# box without a Pi or a cart:
+#
+#   make && ./daemon-test.sh [path to copyrom] [rom the sim cart is backed by]
+#
+# It starts a daemon on the sim backend in a scratch directory and then, through the client, probes,
+# dumps and compares with the rom, round trips the SRAM, ejects and dumps again, queues two dumps at
+# once, cancels a dump part way and checks bad requests get turned down. Stops at the first thing that fails.
+
+COPYROM=$(realpath "${1:-./copyrom}")
+ROM=$(realpath "${2:-smw.smc}")
+DIR=$(mktemp -d)
+SOCKET=$DIR/copyromd.sock
+
+cd "$DIR" || exit 1
+
+# slowed down so there's time to cancel a dump before it's done
+"$COPYROM" --backend=sim --cart="$ROM" --delay-scale=300 --socket="$SOCKET" --daemon > daemon.log 2>&1 &
+DAEMON=$!
+
+client()
+{
+	"$COPYROM" --socket="$SOCKET" --client "$@"
+}
+
+fail()
+{
+	echo "FAIL: $*"
+	kill $DAEMON 2> /dev/null
+	wait $DAEMON
+	tail -n 20 daemon.log
+	echo "(left everything in $DIR)"
+	exit 1
+}
+
+for i in $(seq 50); do
+	[ -S "$SOCKET" ] && break
+	sleep 0.1
+done
+[ -S "$SOCKET" ] || fail "daemon never started listening"
+
+client status | grep -q "cart not probed" || fail "status before probing"
+client probe > probe.txt || fail "probe"
+SRAM_SIZE=$(( $(sed -n 's/.*, \([0-9]*\)KB sram.*/\1/p' probe.txt) * 1024 ))
+echo "probe: $(cat probe.txt)"
+
+client dump smw > /dev/null || fail "dump"
+cmp -s smw.smc "$ROM" || fail "dump doesn't match the rom"
+client status | grep -q "^done 2, failed 0" || fail "status after the dump"
+echo "dump: ok"
+
+if [ $SRAM_SIZE -gt 0 ]; then
+	head -c $SRAM_SIZE /dev/urandom > mine.srm
+	client write-sram smw mine.srm > /dev/null || fail "write-sram"
+	client read-sram smw back.srm > /dev/null || fail "read-sram"
+	cmp -s mine.srm back.srm || fail "SRAM didn't read back as written"
+	head -c 16 /dev/urandom > short.srm
+	client write-sram smw short.srm > /dev/null && fail "write-sram of the wrong size"
+	echo "sram: ok"
+fi
+
+# the next job after an eject probes the cart again before it runs
+client eject > /dev/null || fail "eject"
+client status | grep -q "cart not probed" || fail "status after the eject"
+client dump again again.smc > /dev/null || fail "dump after the eject"
+cmp -s again.smc "$ROM" || fail "dump after the eject doesn't match the rom"
+client status | grep -q "^cart '" || fail "status after probing again"
+echo "eject: ok"
+
+# both queue on the one bus and both come back whole
+client dump a a.smc > a.txt &
+A=$!
+client dump b b.smc > b.txt || fail "second of two queued dumps"
+wait $A || fail "first of two queued dumps"
+cmp -s a.smc "$ROM" && cmp -s b.smc "$ROM" || fail "queued dumps don't match the rom"
+echo "queue: ok"
+
+client dump c c.smc > c.txt &
+C=$!
+for i in $(seq 100); do
+	client status | grep -q "^running 'dump c', DumpROM [1-9]" && break
+	sleep 0.05
+done
+client cancel > /dev/null || fail "cancel"
+wait $C && fail "cancelled dump still finished"
+grep -q "cancelled" c.txt || fail "cancelled dump didn't say so"
+[ -e c.smc.journal ] || fail "cancelled dump didn't leave a journal"
+client cancel > /dev/null && fail "cancel with nothing running"
+echo "cancel: ok"
+
+client bogus > /dev/null && fail "unknown command"
+client dump > /dev/null && fail "dump without a name"
+client dump ../escape > /dev/null && fail "name with a /"
+echo "bad requests: ok"
+
+kill -TERM $DAEMON
+wait $DAEMON
+[ -e "$SOCKET" ] && fail "socket left behind"
+grep -q "SimCart: 0 timing violations" daemon.log || fail "timing violations"
+
+echo "PASS"
+rm -rf "$DIR"
@@ -0,0 +1,27 @@
+#!/bin/sh
+# Sets up a kernel gpio-sim chip with enough lines for our pin map (GPIO0 - GPIO27) so the bus
+# code can be checked on a stock Linux box without a Pi. Needs root and CONFIG_GPIO_SIM.
+#
+#   sudo ./gpio-sim.sh            create the chip and print its name
+#   ./copyrom --chip=gpiochipN --address 1234
+#   cat /sys/devices/platform/gpio-sim.*/gpiochipN/sim_gpio2/value
+#   sudo ./gpio-sim.sh remove     tear it down again
+#
+# Inputs can be driven from the "cart" side by writing pull-up or pull-down to sim_gpioX/pull.
+
+SIM=/sys/kernel/config/gpio-sim/copyrom
+
+if [ "$1" = "remove" ]; then
+	echo 0 > $SIM/live
+	rmdir $SIM/bank0
+	rmdir $SIM
+	exit 0
+fi
+
+modprobe gpio-sim || exit 1
+
+mkdir -p $SIM/bank0
+echo 28 > $SIM/bank0/num_lines
+echo 1 > $SIM/live
+
+echo "gpio-sim chip: $(cat $SIM/bank0/chip_name)"
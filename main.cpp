@@ -18,632 +18,735 @@
 	
 #include <cstring>
 #include <cstdint>
-#include <gpiod.h>
 #include <stdio.h>
+#include <thread>
+#include <time.h>
 #include <unistd.h>
 #include <iostream>
 
-//todo: put in RomManager.h
-#define MAX_ROM_INFOS (2)
-struct RomInfo
+#include "Batch.h"
+#include "Bench.h"
+#include "BusTiming.h"
+#include "CartBus.h"
+#include "CartDetector.h"
+#include "ChunkWriter.h"
+#include "Crc32.h"
+#include "Daemon.h"
+#include "DumpHasher.h"
+#include "DumpJournal.h"
+#include "GPIOManager.h"
+#include "GPIODBackend.h"
+#include "Mapper.h"
+#include "MirrorDetector.h"
+#include "MMIOBackend.h"
+#include "PinMap.h"
+#include "Progress.h"
+#include "ReadVerifier.h"
+#include "Realtime.h"
+#include "RomDatabase.h"
+#include "SimBackend.h"
+#include "SimSpiDevice.h"
+#include "SpiDevice.h"
+#include "RomManager.h"
+#include "SimCart.h"
+
+GPIOBackend* gpBackend = nullptr;
+
+
+uint8_t gSRAMBuffer[MAX_SRAM_SIZE] = {0};
+
+void WriteReadRAMTest()
 {
-public:
-	RomInfo() : mSRAMSize(0)
+	// Use with the 15bit addressable ram chip.
+	
+	for(uint32_t i = 0; i < 65536; i++)
 	{
-		memset(mRomName, 0, sizeof(mRomName));
+		uint32_t address = i;
+		uint32_t writeValue = i % 256;
+		
+		 // write
+		 LOG("---Write---");
+		 LOG("Setting write enable high");
+		 gWriteEnable.Write(1);
+		 usleep(10);
+		 
+		 LOG("Setting data hiZ");
+		 gDataLines.HiZ();
+		 usleep(10);
+		
+		 printf("Setting address 0%x\n", address);
+		 gAddressLines.SetAddress(address);
+		 usleep(10);
+		 
+		 LOG("Setting write enable low");
+		 gWriteEnable.Write(0);
+		 usleep(10);
+		
+		 printf("Writing value: 0%x\n", writeValue);
+		 gDataLines.Write(writeValue);
+		 usleep(10);
+		
+		 LOG("Setting write enable high");
+		 gWriteEnable.Write(1);
+		 usleep(10);
+		 
+		 LOG("Setting data hiZ");
+		 gDataLines.HiZ();
+		 usleep(10);
 	}
-	
-	char mRomName[256];
-	uint32_t mSRAMSize;	
-};
-
-uint32_t gNumRomInfos = 0;
-RomInfo gRomInfos[MAX_ROM_INFOS];
+	 
+	 for(uint32_t i = 0; i < 65536; i++)
+	 {
+		uint32_t address = i;
+		
+		 // read
+		 LOG("---Read---");
+		 LOG("Setting write enable high");
+		 gWriteEnable.Write(1);
+		 usleep(10);
+		
+		 printf("Setting address 0%x\n", address);
+		 gAddressLines.SetAddress(address);
+		 usleep(10);
+		 
+		 LOG("Setting data hiZ");
+		 gDataLines.HiZ();
+		 usleep(10);
+		
+		 LOG("Reading");
+		 uint8_t value = gDataLines.Read();
+		 printf("Value at dataline: %x\n", value);
+		 usleep(10);
+		 
+		 if(value != i % 256)
+		 {
+			 printf("*****THIS DOES NOT MATCH******\n");
+			 return;
+		 }
+		 
+		 LOG("Setting data hiZ");
+		 gDataLines.HiZ();
+		 usleep(10);
+	 }
+	 
+	 printf("*****ALL VALUES MATCH******\n");
+}
 
-bool AddRomInfo(const char* pRomName, uint32_t sramSize)
+// Writes out the bus trace (with --verbose-trace) if the backend reported errors during an
+// operation or the operation itself failed. Otherwise the trace is just thrown away.
+void FinishTrace(RomInfo* pRomInfo, uint32_t numErrorsBefore, bool failed)
 {
-	if(gNumRomInfos + 1 > MAX_ROM_INFOS)
+	if(!gTrace.IsEnabled())
 	{
-		printf("AddRomInfo: Cannot add more roms. Increase MAX_ROM_INFOS which is size: %d\n", MAX_ROM_INFOS);
-		return false;
+		return;
 	}
 	
-	strcpy(gRomInfos[gNumRomInfos].mRomName, pRomName);
-	gRomInfos[gNumRomInfos].mSRAMSize = sramSize;
-	
-	gNumRomInfos++;
-	return true;
+	if(failed || gpBackend->GetNumErrors() != numErrorsBefore)
+	{
+		char traceFileName[300] = { 0 };
+		snprintf(traceFileName, sizeof(traceFileName) - 1, "./%s.trace", pRomInfo->mRomName);
+		
+		gTrace.Dump(traceFileName);
+	}
 }
 
-bool CreateRomInfos()
+// Reads size bytes of SRAM starting at offset into pData. bytesDone counts them for the progress report.
+static void ReadSRAMRange(const Mapper* pMapper, uint32_t offset, uint32_t size, uint8_t* pData, uint32_t& bytesDone)
 {
-	// Final Fantasy 2 (ff2)
-	if(!AddRomInfo("ff2", 8192)) return false;
-	
-	// Super Mario World
-	if(!AddRomInfo("smw", 1024)) return false;
+	BusRun runs[MAX_BUS_RUNS];
 	
-	return true;
+	for(uint32_t i = 0; i < size;)
+	{
+		uint32_t numRuns = pMapper->GetSRAMBatch(offset + i, size - i, runs, MAX_BUS_RUNS);
+		for(uint32_t r = 0; r < numRuns; r++)
+		{
+			ReadCartRun(runs[r], pData + i);
+			
+			for(uint32_t a = 0; a < runs[r].mLength; a++, i++, bytesDone++)
+			{
+				uint32_t address = runs[r].mAddress + a;
+				
+				gTrace.Record(TraceOp::ReadSRAM, address, pData[i]);
+				
+				gProgress.Update(bytesDone, address);
+			}
+		}
+	}
 }
 
-RomInfo* GetRomInfo(const char* pRomName)
+// Writes size bytes from pData to SRAM starting at offset.
+static void WriteSRAMRange(const Mapper* pMapper, uint32_t offset, uint32_t size, const uint8_t* pData, uint32_t& bytesDone)
 {
-	for(uint32_t i = 0; i < gNumRomInfos; i++)
+	BusRun runs[MAX_BUS_RUNS];
+	
+	for(uint32_t i = 0; i < size;)
 	{
-		if(!strcmp(gRomInfos[i].mRomName, pRomName))
+		uint32_t numRuns = pMapper->GetSRAMBatch(offset + i, size - i, runs, MAX_BUS_RUNS);
+		for(uint32_t r = 0; r < numRuns; r++)
 		{
-			return &gRomInfos[i];
+			WriteCartRun(runs[r], pData + i);
+			
+			for(uint32_t a = 0; a < runs[r].mLength; a++, i++, bytesDone++)
+			{
+				uint32_t address = runs[r].mAddress + a;
+				
+				gTrace.Record(TraceOp::WriteSRAM, address, pData[i]);
+				
+				gProgress.Update(bytesDone, address);
+			}
 		}
 	}
-	
-	return nullptr;
 }
-//
 
-// todo: put in GPIOManager.h
-static const char gRequestingProgram[] = "CopyRom";
+// what's on the cart, for --sram-diff
+uint8_t gCartSRAMBuffer[MAX_SRAM_SIZE] = {0};
 
-#define LOG(a) printf("%s: %s\n", __FUNCTION__, (a))
+// from the command line, see ParseOptions
+bool gSRAMDiff = false;
 
-class GPIOLine
+// Reads the cart's SRAM, then only writes the runs of bytes that differ from gSRAMBuffer and reads
+// those back to check them. A save that changed a few bytes costs a read and a handful of writes.
+// The read and the writes are reported as two goes, since how much there is to write isn't known
+// until the read is done. Returns false if anything didn't read back as written.
+static bool WriteSRAMDiff(const Mapper* pMapper, uint32_t sramSize)
 {
-public:
-	void Create(gpiod_chip* pChip, uint32_t gpioLineNum)
-	{
-		if(!pChip)
-		{
-			LOG("Invalid chip passed.");
-			return;
-		}
-		
-		mpChip = pChip;
-		mGPIOLineNum = gpioLineNum;
-	}
+	gProgress.Begin("ReadSRAM", sramSize);
+	uint32_t bytesDone = 0;
 	
-	void HiZ()
-	{
-		ConfigForHiZ();
-	}
+	ReadSRAMRange(pMapper, 0, sramSize, gCartSRAMBuffer, bytesDone);
+	gProgress.End(bytesDone);
 	
-	void Write(uint8_t bit)
+	uint32_t numToWrite = 0;
+	for(uint32_t i = 0; i < sramSize; i++)
 	{
-		ConfigForOutput();
-		
-		int32_t result = gpiod_line_set_value(mpLine, (bit & 0x1));
-		if(result == -1)
-		{
-			LOG("Failed to write to line.");
-		}
+		numToWrite += (gCartSRAMBuffer[i] != gSRAMBuffer[i]) ? 1 : 0;
 	}
 	
-	int8_t Read()
-	{
-		ConfigForInput();
-		
-		int8_t value = gpiod_line_get_value(mpLine);
-		if(value > -1)
-		{
-			return value & 0x1;
-		}
-		else
-		{
-			LOG("Failed to read value for line.");
-			return -1;
-		}
-	}
+	// each of them is written and then read back
+	gProgress.Begin("WriteSRAM", numToWrite * 2);
+	bytesDone = 0;
 	
-	void Release()
-	{
-		if(mpLine)
-		{
-			gpiod_line_release(mpLine);
-			mpLine = nullptr;
-		}
-	}
+	uint32_t numChanged = 0;
+	uint32_t numRuns = 0;
+	uint32_t numBad = 0;
 	
-	~GPIOLine()
+	for(uint32_t i = 0; i < sramSize;)
 	{
-		if(mpLine)
+		if(gCartSRAMBuffer[i] == gSRAMBuffer[i])
 		{
-			gpiod_line_release(mpLine);
+			i++;
+			continue;
 		}
 		
-		mpLine = nullptr;
-		mpChip = nullptr;
-	}
-	
-private:
-	bool OpenLine()
-	{
-		if(!mpChip)
+		uint32_t start = i;
+		while(i < sramSize && gCartSRAMBuffer[i] != gSRAMBuffer[i])
 		{
-			LOG("Chip invalid");
-			return false;
+			i++;
 		}
 		
-		if(mGPIOLineNum < 0)
+		WriteSRAMRange(pMapper, start, i - start, gSRAMBuffer + start, bytesDone);
+		ReadSRAMRange(pMapper, start, i - start, gCartSRAMBuffer + start, bytesDone);
+		
+		for(uint32_t j = start; j < i; j++)
 		{
-			LOG("GPIOLineNum not set");
-			return false;
+			if(gCartSRAMBuffer[j] != gSRAMBuffer[j])
+			{
+				RealtimeLog("\nWriteSRAM: %04X reads back %02X, wrote %02X", j, gCartSRAMBuffer[j], gSRAMBuffer[j]);
+				numBad++;
+			}
 		}
 		
-		mpLine = gpiod_chip_get_line(mpChip, mGPIOLineNum);
-		return mpLine != nullptr;
+		numChanged += i - start;
+		numRuns++;
 	}
 	
-	void ConfigForOutput()
+	gProgress.End(bytesDone);
+	
+	RealtimeLog("WriteSRAM: %d of %d bytes differed, in %d runs\n", numChanged, sramSize, numRuns);
+	if(numBad)
 	{
-		if(mDirection != Direction::Output)
-		{
-			mDirection = Direction::Output;
-			
-			Release();
-			
-			if(!OpenLine())
-			{
-				LOG("Failed to open line.");
-				return;
-			}
-			
-			int32_t result = gpiod_line_request_output(mpLine, gRequestingProgram, 0);
-			if(result == -1)
-			{
-				LOG("Failed to set line to output.");
-			}
-		}
+		RealtimeLog("WriteSRAM: %d bytes didn't read back as written\n", numBad);
 	}
 	
-	void ConfigForInput()
+	return numBad == 0;
+}
+
+bool WriteSRAM(RomInfo* pRomInfo)
+{
+	char sramFileName[300] = { 0 };
+	snprintf(sramFileName, sizeof(sramFileName) - 1, "./%s.srm", pRomInfo->mRomName);
+		
+	FILE* pFile = fopen(sramFileName, "rb");
+	if(!pFile)
 	{
-		if(mDirection != Direction::Input)
-		{
-			mDirection = Direction::Input;
-			
-			Release();
-			
-			if(!OpenLine())
-			{
-				LOG("Failed to open line.");
-				return;
-			}
-			
-			int32_t result = gpiod_line_request_input_flags(mpLine, gRequestingProgram, GPIOD_LINE_REQUEST_FLAG_BIAS_PULL_DOWN);
-			if(result == -1)
-			{
-				LOG("Failed to set line to input.");
-			}
-		}
+		printf("Failed to open file '%s' for read!\n", sramFileName);
+		return false;
+	}
+	
+	// short, and the rest of gSRAMBuffer is whatever the last cart left in it
+	uint32_t numRead = fread(gSRAMBuffer, 1, pRomInfo->mSRAMSize, pFile);
+	fclose(pFile);
+	pFile = NULL;
+	
+	if(numRead != pRomInfo->mSRAMSize)
+	{
+		printf("WriteSRAM: '%s' has %d bytes, the cart has %d bytes of SRAM\n", sramFileName, numRead, pRomInfo->mSRAMSize);
+		return false;
 	}
 	
-	void ConfigForHiZ()
+	uint32_t numErrorsBefore = gpBackend->GetNumErrors();
+	const Mapper* pMapper = GetMapper(pRomInfo->mMapping);
+	bool failed = false;
+	
+	// only the bus work goes on the bus thread, the files are this thread's
+	RunBusCommand([&]
 	{
-		if(mDirection != Direction::HiZ)
+		usleep(1);
+		if(gSRAMDiff)
 		{
-			mDirection = Direction::HiZ;
-			
-			Release();
-			
-			if(!OpenLine())
-			{
-				LOG("Failed to open line.");
-				return;
-			}
-			
-			int32_t result = gpiod_line_request_input_flags(mpLine, gRequestingProgram, GPIOD_LINE_REQUEST_FLAG_BIAS_PULL_UP);
-			//int32_t result = gpiod_line_request_input(mpLine, gRequestingProgram);
-			if(result == -1)
-			{
-				LOG("Failed to set line to input.");
-			}
+			failed = !WriteSRAMDiff(pMapper, pRomInfo->mSRAMSize);
+			return;
 		}
-	}
+		
+		gProgress.Begin("WriteSRAM", pRomInfo->mSRAMSize);
+		uint32_t bytesDone = 0;
+		
+		WriteSRAMRange(pMapper, 0, pRomInfo->mSRAMSize, gSRAMBuffer, bytesDone);
+		
+		gProgress.End(bytesDone);
+	});
 	
-private:
-	int32_t mGPIOLineNum = -1;
-	gpiod_line* mpLine = nullptr;
-	gpiod_chip* mpChip = nullptr;
+	FinishTrace(pRomInfo, numErrorsBefore, failed);
 	
-	enum class Direction
+	if(failed)
 	{
-		None,
-		Input,
-		Output,
-		HiZ
-	};
+		printf("WriteSRAM: Cart SRAM didn't take the contents of file '%s'\n", sramFileName);
+		return false;
+	}
 	
-	Direction mDirection = Direction::None;
-};
+	printf("WriteSRAM: Uploaded contents of file '%s' to Cart SRAM\n", sramFileName);
+	return true;
+}
 
-template<int NumLines>
-class GPIOLineArray
+bool ReadSRAM(RomInfo* pRomInfo)
 {
-public:
-	~GPIOLineArray()
+	uint32_t numErrorsBefore = gpBackend->GetNumErrors();
+	const Mapper* pMapper = GetMapper(pRomInfo->mMapping);
+	
+	RunBusCommand([&]
 	{
-		Release();
-	}
+		gProgress.Begin("ReadSRAM", pRomInfo->mSRAMSize);
+		uint32_t bytesDone = 0;
+		
+		usleep(1);
+		ReadSRAMRange(pMapper, 0, pRomInfo->mSRAMSize, gSRAMBuffer, bytesDone);
+		
+		gProgress.End(pRomInfo->mSRAMSize);
+	});
+	
+	char sramFileName[300] = { 0 };
+	snprintf(sramFileName, sizeof(sramFileName) - 1, "./%s.srm", pRomInfo->mRomName);
 	
-	void Create(gpiod_chip* pChip, uint8_t* pGPIOVals)
+	FILE* pFile = fopen(sramFileName, "wb");
+	bool failed = (pFile == NULL);
+	if(pFile)
 	{
-		if(!pChip)
-		{
-			LOG("Invalid chip passed!");
-			return;
-		}
+		printf("ReadSRAM: Wrote contents to file '%s'\n", sramFileName);
+		fwrite(gSRAMBuffer, pRomInfo->mSRAMSize, 1, pFile);
 		
-		for(uint32_t i = 0; i < NumLines; i++)
-		{
-			mLines[i].Create(pChip, pGPIOVals[i]);
-		}
+		fclose(pFile);
+		pFile = NULL;
+	}
+	else
+	{
+		printf("Failed to open file '%s' for write!\n", sramFileName);
 	}
 	
-	void Release()
+	FinishTrace(pRomInfo, numErrorsBefore, failed);
+	return !failed;
+}
+
+//todo: reading a single bank (0 - 32768) for smw worked!!!! now im trying to read all its banks, but 
+// a little confused on loRom banking. see https://snes.nesdev.org/wiki/Memory_map
+
+// from the command line, see ParseOptions
+bool gResume = false;
+bool gAutoName = false;
+ReadVerifier gVerifier;
+const char* gpDatIndexFileName = "nointro.idx";
+
+// Looks a dump up in the DAT index. Fills pName in with what it's called if it's known.
+bool LookUpRom(const RomDigests& digests, char* pName, uint32_t nameSize)
+{
+	RomDatabase database;
+	if(!database.Open(gpDatIndexFileName))
 	{
-		for(uint32_t i = 0; i < NumLines; i++)
-		{
-			mLines[i].Release();
-		}
+		printf("RomDatabase: No index '%s' to look the rom up in, see --compile-dat\n", gpDatIndexFileName);
+		return false;
 	}
 	
-	void HiZ()
+	const DatIndexEntry* pEntry = database.Find(digests);
+	if(!pEntry)
 	{
-		for(int32_t i = 0; i < NumLines; i++)
-		{
-			mLines[i].HiZ();
-		}
+		printf("RomDatabase: Not one of the %d known roms, a bad dump or an undumped cart\n", database.GetNumEntries());
+		return false;
 	}
 	
-	void Write(uint32_t value)
+	printf("RomDatabase: Known good dump of '%s'\n", database.GetName(pEntry));
+	snprintf(pName, nameSize, "%s", database.GetName(pEntry));
+	return true;
+}
+
+// Renames the dump after the DAT's name for it, unless something already has that name. Returns
+// false if it's still called pRomFileName.
+bool RenameDump(const char* pRomFileName, const char* pKnownName, char* pNewFileName, uint32_t newFileNameSize)
+{
+	char newFileName[300] = { 0 };
+	snprintf(newFileName, sizeof(newFileName) - 1, "./%s.smc", pKnownName);
+	
+	// names are free text, and can't be allowed to climb out of the directory
+	for(char* p = newFileName + 2; *p; p++)
 	{
-		for(int32_t i = 0; i < NumLines; i++)
+		if(*p == '/')
 		{
-			mLines[i].Write((value & (0x1 << i)) != 0 ? 1 : 0);
+			*p = '_';
 		}
 	}
 	
-	uint8_t Read()
+	if(access(newFileName, F_OK) == 0)
 	{
-		uint8_t value = 0;
-		
-		for(int32_t i = 0; i < NumLines; i++)
-		{
-			uint8_t lineVal = mLines[i].Read();
-			
-			value |= ((lineVal != 0 ? 0x1 : 0) << i);
-		}
-		
-		return value;
+		printf("DumpROM: Not renaming to '%s', it's already there\n", newFileName);
+		return false;
+	}
+	else if(rename(pRomFileName, newFileName) != 0)
+	{
+		printf("DumpROM: Failed to rename '%s' to '%s'\n", pRomFileName, newFileName);
+		return false;
 	}
 	
-private:
-	GPIOLine mLines[NumLines];
-};
+	printf("DumpROM: Renamed to '%s'\n", newFileName);
+	snprintf(pNewFileName, newFileNameSize, "%s", newFileName);
+	return true;
+}
 
-template<int NumLines, int NumBankLines>
-class GPIOAddressArray
+// Hashes an existing dump the same way DumpROM does and looks it up.
+void IdentifyRomFile(const char* pFileName)
 {
-public:
-	~GPIOAddressArray()
+	FILE* pFile = fopen(pFileName, "rb");
+	if(!pFile)
 	{
-		Release();
+		printf("Failed to open file '%s'\n", pFileName);
+		return;
 	}
 	
-	void Create(gpiod_chip* pChip, uint8_t* pGPIOVals, uint8_t latchVal, uint8_t* pBankGPIOVals, uint8_t bankLatchVal)
+	// the header is at the end of the first 32KB for LoROM, 64KB for HiROM and 64KB into the upper 4MB for ExHiROM
+	uint16_t headerChecksum = 0;
+	const uint32_t headerOffsets[] = { 0x7FB0, 0xFFB0, 0x40FFB0 };
+	for(uint32_t i = 0; i < sizeof(headerOffsets) / sizeof(headerOffsets[0]); i++)
 	{
-		if(!pChip)
-		{
-			LOG("Invalid chip passed!");
-			return;
-		}
-		
-		for(uint32_t i = 0; i < NumLines; i++)
+		uint8_t header[HEADER_READ_SIZE];
+		if(fseek(pFile, headerOffsets[i], SEEK_SET) == 0 && fread(header, sizeof(header), 1, pFile) == 1 && IsRomHeaderChecksumValid(header))
 		{
-			mLines[i].Create(pChip, pGPIOVals[i]);
+			RomInfo romInfo;
+			ParseRomHeader(header, &romInfo);
+			headerChecksum = romInfo.mChecksum;
+			break;
 		}
-		
-		for(uint32_t i = 0; i < NumBankLines; i++)
-		{
-			mBankLines[i].Create(pChip, pBankGPIOVals[i]);
-		}
-		
-		mLatch.Create(pChip, latchVal);
-		mBankLatch.Create(pChip, bankLatchVal);
 	}
 	
-	void Release()
+	fseek(pFile, 0, SEEK_SET);
+	
+	static DumpHasher hasher;
+	hasher.Reset();
+	
+	static uint8_t chunk[CHUNK_SIZE];
+	uint32_t size = 0;
+	for(size_t numRead = 0; (numRead = fread(chunk, 1, sizeof(chunk), pFile)) > 0; size += numRead)
 	{
-		mBankLatch.Release();
-		mLatch.Release();
-		
-		for(uint32_t i = 0; i < NumBankLines; i++)
-		{
-			mBankLines[i].Release();
-		}
-		
-		for(uint32_t i = 0; i < NumLines; i++)
-		{
-			mLines[i].Release();
-		}
+		hasher.AddChunk(chunk, numRead);
 	}
 	
-	void HiZ()
+	fclose(pFile);
+	
+	RomDigests digests;
+	if(size > MAX_DUMP_SIZE || !hasher.Finish(size, digests))
 	{
-		// prepare the latch 
-		mLatch.Write(1);
-		usleep(10);
-		
-		// set the low values
-		for(int32_t i = 0; i < NumLines; i++)
-		{
-			mLines[i].HiZ();
-		}
-		
-		// prepare the latch 
-		mLatch.Write(0);
-		usleep(10);
-		
-		// set the high values
-		for(int32_t i = 0; i < NumLines; i++)
-		{
-			mLines[i].HiZ();
-		}
-		
-		
-		// prepare the latch 
-		mBankLatch.Write(1);
-		usleep(10);
-		
-		// set the low values
-		for(int32_t i = 0; i < NumBankLines; i++)
-		{
-			mBankLines[i].HiZ();
-		}
-		
-		// prepare the latch 
-		mBankLatch.Write(0);
-		usleep(10);
-		
-		// set the high values
-		for(int32_t i = 0; i < NumBankLines; i++)
-		{
-			mBankLines[i].HiZ();
-		}
+		printf("'%s' is too big to be a rom\n", pFileName);
+		return;
+	}
+	
+	DumpHasher::Print(digests, headerChecksum);
+	
+	char name[256];
+	LookUpRom(digests, name, sizeof(name));
+}
+
+// A dump from its first chunk to its digests. The bus is done with it once ReadRomDump returns,
+// and the rest (the writer draining, the fsync, the last of the hashing and the DAT lookup) is
+// FinishRomDump, which --batch runs while the next cart goes in.
+struct RomDump
+{
+	RomInfo mRomInfo;
+	char mFileName[300];
+	uint32_t mRomSize;
+	uint32_t mBytesRead;
+	
+	DumpJournal mJournal;
+	DumpHasher mHasher;
+	ChunkWriter mWriter;
+	MirrorDetector mMirrors;
+	
+	// from FinishRomDump, mFileName included if --auto-name renamed it
+	bool mHasDigests;
+	RomDigests mDigests;
+	char mKnownName[256];
+};
+
+// Only ever one, since --batch has finished with it by the time the next cart is dumped. Static,
+// as the hasher keeps state for every chunk and the writer's queues want their cache lines.
+RomDump gRomDump;
+
+// this perfectly reads SMW consistently, and is binary identical to known dumps. But doesn't work for Pushover.
+// Returns false if the dump couldn't be started or was cancelled, in which case there's nothing to finish.
+bool ReadRomDump(RomInfo* pRomInfo, RomDump* pDump)
+{
+	const Mapper* pMapper = GetMapper(pRomInfo->mMapping);
+	
+	pDump->mRomInfo = *pRomInfo;
+	pDump->mHasDigests = false;
+	pDump->mKnownName[0] = 0;
+	
+	// read only as much as the header says the rom has. Without a header fall back to the most LoROM can address.
+	uint32_t romSize = pRomInfo->mRomSize;
+	if(romSize == 0)
+	{
+		printf("DumpROM: No rom size from the header, reading 4MB\n");
+		romSize = 0x400000;
 	}
 	
-	void SetAddress(uint32_t value)
+	if(romSize > MAX_DUMP_SIZE)
 	{
-		uint8_t lowVals = value & 0x00FF;
-		uint8_t highVals = (value & 0xFF00) >> 8;
-		uint8_t bankVals = (value & 0xFF0000) >> 16;
-		
-		//printf("requesting address: %d, low: %d, high: %d\n", value, lowVals, highVals);
-		
-		// SET ADDRESS LINES
-		
-		// prepare the latch 
-		mLatch.Write(1);
-		usleep(10);
-		
-		// set the low values
-		for(int32_t i = 0; i < NumLines; i++)
-		{
-			//printf("Set low value bit %d: %d\n", i, (lowVals >> i) & 0x1);
-			mLines[i].Write((lowVals >> i) & 0x1);
-		}
-		
-		// set the latch 
-		mLatch.Write(0);
-		usleep(10);
+		romSize = MAX_DUMP_SIZE;
+	}
+	
+	char* romFileName = pDump->mFileName;
+	snprintf(romFileName, sizeof(pDump->mFileName) - 1, "./%s.smc", pRomInfo->mRomName);
+	
+	// the rom goes straight to disk a chunk at a time as it's read, rather than being held until the end,
+	// and the journal keeps track of how far it got in case we don't make it to the end
+	DumpJournal& journal = pDump->mJournal;
+	uint32_t numResumable = journal.Begin(romFileName, pRomInfo, romSize, gResume);
+	
+	// and it's hashed as it goes, so the digests are there as soon as the dump is
+	DumpHasher& hasher = pDump->mHasher;
+	hasher.Reset();
+	
+	ChunkWriter& writer = pDump->mWriter;
+	writer.SetJournal(&journal);
+	writer.SetHasher(&hasher);
+	if(!writer.Open(romFileName, numResumable > 0))
+	{
+		FinishTrace(pRomInfo, gpBackend->GetNumErrors(), true);
+		return false;
+	}
+	
+	printf("DumpROM: Reading %dKB as %s\n", romSize / 1024, pMapper->GetName());
+	if(numResumable > 0)
+	{
+		printf("DumpROM: Resuming, %d of %d chunks already dumped\n", numResumable, (romSize + CHUNK_SIZE - 1) / CHUNK_SIZE);
+	}
+	
+	uint32_t numErrorsBefore = gpBackend->GetNumErrors();
+	
+	bool verifying = gVerifier.IsEnabled();
+	gVerifier.Begin();
+	
+	// the header can claim more rom than the cart has, and without one we're sweeping 4MB,
+	// so stop as soon as what we're reading is a copy of what we already have
+	MirrorDetector& mirrors = pDump->mMirrors;
+	mirrors.Reset();
+	
+	bool mirrored = false;
+	bool cancelled = false;
+	uint32_t bytesRead = 0;
+	uint32_t numResumed = 0;
+	
+	// The chunks an earlier dump finished are a run from the start, since the writer goes in order.
+	// They're checked against the file here so the bus thread never reads the disk, and the first one
+	// that doesn't check out is where the bus takes over.
+	Chunk* pFirstChunk = nullptr;
+	while(bytesRead < romSize && !mirrored && numResumed < numResumable)
+	{
+		pFirstChunk = writer.GetFreeChunk();
+		pFirstChunk->mOffset = bytesRead;
+		pFirstChunk->mSize = (romSize - bytesRead < CHUNK_SIZE) ? romSize - bytesRead : CHUNK_SIZE;
 		
-		// set the high values
-		for(int32_t i = 0; i < NumLines; i++)
+		uint32_t journalCrc = 0;
+		if(!journal.IsChunkDone(bytesRead / CHUNK_SIZE, journalCrc) || !writer.ReadChunk(pFirstChunk) ||
+			Crc32(pFirstChunk->mpData, pFirstChunk->mSize) != journalCrc)
 		{
-			//printf("Set high value bit %d: %d\n", i, (highVals >> i) & 0x1);
-			mLines[i].Write((highVals >> i) & 0x1);
+			break;
 		}
 		
+		bytesRead += pFirstChunk->mSize;
+		numResumed++;
 		
-		// SET BANK LINES
-		uint8_t lowBankVals = bankVals & 0xF;
-		uint8_t highBankVals = (bankVals & 0xF0) >> 4;
+		pFirstChunk->mOnDisk = true;
+		mirrors.Add(pFirstChunk->mpData, pFirstChunk->mSize);
+		writer.Submit(pFirstChunk);
+		pFirstChunk = nullptr;
 		
-		// prepare the bank latch 
-		mBankLatch.Write(1);
-		usleep(10);
+		mirrored = bytesRead < romSize && mirrors.IsUpperHalfMirrored(bytesRead);
+	}
+	
+	RunBusCommand([&]
+	{
+		gProgress.Begin("DumpROM", romSize);
+		BusRun runs[MAX_BUS_RUNS];
 		
-		// set the low values
-		for(int32_t i = 0; i < NumBankLines; i++)
+		usleep(1);
+		while(bytesRead < romSize && !mirrored && !cancelled)
 		{
-			mBankLines[i].Write((lowBankVals >> i) & 0x1);
+			Chunk* pChunk = pFirstChunk ? pFirstChunk : writer.GetFreeChunk();
+			pFirstChunk = nullptr;
+			
+			pChunk->mOffset = bytesRead;
+			pChunk->mSize = (romSize - bytesRead < CHUNK_SIZE) ? romSize - bytesRead : CHUNK_SIZE;
+			
+			uint32_t numRuns = pMapper->GetRomBatch(bytesRead, pChunk->mSize, runs, MAX_BUS_RUNS);
+			
+			pChunk->mSize = 0;
+			for(uint32_t r = 0; r < numRuns; r++)
+			{
+				if(verifying)
+				{
+					gVerifier.ReadRun(runs[r], pChunk->mpData + pChunk->mSize);
+				}
+				else
+				{
+					ReadCartRun(runs[r], pChunk->mpData + pChunk->mSize);
+				}
+				
+				for(uint32_t a = 0; a < runs[r].mLength; a++, bytesRead++)
+				{
+					uint32_t address = runs[r].mAddress + a;
+					
+					gTrace.Record(TraceOp::ReadROM, address, pChunk->mpData[pChunk->mSize++]);
+					
+					gProgress.Update(bytesRead, address);
+				}
+			}
+			
+			mirrors.Add(pChunk->mpData, pChunk->mSize);
+			writer.Submit(pChunk);
+			
+			mirrored = bytesRead < romSize && mirrors.IsUpperHalfMirrored(bytesRead);
+			cancelled = IsCancelRequested();
 		}
 		
-		// set the latch
-		mBankLatch.Write(0);
-		usleep(10);
+		gProgress.End(bytesRead);
+	});
+	
+	// what's there so far is whole chunks and in the journal, so --resume picks it up from here
+	if(cancelled && !mirrored && bytesRead < romSize)
+	{
+		writer.Close(bytesRead);
+		printf("DumpROM: Cancelled after %dKB, --resume carries on from there\n", bytesRead / 1024);
 		
-		// set the high values 
-		for(int32_t i = 0; i < NumBankLines; i++)
-		{
-			mBankLines[i].Write((highBankVals >> i) & 0x1);
-		}
+		FinishTrace(pRomInfo, numErrorsBefore, true);
+		return false;
 	}
 	
-private:
-	GPIOLine mLines[NumLines];
-	GPIOLine mBankLines[NumBankLines];
-	GPIOLine mLatch;
-	GPIOLine mBankLatch;
-};
-//
-
-// Controls address lines A0 - A15 with support of a latch and A16-A23 (Bank Addresses BA0-BA7) with another latch.
-uint8_t gAddressLineIndices[] = {2,3,4,17,27,22,10,9};
-uint8_t gBankAddressBusIndices[] = {6,13,19,26};
-uint8_t gLatch8Thru15LineIndex = 5;
-uint8_t gLatch16Thru19Index = 16;
-GPIOAddressArray<8,4> gAddressLines;
-
-// controls bank address lines BA0 - BA7 (A16-A23) with support of a latch
-
-//uint8_t gLatch16Thru19Index = 16;
-//GPIOAddressArray<4> gBankAddressBus;
-
-uint8_t gDataLineIndices[] = {14,15,18,23,24,25,8,7};
-GPIOLineArray<8> gDataLines;
-
-uint8_t gWriteLineIndices[] = {12};
-GPIOLineArray<1> gWriteEnable;
-
-uint8_t gResetLineIndices[] = {21};
-GPIOLineArray<1> gReset;
-
-uint8_t gCartEnableLineIndices[] = {20};
-GPIOLineArray<1> gCartEnable;
-
-
-uint8_t gSRAMBuffer[65536] = {0};
-
-void WriteReadRAMTest()
-{
-	// Use with the 15bit addressable ram chip.
+	if(numResumed > 0)
+	{
+		printf("DumpROM: Kept %d chunks from the earlier dump\n", numResumed);
+	}
 	
-	for(uint32_t i = 0; i < 65536; i++)
+	if(mirrored)
 	{
-		uint32_t address = i;
-		uint32_t writeValue = i % 256;
-		
-		 // write
-		 LOG("---Write---");
-		 LOG("Setting write enable high");
-		 gWriteEnable.Write(1);
-		 usleep(10);
-		 
-		 LOG("Setting data hiZ");
-		 gDataLines.HiZ();
-		 usleep(10);
-		
-		 printf("Setting address 0%x\n", address);
-		 gAddressLines.SetAddress(address);
-		 usleep(10);
-		 
-		 LOG("Setting write enable low");
-		 gWriteEnable.Write(0);
-		 usleep(10);
-		
-		 printf("Writing value: 0%x\n", writeValue);
-		 gDataLines.Write(writeValue);
-		 usleep(10);
-		
-		 LOG("Setting write enable high");
-		 gWriteEnable.Write(1);
-		 usleep(10);
-		 
-		 LOG("Setting data hiZ");
-		 gDataLines.HiZ();
-		 usleep(10);
+		printf("DumpROM: Everything past %dKB is a mirror, stopped early\n", bytesRead / 2048);
 	}
-	 
-	 for(uint32_t i = 0; i < 65536; i++)
-	 {
-		uint32_t address = i;
-		
-		 // read
-		 LOG("---Read---");
-		 LOG("Setting write enable high");
-		 gWriteEnable.Write(1);
-		 usleep(10);
-		
-		 printf("Setting address 0%x\n", address);
-		 gAddressLines.SetAddress(address);
-		 usleep(10);
-		 
-		 LOG("Setting data hiZ");
-		 gDataLines.HiZ();
-		 usleep(10);
-		
-		 LOG("Reading");
-		 uint8_t value = gDataLines.Read();
-		 printf("Value at dataline: %x\n", value);
-		 usleep(10);
-		 
-		 if(value != i % 256)
-		 {
-			 printf("*****THIS DOES NOT MATCH******\n");
-			 return;
-		 }
-		 
-		 LOG("Setting data hiZ");
-		 gDataLines.HiZ();
-		 usleep(10);
-	 }
-	 
-	 printf("*****ALL VALUES MATCH******\n");
+	
+	if(verifying)
+	{
+		gVerifier.PrintErrorMap();
+	}
+	
+	// the trace is only about the bus, and the bus is done. Anything that goes wrong from here is the disk.
+	FinishTrace(pRomInfo, numErrorsBefore, false);
+	
+	pDump->mRomSize = romSize;
+	pDump->mBytesRead = bytesRead;
+	return true;
 }
 
-void WriteSRAM(RomInfo* pRomInfo)
+// Doesn't touch the bus, so it can run on any thread. Returns false if the dump didn't make it to disk.
+bool FinishRomDump(RomDump* pDump)
 {
-	char sramFileName[300] = { 0 };
-	snprintf(sramFileName, sizeof(sramFileName) - 1, "./%s.srm", pRomInfo->mRomName);
-		
-	FILE* pFile = fopen(sramFileName, "rb");
-	if(pFile)
+	char* romFileName = pDump->mFileName;
+	
+	// the mirrors are already on disk, cut them back off
+	uint32_t romSize = pDump->mMirrors.FindRomSize(pDump->mBytesRead);
+	pDump->mRomSize = romSize;
+	
+	bool failed = !pDump->mWriter.Close(romSize);
+	if(!failed)
 	{
-		fread(gSRAMBuffer, pRomInfo->mSRAMSize, 1, pFile);
+		printf("DumpROM: Wrote contents to file '%s'\n", romFileName);
+		pDump->mJournal.Remove();
 		
-		fclose(pFile);
-		pFile = NULL;
+		RomDigests& digests = pDump->mDigests;
+		if(pDump->mHasher.Finish(romSize, digests))
+		{
+			pDump->mHasDigests = true;
+			DumpHasher::Print(digests, pDump->mRomInfo.mChecksum);
+			
+			char* knownName = pDump->mKnownName;
+			char newFileName[300];
+			if(LookUpRom(digests, knownName, sizeof(pDump->mKnownName)) && gAutoName &&
+				RenameDump(romFileName, knownName, newFileName, sizeof(newFileName)))
+			{
+				snprintf(romFileName, sizeof(pDump->mFileName), "%s", newFileName);
+			}
+		}
 	}
 	else
 	{
-		printf("Failed to open file '%s' for write!\n", pRomInfo->mRomName);
-		return;
+		printf("Failed to write file '%s'!\n", romFileName);
 	}
 	
-	usleep(1);
-	for(uint32_t i = 0x700000; i < 0x700000 + pRomInfo->mSRAMSize; i++ )
+	return !failed;
+}
+
+// pDumpFileName gets what the dump ended up being called, which --auto-name can change.
+bool DumpROM(RomInfo* pRomInfo, char* pDumpFileName = nullptr, uint32_t dumpFileNameSize = 0)
+{
+	RomDump* pDump = &gRomDump;
+	
+	bool succeeded = ReadRomDump(pRomInfo, pDump) && FinishRomDump(pDump);
+	if(succeeded && pDumpFileName)
 	{
-		uint32_t address = i;
-		
-		 gWriteEnable.Write(1);
-		 usleep(10);
-		 
-		 gDataLines.HiZ();
-		 usleep(10);
-		 
-		 gCartEnable.Write(1);
-		 usleep(10);
-		
-		 gAddressLines.SetAddress(address);
-		 usleep(10);
-		 
-		 gCartEnable.Write(0);
-		 usleep(10);
-		 
-		 gWriteEnable.Write(0);
-		 usleep(10);
-		
-		 printf("%x: %x\n", address, gSRAMBuffer[i]);
-		 gDataLines.Write(gSRAMBuffer[i]);
-		 usleep(10);
-		
-		 gWriteEnable.Write(1);
-		 usleep(10);
-		 
-		 gDataLines.HiZ();
-		 usleep(10);
+		snprintf(pDumpFileName, dumpFileNameSize, "%s", pDump->mFileName);
 	}
 	
-	printf("WriteSRAM: Uploaded contents of file '%s' to Cart SRAM\n", sramFileName);
+	return succeeded;
 }
 
-void ReadSRAM(RomInfo* pRomInfo)
+// this worked for pushover, except im reading too much of each bank
+/*
+void DumpROM(RomInfo* pRomInfo)
 {
+	uint32_t lowRomNumBanks = 16;
+	uint32_t lowRomBankSize = 32768;
+	
+	uint32_t fullSize = lowRomNumBanks * lowRomBankSize;
+	
+	// try reading the banks!
 	usleep(1);
-	for(uint32_t i = 0x700000; i < 0x700000 + pRomInfo->mSRAMSize; i++ )
+	for(uint32_t i = 0; i < fullSize; i++ )
 	{
 		uint32_t address = i;
 		
-		// disable cart output
 		gCartEnable.Write(1);
 		usleep(10);
 		
@@ -659,285 +762,994 @@ void ReadSRAM(RomInfo* pRomInfo)
 		
 		 uint8_t value = gDataLines.Read();
 		 usleep(10);
-		 gSRAMBuffer[i] = value;
+		 gRomBuffer[i] = value;
 		 printf("%x: %x\n", address, value);
 		 
 		 gDataLines.HiZ();
 		 usleep(10);
 	}
+	char romFileName[300] = { 0 };
+	snprintf(romFileName, sizeof(romFileName) - 1, "./%s.smc", pRomInfo->mRomName);
+	
+	FILE* pFile = fopen(romFileName, "wb");
+	if(pFile)
+	{
+		printf("DumpROM: Wrote contents to file '%s'\n", romFileName);
+		fwrite(gRomBuffer, fullSize, 1, pFile);
+		
+		fclose(pFile);
+		pFile = NULL;
+	}
+	else
+	{
+		printf("Failed to open file '%s' for write!\n", romFileName);
+	}
+}*/
+
+// from the command line, see ParseOptions
+CartSpeed gCartSpeed = CartSpeed::SlowROM;
+bool gCartSpeedGiven = false;
+uint32_t gDelayScalePercent = 100;
+CartDetectMode gCartDetectMode = CartDetectMode::None;
+
+// --cart-detect, which takes the place of pressing a key when a cart goes in or comes out
+CartDetector gCartDetector;
+
+void ConfigureLinesForInsert()
+{
+	gWriteEnable.Write(1);
+	usleep(100);
+	
+	gReset.Write(0);
+	usleep(100);
+	
+	gCartEnable.Write(1);
+	usleep(100);
+	
+	gAddressLines.HiZ();
+	gDataLines.HiZ();
+	usleep(100);
+}
+
+void ConfigureLinesForRemove()
+{
+	gWriteEnable.Write(1);
+	usleep(100);
+	
+	gCartEnable.Write(1);
+	usleep(100);
+	
+	gReset.Write(0);
+	usleep(100);
+	
+	gAddressLines.HiZ();
+	gDataLines.HiZ();
+	usleep(100);
+}
+
+// Powers up the cart that's just gone in and reads its header. Returns false if it didn't have one.
+bool StartCart(RomInfo* pRomInfo)
+{
+	// Set Reset High so we send sram 5v and can read/write.
+	gReset.Write(1);
+	usleep(100);
+	
+	// the header tells us the rom/sram sizes and mapping
+	gWriteEnable.Write(1);
+	bool found = ProbeRomInfo(ReadRomByte, pRomInfo);
+	
+	if(pRomInfo->mFastROM && !gCartSpeedGiven)
+	{
+		printf("Cart is FastROM, using FastROM timings\n");
+		SetCartSpeed(CartSpeed::FastROM, gDelayScalePercent);
+	}
+	// the daemon can go from a FastROM cart to one that isn't
+	else if(!gCartSpeedGiven)
+	{
+		SetCartSpeed(gCartSpeed, gDelayScalePercent);
+	}
+	
+	return found;
+}
+
+// With --cart-detect, makes sure the cart RunMain started is still in before the bus is used again.
+// If it was pulled while the menu was up the lines are put the way they'd have been for removing it,
+// and the next cart is started as soon as it's in.
+static void CheckCartStillIn(RomInfo* pRomInfo)
+{
+	if(!gCartDetector.IsEnabled() || gCartDetector.Sample() || !gCartDetector.WaitFor(false, CART_DETECT_SETTLE_MS * 2))
+	{
+		return;
+	}
+	
+	ConfigureLinesForRemove();
+	
+	printf("Cart came out. INSERT GAME.\n");
+	gCartDetector.WaitFor(true, 0);
+	
+	// nothing but the name carries over, so a cart without a header doesn't get the last one's layout
+	RomInfo romInfo;
+	memcpy(romInfo.mRomName, pRomInfo->mRomName, sizeof(romInfo.mRomName));
+	*pRomInfo = romInfo;
+	
+	if(!StartCart(pRomInfo))
+	{
+		printf("No header on the new cart, so there's no SRAM to read or write. Reseat it and try again.\n");
+	}
+}
+
+void RunMain(const char* pRomName)
+{
+	RomInfo romInfo;
+	RomInfo* pRomInfo = &romInfo;
+	strncpy(romInfo.mRomName, pRomName, sizeof(romInfo.mRomName) - 1);
+	
+	ConfigureLinesForInsert();
+	
+	if(gCartDetector.IsEnabled())
+	{
+		printf("INSERT GAME.\n");
+		gCartDetector.WaitFor(true, 0);
+	}
+	else
+	{
+		printf("INSERT GAME and press any key.\n");
+		while(!getchar())
+		{
+		}
+	}
+	
+	StartCart(pRomInfo);
+
+	bool shouldExit = false;	
+	while(!shouldExit)
+	{
+		printf("[R]ead from SRAM\n");
+		printf("[W]rite to SRAM\n");
+		printf("[D]ump ROM\n");
+		printf("E[x]it\n");
+		printf("Your Selection: ");
+
+		uint32_t inputChoice = 0;
+		uint32_t c = 0;
+		do
+		{
+			c = getchar();
+			if(c != '\n')
+			{
+				inputChoice = c;
+			}
+		}
+		while(c != '\n');
+		
+		if(inputChoice != 'x')
+		{
+			CheckCartStillIn(pRomInfo);
+		}
+			
+		switch(inputChoice)
+		{
+			case 'r':
+			{
+				ReadSRAM(pRomInfo);
+				break;
+			}
+			
+			case 'w':
+			{
+				WriteSRAM(pRomInfo);
+				break;
+			}
+			
+			case 'd':
+			{
+				DumpROM(pRomInfo);
+				break;
+			}
+			
+			case 'x':
+			{
+				shouldExit = true;
+				break;
+			}
+			
+			default:
+			{
+				printf("Unknown choice '%c'\n", inputChoice);
+				break;
+			}
+		}
+	}
+	
+	ConfigureLinesForRemove();
+	
+	if(gCartDetector.IsEnabled())
+	{
+		printf("REMOVE CARTRIDGE.\n");
+		gCartDetector.WaitFor(false, 0);
+	}
+	else
+	{
+		printf("REMOVE CARTRIDGE and press any key.\n");
+		while(!getchar())
+		{
+		}
+	}
+}
+
+// from the command line, see ParseOptions
+const char* gpBatchJsonFileName = "batch.json";
+
+static double GetSecondsSince(uint64_t startNs)
+{
+	return (double)(GetTimeNs() - startNs) / 1000000000.0;
+}
+
+// Returns false at the end of stdin, which ends the batch where it is.
+static bool WaitForEnter()
+{
+	for(int c = getchar(); c != '\n'; c = getchar())
+	{
+		if(c == EOF)
+		{
+			return false;
+		}
+	}
+	
+	return true;
+}
+
+// Enter, or with --cart-detect the cart that's in coming out (if there is one) and the next going in.
+// Returns false at the end of stdin.
+static bool WaitForSwap(bool removeFirst)
+{
+	if(!gCartDetector.IsEnabled())
+	{
+		return WaitForEnter();
+	}
+	
+	if(removeFirst)
+	{
+		gCartDetector.WaitFor(false, 0);
+	}
+	
+	return gCartDetector.WaitFor(true, 0);
+}
+
+// FinishRomDump for a batch dump, on its own thread so the next cart can go in meanwhile.
+static void FinishBatchDump(BatchJob* pJob)
+{
+	uint64_t startNs = GetTimeNs();
+	bool succeeded = FinishRomDump(&gRomDump);
+	
+	pJob->mFinishSeconds = GetSecondsSince(startNs);
+	pJob->mResult = succeeded ? BatchResult::Ok : BatchResult::Failed;
+	pJob->mNumBytes = gRomDump.mRomSize;
+	pJob->mHasDigests = gRomDump.mHasDigests;
+	pJob->mDigests = gRomDump.mDigests;
+	snprintf(pJob->mFileName, sizeof(pJob->mFileName), "%s", gRomDump.mFileName);
+	snprintf(pJob->mKnownName, sizeof(pJob->mKnownName), "%s", gRomDump.mKnownName);
+}
+
+static void RunBatchJob(BatchJob& job, RomInfo* pRomInfo, bool found, double probeSeconds, std::thread& finishThread)
+{
+	uint64_t startNs = GetTimeNs();
+	bool succeeded = false;
+	
+	switch(job.mOp)
+	{
+		case BatchOp::Probe:
+		{
+			// already done, everything needs the header
+			job.mResult = found ? BatchResult::Ok : BatchResult::Failed;
+			job.mSeconds = probeSeconds;
+			return;
+		}
+		
+		case BatchOp::Dump:
+		{
+			// the dump before this one is still using gRomDump
+			if(finishThread.joinable())
+			{
+				finishThread.join();
+			}
+			
+			succeeded = ReadRomDump(pRomInfo, &gRomDump);
+			job.mSeconds = GetSecondsSince(startNs);
+			
+			if(!succeeded)
+			{
+				job.mResult = BatchResult::Failed;
+				return;
+			}
+			
+			finishThread = std::thread(FinishBatchDump, &job);
+			return;
+		}
+		
+		case BatchOp::SRAMBackup:
+		case BatchOp::SRAMRestore:
+		{
+			if(pRomInfo->mSRAMSize == 0)
+			{
+				printf("Batch: '%s' has no SRAM\n", pRomInfo->mRomName);
+				break;
+			}
+			
+			if(job.mOp == BatchOp::SRAMBackup)
+			{
+				succeeded = ReadSRAM(pRomInfo);
+			}
+			else
+			{
+				succeeded = WriteSRAM(pRomInfo);
+			}
+			
+			job.mNumBytes = pRomInfo->mSRAMSize;
+			snprintf(job.mFileName, sizeof(job.mFileName), "./%s.srm", pRomInfo->mRomName);
+			break;
+		}
+	}
+	
+	job.mSeconds = GetSecondsSince(startNs);
+	job.mResult = succeeded ? BatchResult::Ok : BatchResult::Failed;
+}
+
+// --batch: RunMain for a manifest of carts, see Batch.h. A cart is only ever swapped with the lines
+// as RunMain leaves them for removal, and the disk end of each dump overlaps the next swap.
+void RunBatch(const char* pManifestFileName)
+{
+	BatchManifest manifest;
+	if(!manifest.Load(pManifestFileName))
+	{
+		return;
+	}
+	
+	uint64_t batchStartNs = GetTimeNs();
+	std::thread finishThread;
+	
+	ConfigureLinesForInsert();
+	
+	uint32_t numCarts = manifest.GetNumCarts();
+	uint32_t numInserted = 0;
+	for(uint32_t c = 0; c < numCarts; c++)
+	{
+		BatchCart& cart = manifest.GetCart(c);
+		
+		const char* pPrompt = gCartDetector.IsEnabled() ? "" : " and press enter";
+		if(c == 0)
+		{
+			printf("Batch: INSERT '%s' (1 of %d)%s.\n", cart.mName, numCarts, pPrompt);
+		}
+		else
+		{
+			printf("Batch: REMOVE '%s', INSERT '%s' (%d of %d)%s.\n", manifest.GetCart(c - 1).mName, cart.mName,
+				c + 1, numCarts, pPrompt);
+		}
+		
+		uint64_t insertStartNs = GetTimeNs();
+		if(!WaitForSwap(c > 0))
+		{
+			printf("Batch: Out of input, stopping before '%s'\n", cart.mName);
+			break;
+		}
+		
+		cart.mInsertSeconds = GetSecondsSince(insertStartNs);
+		numInserted++;
+		
+		RomInfo romInfo;
+		snprintf(romInfo.mRomName, sizeof(romInfo.mRomName), "%s", cart.mName);
+		
+		uint64_t probeStartNs = GetTimeNs();
+		bool found = false;
+		found = StartCart(&romInfo);
+		double probeSeconds = GetSecondsSince(probeStartNs);
+		
+		cart.mProbed = found;
+		memcpy(cart.mTitle, romInfo.mTitle, sizeof(cart.mTitle) - 1);
+		
+		for(uint32_t j = 0; j < cart.mNumJobs; j++)
+		{
+			RunBatchJob(cart.mJobs[j], &romInfo, found, probeSeconds, finishThread);
+		}
+		
+		ConfigureLinesForRemove();
+	}
+	
+	if(numInserted > 0)
+	{
+		if(gCartDetector.IsEnabled())
+		{
+			printf("Batch: REMOVE '%s'.\n", manifest.GetCart(numInserted - 1).mName);
+			gCartDetector.WaitFor(false, 0);
+		}
+		else
+		{
+			printf("Batch: REMOVE '%s' and press enter.\n", manifest.GetCart(numInserted - 1).mName);
+			WaitForEnter();
+		}
+	}
+	
+	if(finishThread.joinable())
+	{
+		finishThread.join();
+	}
+	
+	manifest.PrintSummary();
+	if(manifest.WriteJson(gpBatchJsonFileName, GetSecondsSince(batchStartNs)))
+	{
+		printf("Batch: Wrote summary to '%s'\n", gpBatchJsonFileName);
+	}
+}
+
+// The daemon's cart, which stays powered up between jobs once it's been probed.
+RomInfo gDaemonRomInfo;
+bool gDaemonCartStarted = false;
+
+void DescribeDaemonCart(char* pText, uint32_t size)
+{
+	if(!gDaemonCartStarted)
+	{
+		snprintf(pText, size, "not probed yet");
+		return;
+	}
+	
+	snprintf(pText, size, "'%s' %s%s, %dKB rom, %dKB sram, checksum %04X", gDaemonRomInfo.mTitle,
+		GetMappingName(gDaemonRomInfo.mMapping), gDaemonRomInfo.mFastROM ? " FastROM" : "",
+		gDaemonRomInfo.mRomSize / 1024, gDaemonRomInfo.mSRAMSize / 1024, gDaemonRomInfo.mChecksum);
+}
+
+bool RunDaemonJob(DaemonCommand command, const char* pName, const uint8_t* pUpload, uint32_t uploadSize,
+	char* pReply, uint32_t replySize, char* pFileName, uint32_t fileNameSize)
+{
+	bool succeeded = true;
+	
+	// back to how the daemon started, so the cart can be swapped and the next job probes the new one
+	if(command == DaemonCommand::Eject)
+	{
+		ConfigureLinesForRemove();
+		gDaemonRomInfo = RomInfo();
+		gDaemonCartStarted = false;
+		
+		snprintf(pReply, replySize, "safe to swap the cart\n");
+		return true;
+	}
+	
+	// Everything but probe works on whatever was probed last, so the first job probes if nothing has.
+	// A probe that finds no header leaves it unprobed, so nothing of the cart before carries over and
+	// the next job probes again.
+	if(command == DaemonCommand::Probe || !gDaemonCartStarted)
+	{
+		gDaemonRomInfo = RomInfo();
+		
+		bool found = false;
+		found = StartCart(&gDaemonRomInfo);
+		gDaemonCartStarted = found;
+		
+		if(command == DaemonCommand::Probe)
+		{
+			if(!found)
+			{
+				snprintf(pReply, replySize, "no header, is a cart in?");
+				return false;
+			}
+			
+			DescribeDaemonCart(pReply, replySize);
+			strncat(pReply, "\n", replySize - strlen(pReply) - 1);
+			return true;
+		}
+	}
+	
+	RomInfo* pRomInfo = &gDaemonRomInfo;
+	snprintf(pRomInfo->mRomName, sizeof(pRomInfo->mRomName), "%s", pName);
+	
+	// without a header there's no telling where the SRAM is or how big
+	if(command != DaemonCommand::DumpROM && !gDaemonCartStarted)
+	{
+		snprintf(pReply, replySize, "no header, is a cart in?");
+		return false;
+	}
+	
+	if(command != DaemonCommand::DumpROM && pRomInfo->mSRAMSize == 0)
+	{
+		snprintf(pReply, replySize, "the cart has no SRAM");
+		return false;
+	}
+	
+	switch(command)
+	{
+		case DaemonCommand::DumpROM:
+		{
+			succeeded = DumpROM(pRomInfo, pFileName, fileNameSize);
+			if(!succeeded)
+			{
+				snprintf(pReply, replySize, IsCancelRequested() ? "cancelled" : "dump failed, see the daemon's log");
+			}
+			
+			break;
+		}
+		
+		case DaemonCommand::ReadSRAM:
+		{
+			succeeded = ReadSRAM(pRomInfo);
+			snprintf(pFileName, fileNameSize, "./%s.srm", pName);
+			break;
+		}
+		
+		case DaemonCommand::WriteSRAM:
+		{
+			if(uploadSize != pRomInfo->mSRAMSize)
+			{
+				snprintf(pReply, replySize, "the cart has %d bytes of SRAM, got %d", pRomInfo->mSRAMSize, uploadSize);
+				return false;
+			}
+			
+			// WriteSRAM takes it from the file, same as it would from the command line
+			char sramFileName[300];
+			snprintf(sramFileName, sizeof(sramFileName), "./%s.srm", pName);
+			
+			FILE* pFile = fopen(sramFileName, "wb");
+			if(!pFile || fwrite(pUpload, uploadSize, 1, pFile) != 1)
+			{
+				snprintf(pReply, replySize, "couldn't write '%s'", sramFileName);
+				if(pFile)
+				{
+					fclose(pFile);
+				}
+				
+				return false;
+			}
+			
+			fclose(pFile);
+			pFile = NULL;
+			
+			succeeded = WriteSRAM(pRomInfo);
+			snprintf(pReply, replySize, succeeded ? "wrote %d bytes of SRAM\n" : "the %d bytes of SRAM didn't all read back as written, see the daemon's log", uploadSize);
+			break;
+		}
+		
+		default:
+		{
+			snprintf(pReply, replySize, "not a bus job");
+			return false;
+		}
+	}
+	
+	return succeeded;
+}
+
+// --daemon (or run as copyromd): the same bus set up as --game, but driven over a socket, see Daemon.h.
+// The lines sit ready for a cart to go in until the first job, and again after each eject.
+void RunCartDaemon(const char* pSocketPath)
+{
+	ConfigureLinesForInsert();
+	
+	DaemonHandlers handlers;
+	handlers.mRunJob = RunDaemonJob;
+	handlers.mDescribeCart = DescribeDaemonCart;
+	
+	RunDaemon(pSocketPath, handlers);
+	
+	ConfigureLinesForRemove();
+}
+
+// Options (--name=value pairs and a few plain switches) can go anywhere on the command line.
+// They're pulled out of argv here so the command handling in main only ever sees commands.
+const char* gpChipName = "gpiochip0";
+const char* gpBackendName = "gpiod";
+const char* gpSimCartFileName = "smw.smc";
+const char* gpSimSRAMFileName = nullptr;
+MMIOBackend::SoC gSoC = MMIOBackend::SoC::Detect;
+bool gPrintLineStats = false;
+uint32_t gVerifySamples = 0;
+uint32_t gVerifyMaxSamples = 7;
+uint32_t gVerifyStretchPercent = 200;
+uint32_t gSimFlakyPerMillion = 0;
+uint32_t gSimBounceMs = 30;
+uint32_t gSimSwapMs = 0;
+uint32_t gDetectSwaps = 4;
+bool gRealtime = false;
+int32_t gRealtimeCpu = -1;
+const char* gpAddressSpiName = nullptr;
+uint32_t gSpiSpeedHz = 8000000;
+uint32_t gBenchBytes = 256 * 1024;
+bool gBenchSRAM = false;
+const char* gpSocketPath = DAEMON_DEFAULT_SOCKET;
+const char* gpBenchJsonFileName = "bench.json";
+
+void ParseOptions(int& argc, const char** argv)
+{
+	int numArgs = 1;
+	for(int i = 1; i < argc; i++)
+	{
+		// name, path, label or number, so a gpio-sim chip can stand in for the Pi (see gpio-sim.sh)
+		if(!strncmp(argv[i], "--chip=", 7))
+		{
+			gpChipName = argv[i] + 7;
+		}
+		else if(!strncmp(argv[i], "--backend=", 10))
+		{
+			gpBackendName = argv[i] + 10;
+		}
+		// overrides the mmio backend's SoC detection, or picks the register layout it fakes
+		else if(!strcmp(argv[i], "--soc=bcm2835"))
+		{
+			gSoC = MMIOBackend::SoC::BCM2835;
+		}
+		else if(!strcmp(argv[i], "--soc=bcm2711"))
+		{
+			gSoC = MMIOBackend::SoC::BCM2711;
+		}
+		else if(!strcmp(argv[i], "--soc=rp1"))
+		{
+			gSoC = MMIOBackend::SoC::RP1;
+		}
+		// bus delays, see BusTiming.h
+		else if(!strcmp(argv[i], "--speed=slow"))
+		{
+			gCartSpeed = CartSpeed::SlowROM;
+			gCartSpeedGiven = true;
+		}
+		else if(!strcmp(argv[i], "--speed=fast"))
+		{
+			gCartSpeed = CartSpeed::FastROM;
+			gCartSpeedGiven = true;
+		}
+		else if(!strncmp(argv[i], "--delay-scale=", 14))
+		{
+			gDelayScalePercent = atoi(argv[i] + 14);
+		}
+		// progress reports per second while dumping or reading/writing SRAM
+		else if(!strncmp(argv[i], "--progress-hz=", 14))
+		{
+			gProgress.SetRate(atoi(argv[i] + 14));
+		}
+		// keep a per-byte trace of bus accesses, written to <game>.trace if something goes wrong
+		else if(!strcmp(argv[i], "--verbose-trace"))
+		{
+			gTrace.Enable();
+		}
+		// rom image the simulated cart is backed by
+		else if(!strncmp(argv[i], "--cart=", 7))
+		{
+			gpSimCartFileName = argv[i] + 7;
+		}
+		// sram image the simulated cart starts with, written back when we're done
+		else if(!strncmp(argv[i], "--cart-sram=", 12))
+		{
+			gpSimSRAMFileName = argv[i] + 12;
+		}
+		// how much each --bench workload moves, and where the results go
+		else if(!strncmp(argv[i], "--bench-bytes=", 14))
+		{
+			gBenchBytes = strtoul(argv[i] + 14, nullptr, 0);
+		}
+		else if(!strncmp(argv[i], "--bench-json=", 13))
+		{
+			gpBenchJsonFileName = argv[i] + 13;
+		}
+		// let --bench's SRAM round trip write over a real cart's save, see RunBusBench
+		else if(!strcmp(argv[i], "--bench-sram"))
+		{
+			gBenchSRAM = true;
+		}
+		// only write the SRAM bytes that differ from the cart's, and check them
+		else if(!strcmp(argv[i], "--sram-diff"))
+		{
+			gSRAMDiff = true;
+		}
+		// pick an interrupted dump back up from its journal instead of starting again
+		else if(!strcmp(argv[i], "--resume"))
+		{
+			gResume = true;
+		}
+		// where the compiled DAT lives, and whether to name dumps after what it calls them
+		else if(!strncmp(argv[i], "--dat-index=", 12))
+		{
+			gpDatIndexFileName = argv[i] + 12;
+		}
+		else if(!strcmp(argv[i], "--auto-name"))
+		{
+			gAutoName = true;
+		}
+		// majority voted dumps, see ReadVerifier.h
+		else if(!strncmp(argv[i], "--verify=", 9))
+		{
+			gVerifySamples = atoi(argv[i] + 9);
+		}
+		else if(!strncmp(argv[i], "--verify-max=", 13))
+		{
+			gVerifyMaxSamples = atoi(argv[i] + 13);
+		}
+		else if(!strncmp(argv[i], "--verify-stretch=", 17))
+		{
+			gVerifyStretchPercent = atoi(argv[i] + 17);
+		}
+		// the simulated cart's dirty contacts, in bit flips per million reads
+		else if(!strncmp(argv[i], "--cart-flaky=", 13))
+		{
+			gSimFlakyPerMillion = atoi(argv[i] + 13);
+		}
+		// cart presence from a sense line or from probing the header, see CartDetector.h
+		else if(!strcmp(argv[i], "--cart-detect=sense"))
+		{
+			gCartDetectMode = CartDetectMode::Sense;
+		}
+		else if(!strcmp(argv[i], "--cart-detect=header"))
+		{
+			gCartDetectMode = CartDetectMode::Header;
+		}
+		// how many swaps --detect-check runs, and how long the simulated cart's contacts bounce for
+		else if(!strncmp(argv[i], "--detect-swaps=", 15))
+		{
+			gDetectSwaps = atoi(argv[i] + 15);
+		}
+		else if(!strncmp(argv[i], "--cart-bounce=", 14))
+		{
+			gSimBounceMs = atoi(argv[i] + 14);
+		}
+		// the simulated cart comes out and goes back in over this many ms, for --cart-detect sessions
+		else if(!strncmp(argv[i], "--cart-swap=", 12))
+		{
+			gSimSwapMs = atoi(argv[i] + 12);
+		}
+		else if(!strcmp(argv[i], "--line-stats"))
+		{
+			gPrintLineStats = true;
+		}
+		// bus commands on a pinned SCHED_FIFO thread, see Realtime.h
+		else if(!strcmp(argv[i], "--realtime"))
+		{
+			gRealtime = true;
+		}
+		else if(!strncmp(argv[i], "--realtime-cpu=", 15))
+		{
+			gRealtime = true;
+			gRealtimeCpu = atoi(argv[i] + 15);
+		}
+		// the address on 74HC595s off a spidev device, or 'sim' for the sim cart's, see AddressShifter.h
+		else if(!strncmp(argv[i], "--address-spi=", 14))
+		{
+			gpAddressSpiName = argv[i] + 14;
+		}
+		else if(!strncmp(argv[i], "--spi-speed=", 12))
+		{
+			gSpiSpeedHz = atoi(argv[i] + 12);
+		}
+		// read runs with /ROMSEL held and the next address going out straight after each read, see ReadCartRunPipelined
+		else if(!strcmp(argv[i], "--pipeline"))
+		{
+			gPipelinedReads = true;
+		}
+		// where --batch writes how every job went
+		else if(!strncmp(argv[i], "--batch-json=", 13))
+		{
+			gpBatchJsonFileName = argv[i] + 13;
+		}
+		// where copyromd listens, and where --client finds it
+		else if(!strncmp(argv[i], "--socket=", 9))
+		{
+			gpSocketPath = argv[i] + 9;
+		}
+		else
+		{
+			argv[numArgs++] = argv[i];
+		}
+	}
 	
-	char sramFileName[300] = { 0 };
-	snprintf(sramFileName, sizeof(sramFileName) - 1, "./%s.srm", pRomInfo->mRomName);
-	
-	FILE* pFile = fopen(sramFileName, "wb");
-	if(pFile)
+	argc = numArgs;
+}
+
+SimCart gSimCart;
+bool gUsingSimCart = false;
+
+bool LoadSimCart()
+{
+	if(!gSimCart.Load(gpSimCartFileName))
 	{
-		printf("ReadSRAM: Wrote contents to file '%s'\n", sramFileName);
-		fwrite(gSRAMBuffer, pRomInfo->mSRAMSize, 1, pFile);
-		
-		fclose(pFile);
-		pFile = NULL;
+		return false;
 	}
-	else
+	
+	if(gpSimSRAMFileName && !gSimCart.LoadSRAM(gpSimSRAMFileName))
 	{
-		printf("Failed to open file '%s' for write!\n", sramFileName);
+		return false;
 	}
+	
+	gSimCart.SetFlakiness(gSimFlakyPerMillion);
+	gSimCart.SetSwapSchedule(gSimSwapMs, gSimBounceMs, 0);
+	gUsingSimCart = true;
+	return true;
 }
 
-//todo: reading a single bank (0 - 32768) for smw worked!!!! now im trying to read all its banks, but 
-// a little confused on loRom banking. see https://snes.nesdev.org/wiki/Memory_map
-char gRomBuffer[1024 * 1024 * 10]; //ten megs, whatever.
-
-// this perfectly reads SMW consistently, and is binary identical to known dumps. But doesn't work for Pushover.
-void DumpROM(RomInfo* pRomInfo)
+// gpiod: libgpiod on gpChipName (the default, works anywhere the kernel has a gpio driver)
+// mmio: the SoC's GPIO registers through /dev/gpiomem, Pi 1-4 and Pi 5 (RP1)
+// mmio-fake: the mmio backend on an anonymous register file, with a simulated cart on the other end
+// sim: a simulated cart with nothing in between, for benchmarking and checking bus timing on any host
+GPIOBackend* CreateBackend()
 {
-	uint32_t lowRomNumBanks = 0xFF;
-	uint32_t lowRomBankSize = 32768;
-	
-	// try reading the banks!
-	usleep(1);
-	for(uint32_t c = 0; c < lowRomNumBanks; c++ )
+	if(!strcmp(gpBackendName, "gpiod"))
 	{
-		for(uint32_t i = 0; i < lowRomBankSize; i++ )
+		return new GPIODBackend(gpChipName);
+	}
+	else if(!strcmp(gpBackendName, "mmio"))
+	{
+		return new MMIOBackend(gSoC);
+	}
+	else if(!strcmp(gpBackendName, "mmio-fake"))
+	{
+		if(!LoadSimCart())
 		{
-			uint32_t address = (c << 16) | i;
-			
-			gCartEnable.Write(1);
-			usleep(2);
-			
-			 // read
-			 gAddressLines.SetAddress(address);
-			 usleep(2);
-			 
-			 gDataLines.HiZ();
-			 usleep(2);
-			 
-			 gCartEnable.Write(0);
-			 usleep(2);
-			
-			 uint8_t value = gDataLines.Read();
-			 usleep(2);
-			 gRomBuffer[(c * lowRomBankSize) + i] = value;
-			 printf("%x: %x\n", address, value);
-			 
-			 gDataLines.HiZ();
-			 usleep(2);
+			return nullptr;
 		}
-	
+		
+		return new MMIOBackend(&gSimCart, gSoC);
 	}
-	char romFileName[300] = { 0 };
-	snprintf(romFileName, sizeof(romFileName) - 1, "./%s.smc", pRomInfo->mRomName);
-	
-	FILE* pFile = fopen(romFileName, "wb");
-	if(pFile)
+	else if(!strcmp(gpBackendName, "sim"))
 	{
-		printf("DumpROM: Wrote contents to file '%s'\n", romFileName);
-		fwrite(gRomBuffer, lowRomNumBanks * lowRomBankSize, 1, pFile);
+		if(!LoadSimCart())
+		{
+			return nullptr;
+		}
 		
-		fclose(pFile);
-		pFile = NULL;
+		return new SimBackend(&gSimCart);
 	}
-	else
+	
+	printf("Unknown backend '%s'\n", gpBackendName);
+	return nullptr;
+}
+
+SpiDevice* CreateAddressSpi()
+{
+	if(!strcmp(gpAddressSpiName, "sim"))
 	{
-		printf("Failed to open file '%s' for write!\n", romFileName);
+		if(!gUsingSimCart)
+		{
+			printf("--address-spi=sim needs the sim cart (--backend=sim or mmio-fake)\n");
+			return nullptr;
+		}
+		
+		return new SimSpiDevice(&gSimCart);
 	}
+	
+	return new SpidevDevice(gpAddressSpiName, gSpiSpeedHz);
 }
 
-// this worked for pushover, except im reading too much of each bank
-/*
-void DumpROM(RomInfo* pRomInfo)
+int main(int argc, const char** argv)
 {
-	uint32_t lowRomNumBanks = 16;
-	uint32_t lowRomBankSize = 32768;
+	ParseOptions(argc, argv);
+	gVerifier.Configure(gVerifySamples, gVerifyMaxSamples, gVerifyStretchPercent);
 	
-	uint32_t fullSize = lowRomNumBanks * lowRomBankSize;
+	// installed as copyromd (see the makefile) it's the daemon without having to say so
+	const char* pProgramName = strrchr(argv[0], '/');
+	if(argc == 1 && !strcmp(pProgramName ? pProgramName + 1 : argv[0], "copyromd"))
+	{
+		argv[argc++] = "--daemon";
+	}
 	
-	// try reading the banks!
-	usleep(1);
-	for(uint32_t i = 0; i < fullSize; i++ )
+	if(argc == 1)
 	{
-		uint32_t address = i;
-		
-		gCartEnable.Write(1);
-		usleep(10);
-		
-		 // read
-		 gAddressLines.SetAddress(address);
-		 usleep(10);
-		 
-		 gDataLines.HiZ();
-		 usleep(10);
-		 
-		 gCartEnable.Write(0);
-		 usleep(10);
-		
-		 uint8_t value = gDataLines.Read();
-		 usleep(10);
-		 gRomBuffer[i] = value;
-		 printf("%x: %x\n", address, value);
-		 
-		 gDataLines.HiZ();
-		 usleep(10);
+		printf("Not enough arguments supplied!\n");
+		printf("Try --game [gamename]\n");
+		return 0;
 	}
-	char romFileName[300] = { 0 };
-	snprintf(romFileName, sizeof(romFileName) - 1, "./%s.smc", pRomInfo->mRomName);
 	
-	FILE* pFile = fopen(romFileName, "wb");
-	if(pFile)
+	// scripts run the client a lot, so it doesn't wait on the delay calibration it has no use for
+	if(!strcmp(argv[1], "--client"))
 	{
-		printf("DumpROM: Wrote contents to file '%s'\n", romFileName);
-		fwrite(gRomBuffer, fullSize, 1, pFile);
-		
-		fclose(pFile);
-		pFile = NULL;
+		return RunDaemonClient(gpSocketPath, argc - 2, argv + 2) ? 0 : 1;
 	}
-	else
+	
+	CalibrateDelays();
+	SetCartSpeed(gCartSpeed, gDelayScalePercent);
+	
+	// commands that never touch the bus, so they work without any backend
+	if(!strcmp(argv[1], "--bench-encoder"))
 	{
-		printf("Failed to open file '%s' for write!\n", romFileName);
+		RunEncoderBench();
+		return 0;
 	}
-}*/
-
-void RunMain(const char* pRomName)
-{
-	RomInfo* pRomInfo = GetRomInfo(pRomName);
-	if(!pRomInfo)
+	else if(!strcmp(argv[1], "--timing-selftest"))
 	{
-		printf("Could not find rom info for rom '%s'\n", pRomName);
-		return;
+		return RunTimingSelfTest() ? 0 : 1;
+	}
+	else if(!strcmp(argv[1], "--mapper-selftest"))
+	{
+		return RunMapperSelfTest() ? 0 : 1;
+	}
+	else if(!strcmp(argv[1], "--print-trace") && argc > 2)
+	{
+		PrintTraceFile(argv[2]);
+		return 0;
+	}
+	else if(!strcmp(argv[1], "--compile-dat") && argc > 2)
+	{
+		CompileDat(argv[2], gpDatIndexFileName);
+		return 0;
+	}
+	else if(!strcmp(argv[1], "--identify") && argc > 2)
+	{
+		IdentifyRomFile(argv[2]);
+		return 0;
 	}
 	
-	// Configure lines for cartridge insertion
-	gWriteEnable.Write(1);
-	usleep(100);
-	
-	gReset.Write(0);
-	usleep(100);
-	
-	gCartEnable.Write(1);
-	usleep(100);
+	// the sim's 595s have no pins to clash with
+	if(gCartDetectMode == CartDetectMode::Sense && gpAddressSpiName && strcmp(gpAddressSpiName, "sim"))
+	{
+		printf("--cart-detect=sense needs GPIO11, which --address-spi uses for SCLK. Try --cart-detect=header\n");
+		return 0;
+	}
 	
-	gAddressLines.HiZ();
-	gDataLines.HiZ();
-	usleep(100);
-	//
+	if(gRealtime)
+	{
+		EnableRealtime(gRealtimeCpu);
+	}
 	
-	printf("INSERT GAME and press any key.\n");
-	while(!getchar())
+	gpBackend = CreateBackend();
+	if(!gpBackend || !gpBackend->Open())
 	{
+		printf("open backend '%s' failed\n", gpBackendName);
+		delete gpBackend;
+		return 0;
 	}
 	
-	// Set Reset High so we send sram 5v and can read/write.
-	gReset.Write(1);
-	usleep(100);
-
-	bool shouldExit = false;	
-	while(!shouldExit)
+	SpiDevice* pAddressSpi = nullptr;
+	AddressShifter* pAddressShifter = nullptr;
+	if(gpAddressSpiName)
 	{
-		printf("[R]ead from SRAM\n");
-		printf("[W]rite to SRAM\n");
-		printf("[D]ump ROM\n");
-		printf("E[x]it\n");
-		printf("Your Selection: ");
-
-		uint32_t inputChoice = 0;
-		uint32_t c = 0;
-		do
-		{
-			c = getchar();
-			if(c != '\n')
-			{
-				inputChoice = c;
-			}
-		}
-		while(c != '\n');
-			
-		switch(inputChoice)
+		pAddressSpi = CreateAddressSpi();
+		if(!pAddressSpi || !pAddressSpi->Open())
 		{
-			case 'r':
-			{
-				ReadSRAM(pRomInfo);
-				break;
-			}
-			
-			case 'w':
-			{
-				WriteSRAM(pRomInfo);
-				break;
-			}
-			
-			case 'd':
-			{
-				DumpROM(pRomInfo);
-				break;
-			}
-			
-			case 'x':
-			{
-				shouldExit = true;
-				break;
-			}
-			
-			default:
-			{
-				printf("Unknown choice '%c'\n", inputChoice);
-				break;
-			}
+			printf("open address spi '%s' failed\n", gpAddressSpiName);
+			delete pAddressSpi;
+			gpBackend->Close();
+			delete gpBackend;
+			return 0;
 		}
+		
+		pAddressShifter = new AddressShifter(pAddressSpi);
+		gAddressLines.SetShifter(pAddressShifter);
 	}
 	
+	// setup bus lines
+	gAddressLines.Create(gpBackend);
+	gDataLines.Create(gpBackend);
+	gWriteEnable.Create(gpBackend);
+	gReset.Create(gpBackend);
+	gCartEnable.Create(gpBackend);
+	gCartDetector.Create(gpBackend, gCartDetectMode);
 	
-	// Configure lines for removing cartridge
-	gWriteEnable.Write(1);
-	usleep(100);
-	
-	gCartEnable.Write(1);
-	usleep(100);
-	
-	gReset.Write(0);
-	usleep(100);
-	
-	gAddressLines.HiZ();
-	gDataLines.HiZ();
-	usleep(100);
+	// what the exit code says, so CI can run the checks against the sim on plain Linux
+	bool succeeded = true;
 	
-	printf("REMOVE CARTRIDGE and press any key.\n");
-	while(!getchar())
+	if(!strcmp(argv[1], "--bench"))
 	{
+		// the sim's SRAM is nobody's save
+		succeeded = RunBusBench(gpBackend, gpBackendName, gBenchBytes, gpBenchJsonFileName, gBenchSRAM || gUsingSimCart);
 	}
-}
-
-int main(int argc, const char** argv)
-{
-	if(argc == 1)
+	else if(!strcmp(argv[1], "--pipeline-check"))
 	{
-		printf("Not enough arguments supplied!\n");
-		printf("Try --game [gamename]\n");
-		return 0;
+		succeeded = RunPipelineCheck(gBenchBytes, gUsingSimCart ? &gSimCart : nullptr);
 	}
-	
-	const char chipName[] = "gpiochip0";
-	
-	gpiod_chip* pChip = gpiod_chip_open_by_name(chipName);
-	if(!pChip)
+	else if(!strcmp(argv[1], "--detect-check"))
 	{
-		printf("open chip failed\n");
-		return 0;
+		succeeded = RunDetectCheck(&gCartDetector, gUsingSimCart ? &gSimCart : nullptr, gDetectSwaps, gSimBounceMs);
 	}
-	
-	if(!CreateRomInfos())
+	else if(!strcmp(argv[1], "--daemon"))
 	{
-		printf("Failed to create Rom Infos\n");
-		return 0;
+		RunCartDaemon(gpSocketPath);
 	}
-	
-	// setup bus lines
-	gAddressLines.Create(pChip, gAddressLineIndices, gLatch8Thru15LineIndex, gBankAddressBusIndices, gLatch16Thru19Index);
-	gDataLines.Create(pChip, gDataLineIndices);
-	gWriteEnable.Create(pChip, gWriteLineIndices);
-	gReset.Create(pChip, gResetLineIndices);
-	gCartEnable.Create(pChip, gCartEnableLineIndices);
-	
-	if(!strcmp(argv[1], "--game"))
+	else if(!strcmp(argv[1], "--batch"))
+	{
+		if(argc == 3)
+		{
+			RunBatch(argv[2]);
+		}
+		else
+		{
+			printf("Not enough args for '--batch'. Expected '--batch [manifest]'\n");
+		}
+	}
+	else if(!strcmp(argv[1], "--game"))
 	{
 		if(argc == 3)
 		{
@@ -988,6 +1800,14 @@ int main(int argc, const char** argv)
 				uint8_t value = atoi(argv[2]);
 				gDataLines.Write(0x1 << value);
 			}
+			else if(!strcmp(argv[1], "--read-address"))
+			{
+				uint32_t address = strtoul(argv[2], nullptr, 0);
+				
+				gWriteEnable.Write(1);
+				printf("%x: %x\n", address, ReadRomByte(address));
+				gCartEnable.Write(1);
+			}
 		}
 		else if(argc > 1)
 		{
@@ -1003,6 +1823,13 @@ int main(int argc, const char** argv)
 				gDataLines.Write(0);
 				gWriteEnable.Write(0);
 			}
+			else if(!strcmp(argv[1], "--probe-header"))
+			{
+				RomInfo romInfo;
+				gWriteEnable.Write(1);
+				ProbeRomInfo(ReadRomByte, &romInfo);
+				gCartEnable.Write(1);
+			}
 			else if(!strcmp(argv[1], "--hiz"))
 			{
 				gAddressLines.HiZ();
@@ -1017,17 +1844,43 @@ int main(int argc, const char** argv)
 	}
 	//
 	
+	if(gPrintLineStats)
+	{
+		gAddressLines.PrintStats();
+		gDataLines.PrintStats("Data");
+		gWriteEnable.PrintStats("WriteEnable");
+		gReset.PrintStats("Reset");
+		gCartEnable.PrintStats("CartEnable");
+	}
+	
+	gCartDetector.Release();
 	gAddressLines.Release();
 	gDataLines.Release();
 	gCartEnable.Release();
 	gWriteEnable.Release();
 	gReset.Release();
 	
-	if(pChip)
+	if(pAddressSpi)
+	{
+		gAddressLines.SetShifter(nullptr);
+		delete pAddressShifter;
+		
+		pAddressSpi->Close();
+		delete pAddressSpi;
+	}
+	
+	gpBackend->Close();
+	delete gpBackend;
+	gpBackend = nullptr;
+	
+	if(gUsingSimCart)
 	{
-		gpiod_chip_close(pChip);
-		pChip = nullptr;
+		gSimCart.PrintViolations();
+		gSimCart.SaveSRAM();
+		
+		// a bus access the real cart wouldn't have kept up with fails whatever was run
+		succeeded = succeeded && gSimCart.GetNumViolations() == 0;
 	}
 	
-	return 0;
+	return succeeded ? 0 : 1;
 }
\ No newline at end of file